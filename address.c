@@ -0,0 +1,138 @@
+#include "ccatd.h"
+
+// Folding of address computations into the memory operands of loads and
+// stores.
+//
+// The address a load or store reads is followed back through the additions
+// of constants and registers, the scaling of an index by 1, 2, 4 or 8, and
+// the address of a local or global variable it was computed from, until it
+// has the form of an x86 memory operand:
+//
+//   [base + index * scale + disp]   base: a register, the frame or a symbol
+//
+// A global is addressed relative to rip, which leaves no room for an index.
+//
+// This moves the reads of the registers the address was computed from to the
+// access, so only registers with a single definition, which hold the same
+// value wherever they are read, are folded. The computation is left for the
+// dead-code elimination to remove once nothing else reads it. It is run last,
+// as the other passes read the address of an access only from a.
+
+static Inst **defs;
+
+// the constant v holds as 8 bytes, if it's known
+static bool const_of(int v, int *c) {
+    Inst *def = defs[v];
+    if (def != NULL && def->kind == IR_SEXT && def->imm == 4) {
+        def = defs[def->a];
+        if (def == NULL || def->kind != IR_IMM)
+            return false;
+        *c = def->imm;
+        return true;
+    }
+    if (def == NULL || def->kind != IR_IMM || (def->size == 4 && def->imm < 0))
+        return false;
+    *c = def->imm;
+    return true;
+}
+
+// the displacement fits in 32 bits even after adding or scaling a few more
+static bool small(int disp) {
+    return -16777216 < disp && disp < 16777216;
+}
+
+// the index scaled by the shift or multiplication defining v, if any
+static bool scaled(int v, int *index, int *scale) {
+    Inst *def = defs[v];
+    int c;
+    if (def == NULL || def->size != 8 || defs[def->a] == NULL || !const_of(def->b, &c))
+        return false;
+    if (def->kind == IR_SHL && 0 <= c && c <= 3)
+        *scale = 1 << c;
+    else if (def->kind == IR_MUL && (c == 1 || c == 2 || c == 4 || c == 8))
+        *scale = c;
+    else
+        return false;
+    *index = def->a;
+    return true;
+}
+
+static void fold(Inst *inst) {
+    int base = inst->a;
+    int index = 0;
+    int scale = 1;
+    int disp = 0;
+    while (true) {
+        Inst *def = defs[base];
+        int c;
+        if (def == NULL)
+            break;
+        if (def->kind == IR_ADD && def->size == 8 && const_of(def->b, &c) && defs[def->a]) {
+            if (!small(c) || !small(disp + c))
+                break;
+            base = def->a;
+            disp = disp + c;
+        } else if (def->kind == IR_SUB && def->size == 8 && const_of(def->b, &c) && defs[def->a]) {
+            if (!small(c) || !small(disp - c))
+                break;
+            base = def->a;
+            disp = disp - c;
+        } else if (def->kind == IR_ADD && def->size == 8 && index == 0
+                   && defs[def->a] && defs[def->b]) {
+            // the scaled operand, if either is, becomes the index
+            base = def->a;
+            index = def->b;
+            if (scaled(def->a, &c, &scale)) {
+                base = def->b;
+                index = c;
+            } else if (scaled(def->b, &c, &scale)) {
+                index = c;
+            }
+        } else {
+            break;
+        }
+    }
+
+    // a constant index, or one added to it, is scaled into the displacement
+    while (index != 0) {
+        Inst *def = defs[index];
+        int c;
+        if (const_of(index, &c) && small(c) && small(disp + c * scale)) {
+            index = 0;
+            disp = disp + c * scale;
+            break;
+        }
+        if (def->kind != IR_ADD || def->size != 8 || !const_of(def->b, &c) || defs[def->a] == NULL
+            || !small(c) || !small(disp + c * scale))
+            break;
+        index = def->a;
+        disp = disp + c * scale;
+    }
+
+    Inst *def = defs[base];
+    if (def != NULL && def->kind == IR_LADDR) {
+        inst->a = 0;
+        inst->name = NULL;
+        disp = disp - def->imm;
+    } else if (def != NULL && def->kind == IR_GADDR && index == 0) {
+        inst->a = 0;
+        inst->name = def->name;
+    } else {
+        inst->a = base;
+    }
+    inst->index = index;
+    inst->scale = scale;
+    inst->imm = disp;
+}
+
+void fold_addresses(IRFunc *ir) {
+    defs = single_defs(ir);
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            if ((inst->kind == IR_LOAD || inst->kind == IR_STORE) && defs[inst->a] != NULL)
+                fold(inst);
+        }
+    }
+}
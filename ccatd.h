@@ -5,11 +5,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 // struct declarations
 
 struct Location;
-struct Token;
 struct Node;
 struct Vector;
 struct StringBuilder;
@@ -18,9 +21,12 @@ struct Struct;
 struct Type;
 struct String;
 struct Environment;
+struct Scope;
+struct Inst;
+struct BB;
+struct IRFunc;
 
 typedef struct Location Location;
-typedef struct Token Token;
 typedef struct Node Node;
 typedef struct Vector Vec;
 typedef struct StringBuilder StringBuilder;
@@ -30,6 +36,10 @@ typedef struct Struct Struct;
 typedef struct Type Type;
 typedef struct String String;
 typedef struct Environment Environment;
+typedef struct Scope Scope;
+typedef struct Inst Inst;
+typedef struct BB BB;
+typedef struct IRFunc IRFunc;
 
 // containers
 
@@ -38,11 +48,13 @@ void vec_push(Vec *vec, void *node);
 void *vec_pop(Vec *vec);
 int vec_len(Vec *vec);
 void *vec_at(Vec *vec, int idx);
+void vec_set(Vec *vec, int idx, void *node);
 
 StringBuilder *strbld_new();
 char *strbld_build(StringBuilder *sb);
 void strbld_append(StringBuilder *sb, char ch);
 void strbld_append_str(StringBuilder *sb, char *ch);
+void strbld_append_mem(StringBuilder *sb, char *str, int len);
 
 struct Map {
     Vec *keys;
@@ -64,11 +76,17 @@ Environment *env_next(Environment *e);
 void env_push(Environment *e, char *k, void *v);
 void *env_find(Environment *e, char *k);
 
+Scope *scope_new();
+void scope_enter(Scope *s);
+void scope_leave(Scope *s);
+void scope_push(Scope *s, char *k, void *v);
+void *scope_find(Scope *s, char *k);
+void *scope_find_local(Scope *s, char *k);
+
 // util
 
 void error(char *fmt, ...);
-void error_loc(Location *loc, char *fmt, ...);
-void error_loc2(int line, int col, char *fmt, ...);
+void error_loc(int loc, char *fmt, ...);
 void debug(char *fmt, ...);
 char *mkstr(char *ptr, int len);
 char *escape_string(char* str);
@@ -89,17 +107,17 @@ typedef enum {
     TK_STRING
 } Token_kind;
 
-struct Token {
-    Token_kind kind;
-    Token *next;
-    int val;
-    char *str;
-    Location *loc;
-};
-
-extern Vec *tokens;
+extern char *source;
+extern int num_tokens;
+extern Token_kind *token_kinds;
+extern int *token_vals;
+extern int *token_locs;
+extern int *token_lens;
+extern int tokenize_jobs;
 
 void tokenize(char *p);
+char *token_str(int tk);
+Location *location_of(int loc);
 
 // parse
 
@@ -169,21 +187,21 @@ typedef enum {
     ND_DEFAULT
 } Node_kind;
 
+// scalars come first to keep the node free of padding
 struct Node {
     Node_kind kind;
+    int val;
+    int loc; // source offset
+    bool is_extern;
+    bool is_static;
+    bool is_enum;
     Node *cond;
     Node *lhs;
     Node *rhs;
     Node *body;
     Vec *block;
-    int val;
-    char *name;
+    char *name; // variable, function, label or (ND_ATTR) field name
     Type *type;
-    Location *loc;
-    Token *attr;
-    bool is_extern;
-    bool is_static;
-    bool is_enum;
 };
 
 struct Func {
@@ -193,16 +211,17 @@ struct Func {
     int offset;
     Type *ret_type;
     Map *global_vars;
-    Location *loc;
+    int loc;
     bool is_extern;
     bool is_static;
+    bool is_inline;
     bool is_varargs;
 };
 
 struct Struct {
     char *name;
     Vec *fields;
-    Location *loc;
+    int loc;
 };
 
 extern Vec *functions;
@@ -212,7 +231,8 @@ extern Environment *builtin_aliases;
 
 void parse();
 
-Node *mknum(int v, Location *loc);
+Node *node_new();
+Node *mknum(int v, int loc);
 
 // type
 
@@ -233,7 +253,7 @@ struct Type {
     int array_size;
     Struct *strct;
     bool enum_decl;
-    Vec *enums;
+    Vec *enums; // enumerator nodes (ND_GVAR with is_enum)
 };
 
 extern Type *type_int;
@@ -266,3 +286,218 @@ void sema_func(Func *func);
 
 void gen_globals();
 void gen_func(Func *func);
+
+// intermediate representation
+
+typedef enum {
+    IR_IMM,     // dst = imm
+    IR_MOV,     // dst = a
+    IR_PARAM,   // dst = the imm-th argument
+    IR_LADDR,   // dst = the address of the local variable at rbp - imm
+    IR_GADDR,   // dst = the address of the symbol `name'
+    IR_LOAD,    // dst = [address], reading `size' bytes
+    IR_STORE,   // [address] = b, writing `size' bytes
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_MULH,    // dst = the upper half of the signed product of a and b
+    IR_DIV,
+    IR_MOD,
+    IR_AND,
+    IR_OR,
+    IR_XOR,
+    IR_SHL,
+    IR_SHR,     // logical
+    IR_SAR,     // arithmetic
+    IR_EQ,      // dst = a == b ? 1 : 0
+    IR_NE,
+    IR_LT,
+    IR_LE,
+    IR_NOT,     // dst = ~a
+    IR_SEXT,    // dst = a sign-extended from imm bytes
+    IR_CALL,    // dst = name(args...)
+    IR_VASTART, // initializes the va_list at a
+
+    // terminators
+    IR_JMP,     // goto then
+    IR_BR,      // if (a) goto then; else goto els, expected to go to then if
+                // imm is 1 and to els if it is -1
+    IR_SWITCH,  // goto targets[i] if a == cases[i]; otherwise goto els
+    IR_RET      // return a (or nothing if a is 0)
+} Inst_kind;
+
+// Virtual registers are numbered from 1 and 0 means none. They are not in
+// SSA form; a register may be assigned in several blocks.
+//
+// The address of a load or store is a until fold_addresses() runs, and then
+// a + index * scale + imm, where the base a is 0 for the symbol `name' if
+// set, or for rbp otherwise.
+struct Inst {
+    Inst_kind kind;
+    int size; // width of the operation (4 or 8), or of the access (1, 4 or 8)
+    int dst;
+    int a;
+    int b;
+    int imm;
+    int nargs;
+    int *args;  // IR_CALL
+    int *cases; // IR_SWITCH
+    char *name; // IR_GADDR, IR_CALL, IR_LOAD, IR_STORE
+    int index;  // IR_LOAD, IR_STORE
+    int scale;
+    BB *then;
+    BB *els;
+    Vec *targets; // IR_SWITCH
+    bool is_tail; // IR_CALL: made as a jump, followed by the return of its value
+};
+
+struct BB {
+    int id;
+    Vec *insts; // ends with exactly one terminator
+};
+
+struct IRFunc {
+    Func *func;
+    Vec *blocks; // in the output order; the first one is the entry
+    int num_vregs;
+    int num_bbs;
+    int frame;   // the bytes taken by the local variables below rbp
+
+    // filled by reg_alloc()
+    int *regs;     // the register of each virtual register, or -1 if spilled
+    int *slots;    // the stack slot of each spilled virtual register
+    int num_slots;
+
+    int *freq;     // the runs of each block by its id in the profile, or NULL
+
+    // cached by the pass manager, or NULL until computed again
+    Vec **preds;
+    BB **idoms;
+    int **live_in;
+    int **live_out;
+};
+
+BB *bb_new(IRFunc *ir);
+Inst *inst_new(Inst_kind kind, int size);
+bool is_terminator(Inst *inst);
+bool has_dst(Inst *inst);
+int inst_uses(Inst *inst, int *uses);
+Inst *bb_term(BB *bb);
+int bb_num_succs(BB *bb);
+BB *bb_succ(BB *bb, int i);
+Inst **single_defs(IRFunc *ir);
+Inst *reaching_def(BB *bb, int pos, int v, Inst **single);
+bool *escaped_locals(IRFunc *ir, Inst **defs);
+bool may_alias(Inst *s, int store_size, Inst *l, int load_size, bool *escaped);
+int *vset_new(IRFunc *ir);
+bool vset_has(int *set, int v);
+void vset_add(int *set, int v);
+void vset_del(int *set, int v);
+int *vset_copy(IRFunc *ir, int *set);
+int *block_index(IRFunc *ir);
+void compute_liveness(IRFunc *ir, int **live_in, int **live_out);
+Vec **compute_preds(IRFunc *ir);
+Vec *reverse_postorder(IRFunc *ir);
+bool remove_unreachable(IRFunc *ir);
+BB **compute_idoms(IRFunc *ir);
+bool dominates(BB **idom, BB *a, BB *b);
+void ir_dump(IRFunc *ir);
+void ir_verify(IRFunc *ir);
+
+IRFunc *gen_ir(Func *func);
+
+// dead-code elimination and CFG simplification
+
+void simplify_cfg(IRFunc *ir);
+void eliminate_dead_code(IRFunc *ir);
+
+// promotion of scalar locals
+
+void promote_locals(IRFunc *ir);
+
+// tail calls
+
+void eliminate_tail_calls(IRFunc *ir);
+
+// global value numbering
+
+void number_values(IRFunc *ir);
+
+// loop-invariant code motion
+
+void hoist_invariants(IRFunc *ir);
+
+// strength reduction
+
+int exact_log2(int c);
+void div_magic(int d, int *magic, int *shift);
+int mul_inverse(int d);
+void reduce_strength(IRFunc *ir);
+
+// addressing modes
+
+void fold_addresses(IRFunc *ir);
+
+// inlining
+
+extern int inline_threshold;
+
+bool inline_calls(IRFunc *ir, Map *bodies);
+Vec *drop_inlined(Vec *irs);
+
+// pass manager
+
+extern bool time_passes;
+extern bool verify_each;
+
+Vec **get_preds(IRFunc *ir);
+BB **get_idoms(IRFunc *ir);
+int **get_live_in(IRFunc *ir);
+int **get_live_out(IRFunc *ir);
+void invalidate_liveness(IRFunc *ir);
+void invalidate_analyses(IRFunc *ir);
+void run_pass(IRFunc *ir, char *name);
+void set_pipeline(char *passes);
+void set_opt_level(int level);
+Vec *run_pipeline(Vec *irs);
+void print_pass_times();
+
+// profile-guided optimization
+
+extern char *profile_generate;
+
+void profile_func(IRFunc *ir);
+void profile_block(BB *bb);
+void profile_call(Inst *call);
+void gen_profile_runtime();
+void load_profile(char *text);
+Vec *apply_profile(Vec *irs);
+
+// block layout
+
+void lay_out_blocks(IRFunc *ir, int *freq);
+void place_blocks(IRFunc *ir);
+
+// x86-64 backend
+
+typedef enum {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+} Reg;
+
+extern bool omit_frame_pointer;
+
+void reg_alloc(IRFunc *ir);
+void gen_x86(IRFunc *ir);
+
+// switch dispatch
+
+void gen_switch_dispatch(char *reg, int *cases, char **case_labels, int n, char *dflt, int *case_weights);
+
+// peephole
+
+extern bool peephole_stats;
+
+void emitf(char *fmt, ...);
+void flush_asm();
+void print_peephole_stats();
@@ -11,18 +11,21 @@ static void gen_lval(Node* n, Func *f);
 static void gen_coeff_ptr(Type* t1, Type* t2);
 static void extend_rax(int dst, int src);
 static void load_rax(int size);
+static void load_mem(int size, char *addr);
+static int index_scale(Type *lt, Type *rt);
 static char *rax_of_type(Type* t);
 static char *rdi_of_type(Type* t);
-
-static int resolve_enum_value(Vec *enums, char *name) {
-    int len = vec_len(enums);
-    for (int i = 0; i < len; i++) {
-        if (!strcmp(name, ((Token*) vec_at(enums, i))->str))
-            return i;
-    }
-    error("[internal] enum");
-    return -1;
-}
+static bool su_eligible(Node *n);
+static int su_need(Node *n);
+static void gen_su(Node *n, int *regs, int num_regs);
+static void gen_su_op(Node *n, int reg, char *src);
+static char *gen_su_operands(Node *n, int *regs, int num_regs);
+static void gen_branch(Node *n, Func *f, bool jump_if, char *label);
+static bool const_divisor(Node *n, int *d);
+static void gen_mul_imm(char *r32, char *r64, int c);
+static void gen_divmod_imm(int d, bool mod);
+static char *format_label(char *name, char *suffix);
+static char *numbered_label(char *prefix, int num);
 
 // generate global variables
 
@@ -40,7 +43,7 @@ void gen_globals() {
         Node *global = vec_at(global_vars->values, i);
         if (global->is_extern)
             continue;
-        if (is_enum(global->type))
+        if (global->is_enum)
             continue;
 
         printf("%s:\n", global->name);
@@ -69,18 +72,6 @@ void gen_const(Type *typ, Node *node) {
         printf("  .quad %s\n", node->lhs->name);
         return;
     case ND_GVAR:
-        if (is_enum(node->type)) {
-            int len = vec_len(node->type->enums);
-            for (int i = 0; i < len; i++) {
-                Token *e = vec_at(node->type->enums, i);
-                if (!strcmp(node->name, e->str)) {
-                    printf("  .long %d\n", i);
-                    return;
-                }
-            }
-            error_loc(node->loc, "[internal] enum");
-        }
-
         printf("  .quad %s\n", node->name);
         printf("\n");
         return;
@@ -205,61 +196,71 @@ bool is_assign_expr(Node_kind kind) {
 int label_num = 0;
 int stack_depth = 0;
 
+// the assembly label .L<name><suffix>
+static char *format_label(char *name, char *suffix) {
+    char *buf = calloc(strlen(name) + strlen(suffix) + 3, sizeof(char));
+    sprintf(buf, ".L%s%s", name, suffix);
+    return buf;
+}
+
+// the assembly label .L<prefix><num>
+static char *numbered_label(char *prefix, int num) {
+    char *buf = calloc(strlen(prefix) + 15, sizeof(char));
+    sprintf(buf, ".L%s%d", prefix, num);
+    return buf;
+}
+
 void gen_expr(Node *node, Func *func) {
+    if (node->lhs != NULL && node->rhs != NULL && su_eligible(node)) {
+        int regs[9] = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+        gen_su(node, regs, 9);
+        emitf("  push rax\n");
+        return;
+    }
+
     switch (node->kind) {
     case ND_NUM:
         // assuming `int'
-        printf("  mov eax, %d\n", node->val);
-        printf("  push %d\n", node->val);
+        emitf("  mov eax, %d\n", node->val);
+        emitf("  push %d\n", node->val);
         return;
     case ND_CHAR:
-        printf("  mov al, %d\n", node->val);
-        printf("  push %d\n", node->val);
+        emitf("  mov al, %d\n", node->val);
+        emitf("  push %d\n", node->val);
         return;
     case ND_STRING:
         for (int i = 0; i < vec_len(string_literals); i++) {
             char *str = vec_at(string_literals, i);
             if (!strcmp(node->name, str)) {
-                printf("  mov rax, OFFSET .LC%d\n", i);
-                printf("  push rax\n");
+                emitf("  lea rax, .LC%d[rip]\n", i);
+                emitf("  push rax\n");
                 return;
             }
         }
         error_loc(node->loc, "[internal] string not found\n");
-    case ND_VAR:
-        if (node->is_enum) {
-            int idx = resolve_enum_value(node->type->enums, node->name);
-            printf("  mov rax, %d\n", idx);
-            printf("  push %d\n", idx);
-            return;
-        }
-
-        printf("  mov rax, rbp\n");
-        printf("  sub rax, %d\n", node->val);
-
-        if (node->type->ty != TY_ARRAY)
-            load_rax(type_size(node->type));
-        printf("  push rax\n");
+    case ND_VAR: {
+        char *addr = calloc(20, sizeof(char));
+        sprintf(addr, "[rbp-%d]", node->val);
+        if (node->type->ty == TY_ARRAY)
+            emitf("  lea rax, %s\n", addr);
+        else
+            load_mem(type_size(node->type), addr);
+        emitf("  push rax\n");
         return;
-    case ND_GVAR:
+    }
+    case ND_GVAR: {
+        char *addr = calloc(strlen(node->name) + 10, sizeof(char));
+        sprintf(addr, "%s[rip]", node->name);
         if (node->type->ty == TY_ARRAY)
-            printf("  mov rax, OFFSET %s\n", node->name);
-        else if (is_enum(node->type)) {
-            int idx = resolve_enum_value(node->type->enums, node->name);
-            printf("  mov rax, %d\n", idx);
-            printf("  push %d\n", idx);
-            return;
-        } else {
-            char *rax = rax_of_type(node->type);
-            printf("  mov rax, OFFSET %s\n", node->name);
-            printf("  mov %s, [rax]\n", rax);
-        }
-
-        printf("  push rax\n");
+            emitf("  lea rax, %s\n", addr);
+        else
+            load_mem(type_size(node->type), addr);
+        emitf("  push rax\n");
         return;
+    }
     case ND_SEQ:
         gen_expr(node->lhs, func);
-        printf("  pop rax\n");
+        emitf("  pop rax\n");
         gen_expr(node->rhs, func);
         return;
     case ND_ASGN:
@@ -267,27 +268,32 @@ void gen_expr(Node *node, Func *func) {
         stack_depth += 8;
         gen_expr(node->rhs, func);
         stack_depth -= 8;
-        printf("  pop rax\n");
+        emitf("  pop rax\n");
         extend_rax(type_size(node->lhs->type), type_size(node->rhs->type));
-        printf("  mov rdi, [rsp]\n");
+        emitf("  mov rdi, [rsp]\n");
 
         char *rax = rax_of_type(node->type);
-        printf("  mov [rdi], %s\n", rax);
-        printf("  mov [rsp], %s\n", rax);
+        emitf("  mov [rdi], %s\n", rax);
+        emitf("  mov [rsp], %s\n", rax);
         return;
     case ND_CALL: {
+        // the hint is only taken by the IR
+        if (!strcmp("__builtin_expect", node->name)) {
+            gen_expr(vec_at(node->block, 0), func);
+            return;
+        }
         if (!strcmp("__builtin_va_start", node->name)) {
             // assuming this call is in va_start called by a variadic function
-            printf("  mov rax, [rbp-56]\n"); // ap
-            printf("  mov rdi, [rbp]\n");
-            printf("  add rdi, QWORD PTR [rdi-8]\n");
-            printf("  sub rdi, 56\n");
-            printf("  mov DWORD PTR [rax], 48\n"); // gp_offset
-            printf("  mov DWORD PTR [rax+4], 304\n"); // fp_offset
-            printf("  mov QWORD PTR [rax+8], rdi\n"); // overflow_arg_area
-            printf("  mov QWORD PTR [rax+16], 0\n"); // reg_save_area
-            printf("  mov rax, 0\n"); // # of floating point parameters
-            printf("  push rax\n");
+            emitf("  mov rax, [rbp-56]\n"); // ap
+            emitf("  mov rdi, [rbp]\n");
+            emitf("  add rdi, QWORD PTR [rdi-8]\n");
+            emitf("  sub rdi, 56\n");
+            emitf("  mov DWORD PTR [rax], 48\n"); // gp_offset
+            emitf("  mov DWORD PTR [rax+4], 304\n"); // fp_offset
+            emitf("  mov QWORD PTR [rax+8], rdi\n"); // overflow_arg_area
+            emitf("  mov QWORD PTR [rax+16], 0\n"); // reg_save_area
+            emitf("  mov rax, 0\n"); // # of floating point parameters
+            emitf("  push rax\n");
             return;
         }
 
@@ -296,6 +302,7 @@ void gen_expr(Node *node, Func *func) {
         for (int i = 0; i < arg_len; i++) {
             Node *e = vec_at(node->block, i);
             gen_expr(e, func);
+            stack_depth += 8;
 
             if (i >= vec_len(called->params)) // varargs
                 continue;
@@ -304,104 +311,112 @@ void gen_expr(Node *node, Func *func) {
             int size_param = type_size(p->type);
             if (size_arg < size_param && type_size(coerce_pointer(e->type)) == 1) {
                 char *rax = rax_of_type(p->type);
-                printf("  movzb eax, al\n");
-                printf("  mov [rsp], %s\n", rax);
+                emitf("  movzb eax, al\n");
+                emitf("  mov [rsp], %s\n", rax);
             }
         }
 
         for (int i = arg_len-1; i >= 0; i--)
-            printf("  pop %s\n", arg_regs64[i]);
+            emitf("  pop %s\n", arg_regs64[i]);
+        stack_depth -= 8 * arg_len;
 
         int diff = (16 - stack_depth % 16) % 16;
         if (diff != 0)
-            printf("  sub rsp, %d\n", diff); // 16-bit boundary
-        printf("  call %s\n", node->name);
+            emitf("  sub rsp, %d\n", diff); // 16-bit boundary
+        if (called->is_varargs)
+            emitf("  mov eax, 0\n"); // # of vector registers used
+        emitf("  call %s\n", node->name);
         if (diff != 0)
-            printf("  add rsp, %d\n", diff); // 16-bit boundary
+            emitf("  add rsp, %d\n", diff); // 16-bit boundary
 
-        printf("  push rax\n");
+        emitf("  push rax\n");
         return;
     }
     case ND_ADDR:
         gen_lval(node->lhs, func);
         return;
-    case ND_DEREF:
-        gen_expr(node->lhs, func);
-        load_rax(type_size(node->type));
-        printf("  mov [rsp], %s\n", rax_of_type(node->type));
+    case ND_DEREF: {
+        // p[i] is read from [p+i*size] without computing the address first
+        Node *ptr = node->lhs->lhs;
+        Node *idx = node->lhs->rhs;
+        int scale = node->lhs->kind == ND_ADD ? index_scale(ptr->type, idx->type) : 0;
+        if (scale == 0) {
+            gen_expr(node->lhs, func);
+            load_rax(type_size(node->type));
+            emitf("  mov [rsp], %s\n", rax_of_type(node->type));
+            return;
+        }
+        if (is_integer(ptr->type)) {
+            ptr = node->lhs->rhs;
+            idx = node->lhs->lhs;
+        }
+        gen_expr(ptr, func);
+        stack_depth += 8;
+        gen_expr(idx, func);
+        stack_depth -= 8;
+        emitf("  pop rax\n");
+        extend_rax(8, type_size(idx->type));
+        emitf("  mov rdi, rax\n");
+        emitf("  mov rax, [rsp]\n");
+        char *addr = calloc(20, sizeof(char));
+        sprintf(addr, "[rax+rdi*%d]", scale);
+        load_mem(type_size(node->type), addr);
+        emitf("  mov [rsp], %s\n", rax_of_type(node->type));
         return;
+    }
     case ND_ATTR:
         gen_lval(node->lhs, func);
-        printf("  add rax, %d\n", node->val);
-        if (node->type->ty != TY_ARRAY)
-            load_rax(type_size(node->type));
-        printf("  mov [rsp], %s\n", rax_of_type(node->type));
+        if (node->type->ty == TY_ARRAY) {
+            emitf("  add rax, %d\n", node->val);
+        } else {
+            char *addr = calloc(20, sizeof(char));
+            sprintf(addr, "[rax+%d]", node->val);
+            load_mem(type_size(node->type), addr);
+        }
+        emitf("  mov [rsp], %s\n", rax_of_type(node->type));
         return;
     case ND_CAST:
         gen_expr(node->lhs, func);
         node->lhs->type = node->type;
         return;
     case ND_SIZEOF:
-        printf("  mov rax, %d\n"
+        emitf("  mov rax, %d\n"
                "  push %d\n", node->val, node->val);
         return;
     case ND_NEG:
         gen_expr(node->lhs, func);
-        printf("  cmp %s, 0\n", rax_of_type(node->type));
-        printf("  sete al\n"
+        emitf("  cmp %s, 0\n", rax_of_type(node->lhs->type));
+        emitf("  sete al\n"
                "  movzb eax, al\n"
                "  mov [rsp], rax\n");
         return;
     case ND_BCOMPL:
         gen_expr(node->lhs, func);
-        printf("  not %s\n", rax_of_type(node->type));
-        printf("  mov [rsp], %s\n", rax_of_type(node->type));
+        emitf("  not %s\n", rax_of_type(node->type));
+        emitf("  mov [rsp], %s\n", rax_of_type(node->type));
         return;
     case ND_COND: {
         int lb = label_num++;
-        gen_expr(node->cond, func);
-        char *rax = rax_of_type(node->cond->type);
-        printf("  pop rax\n"
-               "  cmp %s, 0\n", rax);
-        printf("  je .Lcond_else%d\n", lb);
+        char *els = numbered_label("cond_else", lb);
+        gen_branch(node->cond, func, false, els);
         gen_expr(node->lhs, func);
-        printf("  jmp .Lcond_end%d\n"
-               ".Lcond_else%d:\n", lb, lb);
+        emitf("  jmp .Lcond_end%d\n", lb);
+        emitf("%s:\n", els);
         gen_expr(node->rhs, func);
-        printf(".Lcond_end%d:\n", lb);
+        emitf(".Lcond_end%d:\n", lb);
         return;
     }
-    case ND_LAND: {
+    case ND_LAND: case ND_LOR: {
         int lb = label_num++;
-        gen_expr(node->lhs, func);
-        char *raxl = rax_of_type(node->lhs->type);
-        printf("  cmp %s, 0\n", raxl);
-        printf("  je .Land_end%d\n", lb);
-        printf("  pop rax\n");
-        char *raxr = rax_of_type(node->rhs->type);
-        gen_expr(node->rhs, func);
-        printf("  cmp %s, 0\n", raxr);
-        printf("  je .Land_end%d\n", lb);
-        printf("  pop rax\n"
+        char *fals = numbered_label("logical_false", lb);
+        gen_branch(node, func, false, fals);
+        emitf("  mov eax, 1\n"
                "  push 1\n");
-        printf(".Land_end%d:\n", lb);
-        return;
-    }
-    case ND_LOR: {
-        int lb = label_num++;
-        gen_expr(node->lhs, func);
-        char *raxl = rax_of_type(node->lhs->type);
-        printf("  cmp %s, 0\n", raxl);
-        printf("  jne .Lor_true%d\n", lb);
-        printf("  pop rax\n");
-        gen_expr(node->rhs, func);
-        char *raxr = rax_of_type(node->rhs->type);
-        printf("  cmp %s, 0\n", raxr);
-        printf("  je .Lor_end%d\n", lb);
-        printf(".Lor_true%d:\n", lb);
-        printf("  pop rax\n"
-               "  push 1\n");
-        printf(".Lor_end%d:\n", lb);
+        emitf("  jmp .Llogical_end%d\n", lb);
+        emitf("%s:\n", fals);
+        emitf("  mov eax, 0\n"
+               "  push 0\n");
+        emitf(".Llogical_end%d:\n", lb);
         return;
     }
     case ND_PREINCR: case ND_PREDECR: {
@@ -411,11 +426,11 @@ void gen_expr(Node *node, Func *func) {
 
         char *rdi = rdi_of_type(node->lhs->type);
         char *rax = rax_of_type(node->lhs->type);
-        printf("  mov %s, [rax]\n", rdi);
-        printf("  add %s, %d\n", rdi, incr);
-        printf("  mov [rax], %s\n", rdi);
-        printf("  mov %s, %s\n", rax, rdi);
-        printf("  mov [rsp], %s\n", rdi);
+        emitf("  mov %s, [rax]\n", rdi);
+        emitf("  add %s, %d\n", rdi, incr);
+        emitf("  mov [rax], %s\n", rdi);
+        emitf("  mov %s, %s\n", rax, rdi);
+        emitf("  mov [rsp], %s\n", rdi);
         return;
     }
     case ND_POSTINCR: case ND_POSTDECR: {
@@ -425,11 +440,11 @@ void gen_expr(Node *node, Func *func) {
 
         char *rdi = rdi_of_type(node->lhs->type);
         char *rax = rax_of_type(node->lhs->type);
-        printf("  mov %s, [rax]\n", rdi);
-        printf("  mov [rsp], %s\n", rdi);
-        printf("  add %s, %d\n", rdi, incr);
-        printf("  mov [rax], %s\n", rdi);
-        printf("  mov %s, [rsp]\n", rax);
+        emitf("  mov %s, [rax]\n", rdi);
+        emitf("  mov [rsp], %s\n", rdi);
+        emitf("  add %s, %d\n", rdi, incr);
+        emitf("  mov [rax], %s\n", rdi);
+        emitf("  mov %s, [rsp]\n", rax);
         return;
     }
     case ND_LSHEQ: case ND_LSH:
@@ -440,22 +455,22 @@ void gen_expr(Node *node, Func *func) {
         stack_depth += 8;
         gen_expr(node->rhs, func);
         stack_depth -= 8;
-        printf("  pop rcx\n");
+        emitf("  pop rcx\n");
 
         char *rax = rax_of_type(node->lhs->type);
         if (assign) {
-            printf("  mov rdi, [rsp]\n");
-            printf("  mov %s, [rdi]\n", rax);
+            emitf("  mov rdi, [rsp]\n");
+            emitf("  mov %s, [rdi]\n", rax);
         } else {
-            printf("  mov %s, [rsp]\n", rax);
+            emitf("  mov %s, [rsp]\n", rax);
         }
 
         char *mne = (node->kind == ND_LSH || node->kind == ND_LSHEQ) ? "shl" : "shr";
-        printf("  %s %s, cl\n", mne, rax);
+        emitf("  %s %s, cl\n", mne, rax);
 
         if (assign)
-            printf("  mov [rdi], %s\n", rax);
-        printf("  mov [rsp], %s\n", rax);
+            emitf("  mov [rdi], %s\n", rax);
+        emitf("  mov [rsp], %s\n", rax);
         return;
     }
     default:
@@ -465,79 +480,410 @@ void gen_expr(Node *node, Func *func) {
     bool assign = is_assign_expr(node->kind);
 
     assign ? gen_lval(node->lhs, func) : gen_expr(node->lhs, func);
+    stack_depth += 8;
     gen_expr(node->rhs, func);
+    stack_depth -= 8;
 
     // rhs
-    printf("  pop rax\n");
+    emitf("  pop rax\n");
     extend_rax(type_size(node->type), type_size(coerce_pointer(node->rhs->type)));
-    printf("  mov rdi, rax\n");
+    emitf("  mov rdi, rax\n");
 
     char *rax = rax_of_type(node->type);
     char *rdi = rdi_of_type(node->type);
 
     // lhs
-    printf("  mov rax, [rsp]\n");
+    emitf("  mov rax, [rsp]\n");
     if (assign)
-        printf("  mov %s, [rax]\n", rax);
+        emitf("  mov %s, [rax]\n", rax);
     extend_rax(type_size(node->type), type_size(coerce_pointer(node->lhs->type)));
 
     switch (node->kind) {
-        case ND_ADD: case ND_ADDEQ:
+        case ND_ADD: case ND_ADDEQ: {
+            // a pointer plus an index scaled by 1, 2, 4 or 8 is one lea
+            int scale = index_scale(node->lhs->type, node->rhs->type);
+            if (scale != 0 && is_integer(node->rhs->type)) {
+                emitf("  lea rax, [rax+rdi*%d]\n", scale);
+                break;
+            } else if (scale != 0) {
+                emitf("  lea rax, [rdi+rax*%d]\n", scale);
+                break;
+            }
             gen_coeff_ptr(node->lhs->type, node->rhs->type);
-            printf("  add %s, %s\n", rax, rdi);
+            emitf("  add %s, %s\n", rax, rdi);
             break;
+        }
         case ND_SUB: case ND_SUBEQ:
             gen_coeff_ptr(node->lhs->type, node->rhs->type);
-            printf("  sub %s, %s\n", rax, rdi);
+            emitf("  sub %s, %s\n", rax, rdi);
             if (is_pointer_compat(node->lhs->type) && is_pointer_compat(node->rhs->type)) {
-                printf("  mov rdi, %d\n", type_size(node->lhs->type->ptr_to));
-                printf("  cqo\n"
-                       "  div %s\n", rdi);
+                // the difference is a multiple of the size, divided exactly
+                // by shifting out the factors of two and multiplying by the
+                // inverse of the odd rest
+                int size = type_size(node->lhs->type->ptr_to);
+                int k = 0;
+                while (size % 2 == 0) {
+                    size = size / 2;
+                    k++;
+                }
+                if (k > 0)
+                    emitf("  sar %s, %d\n", rax, k);
+                if (size > 1)
+                    emitf("  imul %s, %s, %d\n", rax, rax, mul_inverse(size));
             }
             break;
-        case ND_MUL: case ND_MULEQ:
-            printf("  imul %s, %s\n", rax, rdi);
-            break;
-        case ND_DIV: case ND_DIVEQ:
-            printf("  cqo\n"
-                   "  idiv %s\n", rdi);
+        case ND_MUL: case ND_MULEQ: {
+            int c;
+            if (const_divisor(node, &c))
+                gen_mul_imm(rax, "rax", c);
+            else
+                emitf("  imul %s, %s\n", rax, rdi);
             break;
-        case ND_MOD: case ND_MODEQ: {
-            char *mne = type_size(node->type) == 4 ? "cdq"
-                     : "cqo";
-            printf("  %s\n", mne);
-            printf("  idiv %s\n", rdi);
-            printf("  mov rax, rdx\n");
+        }
+        case ND_DIV: case ND_DIVEQ: case ND_MOD: case ND_MODEQ: {
+            bool mod = node->kind == ND_MOD || node->kind == ND_MODEQ;
+            int d;
+            if (const_divisor(node, &d) && d != 0 && d != -2147483647 - 1) {
+                gen_divmod_imm(d, mod);
+                break;
+            }
+            emitf(type_size(node->type) == 4 ? "  cdq\n" : "  cqo\n");
+            emitf("  idiv %s\n", rdi);
+            if (mod)
+                emitf("  mov rax, rdx\n");
             break;
         }
         case ND_IOR: case ND_IOREQ:
-            printf("  or %s, %s\n", rax, rdi);
+            emitf("  or %s, %s\n", rax, rdi);
             break;
         case ND_XOR: case ND_XOREQ:
-            printf("  xor %s, %s\n", rax, rdi);
+            emitf("  xor %s, %s\n", rax, rdi);
             break;
         case ND_AND: case ND_ANDEQ:
-            printf("  and %s, %s\n", rax, rdi);
+            emitf("  and %s, %s\n", rax, rdi);
             break;
         default: {
-            printf("  cmp %s, %s\n", rax, rdi);
+            emitf("  cmp %s, %s\n", rax, rdi);
             char *mne = node->kind == ND_EQ ? "sete"
                       : node->kind == ND_NEQ ? "setne"
                       : node->kind == ND_LT ? "setl"
                       : node->kind == ND_LTE ? "setle"
                       : (error("should be unreachable"), NULL);
-            printf("  %s al\n", mne);
-            printf("  movzb rax, al\n");
+            emitf("  %s al\n", mne);
+            emitf("  movzb rax, al\n");
         }
     }
 
     if (assign)
-        printf("  mov rdi, [rsp]\n"
+        emitf("  mov rdi, [rsp]\n"
                "  mov [rdi], %s\n", rax);
-    printf("  mov [rsp], %s\n", rax);
+    emitf("  mov [rsp], %s\n", rax);
 
 }
 
+// Conditions
+//
+// A condition is branched on with the flags of its comparison instead of
+// being computed as 0 or 1 and compared with 0. The logical operators become
+// chains of branches on their operands.
+
+// the jump taken if the comparison does or doesn't hold
+static char *jcc_of(Node_kind kind, bool holds) {
+    if (kind == ND_EQ)
+        return holds ? "je" : "jne";
+    if (kind == ND_NEQ)
+        return holds ? "jne" : "je";
+    if (kind == ND_LT)
+        return holds ? "jl" : "jge";
+    return holds ? "jle" : "jg";
+}
+
+// jumps to label if node is nonzero and jump_if is true, or if node is zero
+// and jump_if is false; falls through otherwise
+static void gen_branch(Node *node, Func *func, bool jump_if, char *label) {
+    switch (node->kind) {
+    case ND_NUM:
+        if ((node->val != 0) == jump_if)
+            emitf("  jmp %s\n", label);
+        return;
+    case ND_NEG:
+        gen_branch(node->lhs, func, !jump_if, label);
+        return;
+    case ND_LAND: case ND_LOR:
+        // `a && b' is false as soon as a is, and `a || b' true as soon as a is
+        if ((node->kind == ND_LAND) != jump_if) {
+            gen_branch(node->lhs, func, jump_if, label);
+            gen_branch(node->rhs, func, jump_if, label);
+        } else {
+            char *skip = numbered_label("skip", label_num++);
+            gen_branch(node->lhs, func, !jump_if, skip);
+            gen_branch(node->rhs, func, jump_if, label);
+            emitf("%s:\n", skip);
+        }
+        return;
+    case ND_EQ: case ND_NEQ: case ND_LT: case ND_LTE:
+        if (su_eligible(node)) {
+            int regs[9] = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+            char *src = gen_su_operands(node, regs, 9);
+            emitf("  cmp eax, %s\n", src);
+        } else {
+            // the operands are extended as in gen_expr()
+            gen_expr(node->lhs, func);
+            stack_depth += 8;
+            gen_expr(node->rhs, func);
+            stack_depth -= 8;
+            emitf("  pop rax\n");
+            extend_rax(type_size(node->type), type_size(coerce_pointer(node->rhs->type)));
+            emitf("  mov rdi, rax\n"
+                   "  pop rax\n");
+            extend_rax(type_size(node->type), type_size(coerce_pointer(node->lhs->type)));
+            emitf("  cmp %s, %s\n", rax_of_type(node->type), rdi_of_type(node->type));
+        }
+        emitf("  %s %s\n", jcc_of(node->kind, jump_if), label);
+        return;
+    default:
+        gen_expr(node, func);
+        emitf("  pop rax\n"
+               "  cmp %s, 0\n", rax_of_type(node->type));
+        emitf("  %s %s\n", jump_if ? "jne" : "je", label);
+    }
+}
+
+// Sethi-Ullman code generation
+//
+// An integer expression built only from constants, local variables and
+// arithmetic without side effects is evaluated in registers instead of on the
+// stack. Every node needs as many registers as its operands if they differ, or
+// one more if they don't; the operand needing more is evaluated first, and the
+// other one in the remaining registers. Only a tree needing more registers
+// than there are keeps an intermediate value on the stack.
+
+static char *su_regs64[9] = {"rax", "rdi", "rsi", "rcx", "rdx", "r8", "r9", "r10", "r11"};
+static char *su_regs32[9] = {"eax", "edi", "esi", "ecx", "edx", "r8d", "r9d", "r10d", "r11d"};
+static char *su_regs8[9] = {"al", "dil", "sil", "cl", "dl", "r8b", "r9b", "r10b", "r11b"};
+
+static bool su_eligible(Node *node) {
+    if (!is_integer(node->type))
+        return false;
+
+    switch (node->kind) {
+    case ND_NUM: case ND_CHAR: case ND_VAR:
+        return true;
+    case ND_BCOMPL:
+        return su_eligible(node->lhs);
+    case ND_ADD: case ND_SUB: case ND_MUL:
+    case ND_AND: case ND_IOR: case ND_XOR:
+    case ND_EQ: case ND_NEQ: case ND_LT: case ND_LTE:
+        return su_eligible(node->lhs) && su_eligible(node->rhs);
+    default:
+        return false;
+    }
+}
+
+// a constant used as an immediate operand doesn't need a register
+static bool is_su_imm(Node *node) {
+    return node->kind == ND_NUM || node->kind == ND_CHAR;
+}
+
+static int su_need(Node *node) {
+    switch (node->kind) {
+    case ND_NUM: case ND_CHAR: case ND_VAR:
+        return 1;
+    case ND_BCOMPL:
+        return su_need(node->lhs);
+    default: {
+        int l = su_need(node->lhs);
+        if (is_su_imm(node->rhs))
+            return l;
+        int r = su_need(node->rhs);
+        return l == r ? l + 1 : l > r ? l : r;
+    }
+    }
+}
+
+// evaluates node into regs[0], sign-extended to 32 bits, using regs[0] to
+// regs[num_regs-1]
+static void gen_su(Node *node, int *regs, int num_regs) {
+    char *dst = su_regs32[regs[0]];
+    switch (node->kind) {
+    case ND_NUM: case ND_CHAR:
+        emitf("  mov %s, %d\n", dst, node->val);
+        return;
+    case ND_VAR:
+        if (type_size(node->type) == 1)
+            emitf("  movsx %s, BYTE PTR [rbp-%d]\n", dst, node->val);
+        else
+            emitf("  mov %s, DWORD PTR [rbp-%d]\n", dst, node->val);
+        return;
+    case ND_BCOMPL:
+        gen_su(node->lhs, regs, num_regs);
+        emitf("  not %s\n", dst);
+        if (type_size(node->type) == 1)
+            emitf("  movsx %s, %s\n", dst, su_regs8[regs[0]]);
+        return;
+    default:
+        break;
+    }
+
+    if (node->kind == ND_MUL && is_su_imm(node->rhs) && type_size(node->type) == 4) {
+        gen_su(node->lhs, regs, num_regs);
+        gen_mul_imm(dst, su_regs64[regs[0]], node->rhs->val);
+        return;
+    }
+    gen_su_op(node, regs[0], gen_su_operands(node, regs, num_regs));
+}
+
+// evaluates the left operand of node into regs[0] and returns the right one:
+// an immediate, or the register it is evaluated into
+static char *gen_su_operands(Node *node, int *regs, int num_regs) {
+    if (is_su_imm(node->rhs)) {
+        gen_su(node->lhs, regs, num_regs);
+        char *imm = calloc(12, sizeof(char));
+        sprintf(imm, "%d", node->rhs->val);
+        return imm;
+    }
+
+    int l = su_need(node->lhs);
+    int r = su_need(node->rhs);
+    if (l >= num_regs && r >= num_regs) {
+        gen_su(node->rhs, regs, num_regs);
+        emitf("  push %s\n", su_regs64[regs[0]]);
+        gen_su(node->lhs, regs, num_regs);
+        emitf("  pop %s\n", su_regs64[regs[1]]);
+    } else if (l >= r) {
+        gen_su(node->lhs, regs, num_regs);
+        gen_su(node->rhs, regs + 1, num_regs - 1);
+    } else {
+        // the right operand goes to regs[1] but may use regs[0] as well
+        int *rest = calloc(num_regs, sizeof(int));
+        for (int i = 0; i < num_regs; i++)
+            rest[i] = regs[i];
+        rest[0] = regs[1];
+        rest[1] = regs[0];
+        gen_su(node->rhs, rest, num_regs);
+        rest[1] = regs[0];
+        gen_su(node->lhs, rest + 1, num_regs - 1);
+    }
+    return su_regs32[regs[1]];
+}
+
+// dst = dst op src, where src is a 32-bit register or an immediate
+static void gen_su_op(Node *node, int reg, char *src) {
+    char *dst = su_regs32[reg];
+    switch (node->kind) {
+    case ND_ADD:
+        emitf("  add %s, %s\n", dst, src);
+        break;
+    case ND_SUB:
+        emitf("  sub %s, %s\n", dst, src);
+        break;
+    case ND_MUL:
+        emitf("  imul %s, %s\n", dst, src);
+        break;
+    case ND_AND:
+        emitf("  and %s, %s\n", dst, src);
+        break;
+    case ND_IOR:
+        emitf("  or %s, %s\n", dst, src);
+        break;
+    case ND_XOR:
+        emitf("  xor %s, %s\n", dst, src);
+        break;
+    default: {
+        char *mne = node->kind == ND_EQ ? "sete"
+                  : node->kind == ND_NEQ ? "setne"
+                  : node->kind == ND_LT ? "setl"
+                  : "setle";
+        emitf("  cmp %s, %s\n", dst, src);
+        emitf("  %s %s\n", mne, su_regs8[reg]);
+        emitf("  movzx %s, %s\n", dst, su_regs8[reg]);
+        return;
+    }
+    }
+    if (type_size(node->type) == 1)
+        emitf("  movsx %s, %s\n", dst, su_regs8[reg]);
+}
+
+// Strength reduction
+//
+// An int multiplied by a constant is shifted or scaled with lea where it can
+// be, and an int divided by a constant other than 0 and -2^31 is multiplied by
+// the magic number of div_magic() instead.
+
+// whether the right operand of an int multiplication or division is the
+// constant *d
+static bool const_divisor(Node *node, int *d) {
+    if (type_size(node->type) != 4 || node->rhs->kind != ND_NUM)
+        return false;
+    *d = node->rhs->val;
+    return true;
+}
+
+// r = r * c, where r32 and r64 name the same register
+static void gen_mul_imm(char *r32, char *r64, int c) {
+    int k = exact_log2(c > 0 ? c : -c);
+    if (k >= 0) {
+        if (k > 0)
+            emitf("  shl %s, %d\n", r32, k);
+        if (c < 0)
+            emitf("  neg %s\n", r32);
+    } else if (c == 3 || c == 5 || c == 9) {
+        emitf("  lea %s, [%s+%s*%d]\n", r32, r64, r64, c - 1);
+    } else {
+        emitf("  imul %s, %s, %d\n", r32, r32, c);
+    }
+}
+
+// eax = eax / d, or eax % d if mod, rounded towards zero; rcx and rdx are
+// clobbered
+static void gen_divmod_imm(int d, bool mod) {
+    int ad = d < 0 ? -d : d;
+    if (ad == 1) {
+        if (mod)
+            emitf("  mov eax, 0\n");
+        else if (d < 0)
+            emitf("  neg eax\n");
+        return;
+    }
+
+    int k = exact_log2(ad);
+    if (k >= 0) {
+        // a negative dividend is biased by 2^k - 1 to round towards zero
+        emitf("  mov edx, eax\n"
+               "  sar edx, 31\n");
+        emitf("  shr edx, %d\n", 32 - k);
+        emitf("  add eax, edx\n");
+        if (mod) {
+            emitf("  and eax, %d\n", ad - 1);
+            emitf("  sub eax, edx\n");
+            return;
+        }
+        emitf("  sar eax, %d\n", k);
+    } else {
+        int magic;
+        int shift;
+        div_magic(ad, &magic, &shift);
+        emitf("  mov ecx, eax\n");
+        emitf("  mov edx, %d\n", magic);
+        emitf("  imul edx\n"
+               "  add edx, ecx\n");
+        if (shift > 0)
+            emitf("  sar edx, %d\n", shift);
+        emitf("  mov eax, ecx\n"
+               "  sar eax, 31\n"
+               "  sub edx, eax\n"
+               "  mov eax, edx\n");
+        if (mod) {
+            emitf("  imul eax, eax, %d\n", ad);
+            emitf("  sub ecx, eax\n"
+                   "  mov eax, ecx\n");
+            return;
+        }
+    }
+    if (d < 0)
+        emitf("  neg eax\n");
+}
+
 void gen_stmt(Node *node, Func *func) {
     switch (node->kind) {
     case ND_VARDECL:
@@ -551,14 +897,14 @@ void gen_stmt(Node *node, Func *func) {
             for (int i = 0; i < len; i++) {
                 gen_lval(node->lhs, func);
                 char *rax = rax_of_type(elem_type);
-                printf("  add rax, %d\n", i * type_size(elem_type));
-                printf("  mov [rsp], %s\n", rax);
+                emitf("  add rax, %d\n", i * type_size(elem_type));
+                emitf("  mov [rsp], %s\n", rax);
 
                 Node *e = vec_at(node->rhs->block, i);
                 stack_depth += 8;
                 gen_expr(e, func);
                 stack_depth -= 8;
-                printf("  pop rax\n"
+                emitf("  pop rax\n"
                        "  pop rdi\n"
                        "  mov [rdi], %s\n", rax);
             }
@@ -569,84 +915,79 @@ void gen_stmt(Node *node, Func *func) {
         stack_depth += 8;
         gen_expr(node->rhs, func);
         stack_depth -= 8;
-        printf("  pop rax\n");
-        printf("  pop rdi\n");
+        emitf("  pop rax\n");
+        emitf("  pop rdi\n");
         char *rax = rax_of_type(node->type);
-        printf("  mov [rdi], %s\n", rax);
+        emitf("  mov [rdi], %s\n", rax);
         return;
     case ND_RETURN:
         if (node->lhs != NULL)
             gen_expr(node->lhs, func);
-        printf("  jmp .L%s_return\n", func->name);
+        emitf("  jmp .L%s_return\n", func->name);
         return;
     case ND_IF: {
         int lb = label_num++;
-        gen_expr(node->cond, func);
-        char *rax = rax_of_type(node->cond->type);
-        printf("  pop rax\n"
-               "  cmp %s, 0\n", rax);
         if (node->rhs == NULL) {
-            printf("  je .Lend_if%d\n", lb);
+            gen_branch(node->cond, func, false, numbered_label("end_if", lb));
             gen_stmt(node->lhs, func);
-            printf(".Lend_if%d:\n", lb);
+            emitf(".Lend_if%d:\n", lb);
         } else {
-            printf("  je  .Lelse%d\n", lb);
+            gen_branch(node->cond, func, false, numbered_label("else", lb));
             gen_stmt(node->lhs, func);
-            printf("  jmp .Lend_if%d\n", lb);
-            printf(".Lelse%d:\n", lb);
+            emitf("  jmp .Lend_if%d\n", lb);
+            emitf(".Lelse%d:\n", lb);
             gen_stmt(node->rhs, func);
-            printf(".Lend_if%d:\n", lb);
+            emitf(".Lend_if%d:\n", lb);
         }
         return;
     }
+    // the condition of a loop is tested at its bottom, branching back to the
+    // body, which is entered by a jump to the first test
     case ND_WHILE: {
         char *label_base = node->name;
-        printf(".L%s_cont:\n", label_base);
-        gen_expr(node->cond, func);
-        char *rax = rax_of_type(node->cond->type);
-        printf("  pop rax\n"
-               "  cmp %s, 0\n", rax);
-        printf("  je .L%s_end\n", label_base);
+        emitf("  jmp .L%s_cont\n", label_base);
+        emitf("  .p2align 4,,10\n");
+        emitf(".L%s:\n", label_base);
         gen_stmt(node->body, func);
-        printf("  jmp .L%s_cont\n", label_base);
-        printf(".L%s_end:\n", label_base);
+        emitf(".L%s_cont:\n", label_base);
+        gen_branch(node->cond, func, true, format_label(label_base, ""));
+        emitf(".L%s_end:\n", label_base);
         return;
     }
     case ND_FOR:
         if (node->lhs != NULL)
             gen_stmt(node->lhs, func);
-        printf(".L%s:\n", node->name);
-        if (node->cond != NULL) {
-            gen_expr(node->cond, func);
-            char *rax = rax_of_type(node->cond->type);
-            printf("  pop rax\n"
-                   "  cmp %s, 0\n", rax);
-            printf("  je .L%s_end\n", node->name);
-        }
+        if (node->cond != NULL)
+            emitf("  jmp .L%s_test\n", node->name);
+        emitf("  .p2align 4,,10\n");
+        emitf(".L%s:\n", node->name);
         gen_stmt(node->body, func);
-        printf(".L%s_cont:\n", node->name);
+        emitf(".L%s_cont:\n", node->name);
         if (node->rhs != NULL)
             gen_stmt(node->rhs, func);
-        printf("  jmp .L%s\n", node->name);
-        printf(".L%s_end:\n", node->name);
+        if (node->cond != NULL) {
+            emitf(".L%s_test:\n", node->name);
+            gen_branch(node->cond, func, true, format_label(node->name, ""));
+        } else {
+            emitf("  jmp .L%s\n", node->name);
+        }
+        emitf(".L%s_end:\n", node->name);
         return;
     case ND_DOWHILE:
-        printf(".L%s:\n", node->name);
+        emitf("  .p2align 4,,10\n");
+        emitf(".L%s:\n", node->name);
         gen_stmt(node->body, func);
-        printf(".L%s_cont:\n", node->name);
-        gen_expr(node->cond, func);
-        printf("  pop rax\n"
-               "  cmp %s, 0\n", rax_of_type(node->cond->type));
-        printf("  jne .L%s\n", node->name);
-        printf(".L%s_end:\n", node->name);
+        emitf(".L%s_cont:\n", node->name);
+        gen_branch(node->cond, func, true, format_label(node->name, ""));
+        emitf(".L%s_end:\n", node->name);
 
         label_num++;
         return;
     case ND_CONTINUE:
-        printf("  jmp .L%s_cont\n", node->name);
+        emitf("  jmp .L%s_cont\n", node->name);
         return;
     case ND_BREAK:
-        printf("  jmp .L%s_end\n", node->name);
+        emitf("  jmp .L%s_end\n", node->name);
         return;
     case ND_BLOCK: {
         int len = vec_len(node->block);
@@ -656,37 +997,37 @@ void gen_stmt(Node *node, Func *func) {
     }
     case ND_SWITCH: {
         gen_expr(node->cond, func);
-        printf("  pop rax\n");
+        emitf("  pop rax\n");
+        if (type_size(node->cond->type) == 1)
+            emitf("  movsx eax, al\n");
         int len = vec_len(node->block);
+        int *cases = calloc(len + 1, sizeof(int));
+        char **labels = calloc(len + 1, sizeof(char *));
+        int ncases = 0;
+        char *dflt = format_label(node->name, "_end");
         for (int i = 0; i < len; i++) {
             Node *stmt = vec_at(node->block, i);
-            if (stmt->kind != ND_CASE)
-                continue;
-            printf("  cmp rax, %d\n", stmt->lhs->val);
-            printf("  je .L%s\n", stmt->name);
-        }
-        bool has_default = false;
-        for (int i = 0; i < len; i++) {
-            Node *stmt = vec_at(node->block, i);
-            if (stmt->kind == ND_DEFAULT) {
-                has_default = true;
-                printf("  jmp .L%s\n", stmt->name);
-                break;
+            if (stmt->kind == ND_CASE) {
+                cases[ncases] = stmt->lhs->val;
+                labels[ncases] = format_label(stmt->name, "");
+                ncases++;
+            } else if (stmt->kind == ND_DEFAULT) {
+                dflt = format_label(stmt->name, "");
             }
         }
-        if (!has_default)
-            printf("  jmp .L%s_end\n", node->name);
+        gen_switch_dispatch("eax", cases, labels, ncases, dflt, NULL);
+        emitf("  jmp %s\n", dflt);
         for (int i = 0; i < len; i++)
             gen_stmt(vec_at(node->block, i), func);
-        printf(".L%s_end:\n", node->name);
+        emitf(".L%s_end:\n", node->name);
         return;
     }
     case ND_CASE: case ND_DEFAULT:
-        printf(".L%s:\n", node->name);
+        emitf(".L%s:\n", node->name);
         return;
     default:
         gen_expr(node, func);
-        printf("  pop rax\n");
+        emitf("  pop rax\n");
     }
 }
 
@@ -695,35 +1036,36 @@ void gen_func(Func* func) {
     if (func->is_extern)
         return;
 
-    printf("%s:\n", func->name);
-    printf("  push rbp\n"
+    emitf("  .p2align 4\n");
+    emitf("%s:\n", func->name);
+    emitf("  push rbp\n"
            "  mov rbp, rsp\n");
 
     int params_len = vec_len(func->params);
 
     if (func->is_varargs) {
-        printf("  mov QWORD PTR [rbp-8], %d\n", 8 * params_len);
-        printf("  mov [rbp-16], r9\n");
-        printf("  mov [rbp-24], r8\n");
-        printf("  mov [rbp-32], rcx\n");
-        printf("  mov [rbp-40], rdx\n");
-        printf("  mov [rbp-48], rsi\n");
-        printf("  mov [rbp-56], rdi\n");
-        printf("  sub rsp, 56\n");
+        emitf("  mov QWORD PTR [rbp-8], %d\n", 8 * params_len);
+        emitf("  mov [rbp-16], r9\n");
+        emitf("  mov [rbp-24], r8\n");
+        emitf("  mov [rbp-32], rcx\n");
+        emitf("  mov [rbp-40], rdx\n");
+        emitf("  mov [rbp-48], rsi\n");
+        emitf("  mov [rbp-56], rdi\n");
+        emitf("  sub rsp, 56\n");
     }
 
     for (int i = 0; i < params_len; i++)
-        printf("  push %s\n", arg_regs64[i]);
+        emitf("  push %s\n", arg_regs64[i]);
 
     int local_vars_space = func->offset - 8 * vec_len(func->params);
     local_vars_space -= func->is_varargs ? 56 : 0;
-    printf("  sub rsp, %d\n", local_vars_space);
+    emitf("  sub rsp, %d\n", local_vars_space);
     for (int i = 0; i < vec_len(func->block); i++) {
         stack_depth = func->offset;
         gen_stmt(vec_at(func->block, i), func);
     }
-    printf(".L%s_return:\n", func->name);
-    printf("mov rsp, rbp\n"
+    emitf(".L%s_return:\n", func->name);
+    emitf("mov rsp, rbp\n"
            "  pop rbp\n"
            "  ret\n");
 }
@@ -731,13 +1073,12 @@ void gen_func(Func* func) {
 void gen_lval(Node *node, Func *func) {
     switch(node->kind) {
     case ND_VAR:
-        printf("  mov rax, rbp\n");
-        printf("  sub rax, %d\n", node->val);
-        printf("  push rax\n");
+        emitf("  lea rax, [rbp-%d]\n", node->val);
+        emitf("  push rax\n");
         return;
     case ND_GVAR:
-        printf("  mov rax, OFFSET %s\n", node->name);
-        printf("  push rax\n");
+        emitf("  lea rax, %s[rip]\n", node->name);
+        emitf("  push rax\n");
         return;
     case ND_DEREF:
         gen_expr(node->lhs, func);
@@ -746,10 +1087,12 @@ void gen_lval(Node *node, Func *func) {
         gen_expr(node, func);
         return;
     case ND_ATTR:
+        // the address of the struct is left in rax as well as on the stack
         gen_lval(node->lhs, func);
-        printf("  pop rax\n"
-               "  add rax, %d\n", node->val);
-        printf("  push rax\n");
+        if (node->val != 0) {
+            emitf("  add rax, %d\n", node->val);
+            emitf("  mov [rsp], rax\n");
+        }
         return;
     default:
         error("term should be a left value");
@@ -758,17 +1101,17 @@ void gen_lval(Node *node, Func *func) {
 
 static void gen_coeff_ptr(Type* lt /* rax */, Type* rt /* rdi */) {
     if (is_pointer_compat(lt) && is_pointer_compat(rt)) {
-    } else if (lt->ty == TY_INT && rt->ty == TY_INT) {
-    } else if (lt->ty == TY_INT) {
+    } else if (is_integer(lt) && is_integer(rt)) {
+    } else if (is_integer(lt)) {
         char *rax = rax_of_type(lt);
         int coeff = type_size(rt->ptr_to);
         if (coeff != 1)
-            printf("  imul %s, %d\n", rax, coeff);
-    } else if (rt->ty == TY_INT) {
+            emitf("  imul %s, %d\n", rax, coeff);
+    } else if (is_integer(rt)) {
         char *rdi = rdi_of_type(rt);
         int coeff = type_size(lt->ptr_to);
         if (coeff != 1)
-            printf("  imul %s, %d\n", rdi, coeff);
+            emitf("  imul %s, %d\n", rdi, coeff);
     } else
         error("addition/subtraction of two pointers is not allowed");
 }
@@ -776,18 +1119,38 @@ static void gen_coeff_ptr(Type* lt /* rax */, Type* rt /* rdi */) {
 void extend_rax(int dst, int src) {
     if (dst <= src) return;
     if (dst == 4)
-        printf("  cbw\n  cwde\n");
+        emitf("  cbw\n  cwde\n");
     if (dst == 8)
-        printf("  cdqe\n");
+        emitf("  cdqe\n");
+}
+
+// the scale of the index of the addition of operands of types lt and rt if
+// one is a pointer and it fits an x86 memory operand, or 0
+static int index_scale(Type *lt, Type *rt) {
+    int size;
+    if (is_pointer_compat(lt) && is_integer(rt))
+        size = type_size(lt->ptr_to);
+    else if (is_integer(lt) && is_pointer_compat(rt))
+        size = type_size(rt->ptr_to);
+    else
+        return 0;
+    if (size == 1 || size == 2 || size == 4 || size == 8)
+        return size;
+    return 0;
 }
 
 static void load_rax(int size) {
+    load_mem(size, "[rax]");
+}
+
+// loads the `size' bytes at the memory operand addr into rax
+static void load_mem(int size, char *addr) {
     if (size == 1)
-        printf("  movsx eax, BYTE PTR [rax]\n");
+        emitf("  movsx eax, BYTE PTR %s\n", addr);
     else if (size == 4)
-        printf("  mov eax, DWORD PTR [rax]\n");
+        emitf("  mov eax, DWORD PTR %s\n", addr);
     else /* size == 8 */
-        printf("  mov rax, [rax]\n");
+        emitf("  mov rax, QWORD PTR %s\n", addr);
 }
 
 static char *rax_of_type(Type *type) {
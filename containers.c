@@ -33,7 +33,7 @@ void *vec_pop(Vec *vec) {
         return NULL;
 
     void * ptr = vec->data[vec->len-1];
-    vec->data[vec->len--] = NULL;
+    vec->data[--vec->len] = NULL;
     return ptr;
 }
 
@@ -43,6 +43,11 @@ void *vec_at(Vec *vec, int idx) {
     return vec->data[idx];
 }
 
+void vec_set(Vec *vec, int idx, void *node) {
+    if (0 <= idx && idx < vec->len)
+        vec->data[idx] = node;
+}
+
 // StringBuilder
 
 struct StringBuilder {
@@ -76,6 +81,17 @@ void strbld_append_str(StringBuilder *sb, char *ch) {
     while (*ch) strbld_append(sb, *(ch++));
 }
 
+// appends the first len characters of str, which contain no null character
+void strbld_append_mem(StringBuilder *sb, char *str, int len) {
+    if (sb->len + len > sb->cap) {
+        while (sb->len + len > sb->cap)
+            sb->cap *= 2;
+        sb->data = realloc(sb->data, sb->cap * sizeof(char));
+    }
+    strncpy(sb->data + sb->len, str, len);
+    sb->len += len;
+}
+
 // Map
 
 Map *map_new() {
@@ -134,3 +150,127 @@ Environment *env_next(Environment *e) {
     return e->next;
 }
 
+
+// Scope
+//
+// A hashed symbol table for block-structured names. Each name has a single
+// Symbol whose bindings form a shadow chain (innermost first), so a lookup
+// costs one hash probe however deeply blocks are nested. Bindings are also
+// recorded in an undo log, and leaving a block pops exactly the bindings
+// made since the matching scope_enter.
+
+typedef struct Symbol Symbol;
+typedef struct Binding Binding;
+
+struct Binding {
+    void *value;
+    int depth;
+    Binding *shadowed;
+};
+
+struct Symbol {
+    char *name;
+    Binding *top;
+    Symbol *next; // in the same bucket
+};
+
+struct Scope {
+    Symbol **buckets;
+    int num_buckets;
+    int num_symbols;
+    Vec *log;
+    int *marks; // the length of `log' at each scope_enter
+    int depth;
+    int marks_cap;
+};
+
+static int scope_hash(char *k) {
+    int h = 0;
+    for (; *k; k++)
+        h = (h * 31 + *k) & 16777215;
+    return h;
+}
+
+static void scope_rehash(Scope *s, int num_buckets) {
+    Symbol **buckets = calloc(num_buckets, sizeof(Symbol*));
+    for (int i = 0; i < s->num_buckets; i++) {
+        Symbol *sym = s->buckets[i];
+        while (sym != NULL) {
+            Symbol *next = sym->next;
+            int idx = scope_hash(sym->name) & (num_buckets - 1);
+            sym->next = buckets[idx];
+            buckets[idx] = sym;
+            sym = next;
+        }
+    }
+    s->buckets = buckets;
+    s->num_buckets = num_buckets;
+}
+
+static Symbol *scope_symbol(Scope *s, char *k, bool create) {
+    int idx = scope_hash(k) & (s->num_buckets - 1);
+    for (Symbol *sym = s->buckets[idx]; sym != NULL; sym = sym->next)
+        if (!strcmp(sym->name, k))
+            return sym;
+    if (!create)
+        return NULL;
+
+    Symbol *sym = calloc(1, sizeof(Symbol));
+    sym->name = k;
+    sym->next = s->buckets[idx];
+    s->buckets[idx] = sym;
+    if (++s->num_symbols > s->num_buckets)
+        scope_rehash(s, s->num_buckets * 2);
+    return sym;
+}
+
+Scope *scope_new() {
+    Scope *s = calloc(1, sizeof(Scope));
+    s->num_buckets = 64;
+    s->buckets = calloc(s->num_buckets, sizeof(Symbol*));
+    s->log = vec_new();
+    s->marks_cap = 16;
+    s->marks = calloc(s->marks_cap, sizeof(int));
+    return s;
+}
+
+void scope_enter(Scope *s) {
+    if (s->depth == s->marks_cap) {
+        s->marks_cap *= 2;
+        s->marks = realloc(s->marks, s->marks_cap * sizeof(int));
+    }
+    s->marks[s->depth++] = vec_len(s->log);
+}
+
+void scope_leave(Scope *s) {
+    int mark = s->marks[--s->depth];
+    while (vec_len(s->log) > mark) {
+        Symbol *sym = vec_pop(s->log);
+        sym->top = sym->top->shadowed;
+    }
+}
+
+void scope_push(Scope *s, char *k, void *v) {
+    Symbol *sym = scope_symbol(s, k, true);
+    Binding *b = calloc(1, sizeof(Binding));
+    b->value = v;
+    b->depth = s->depth;
+    b->shadowed = sym->top;
+    sym->top = b;
+    vec_push(s->log, sym);
+}
+
+void *scope_find(Scope *s, char *k) {
+    Symbol *sym = scope_symbol(s, k, false);
+    if (sym == NULL || sym->top == NULL)
+        return NULL;
+    return sym->top->value;
+}
+
+// looks up `k' only among the bindings of the innermost scope
+void *scope_find_local(Scope *s, char *k) {
+    Symbol *sym = scope_symbol(s, k, false);
+    if (sym == NULL || sym->top == NULL || sym->top->depth != s->depth)
+        return NULL;
+    return sym->top->value;
+}
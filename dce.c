@@ -0,0 +1,220 @@
+#include "ccatd.h"
+
+// Dead-code elimination and CFG simplification.
+//
+// simplify_cfg() folds the branches on constants, threads jumps through the
+// blocks that only jump, drops the blocks no longer reachable from the entry
+// and merges a block into its predecessor when that is its only one and jumps
+// straight to it. eliminate_dead_code() deletes the instructions without side
+// effects whose results are never read.
+
+static IRFunc *ir;
+static Inst **defs; // the only definition of each virtual register
+
+// constant branches
+
+static void make_jump(Inst *term, BB *target) {
+    term->kind = IR_JMP;
+    term->size = 0;
+    term->a = 0;
+    term->then = target;
+    term->els = NULL;
+    term->targets = NULL;
+    term->cases = NULL;
+}
+
+static bool fold_branch(BB *bb) {
+    Inst *term = bb_term(bb);
+    if (term->kind == IR_BR && term->then == term->els) {
+        make_jump(term, term->then);
+        return true;
+    }
+
+    if (term->kind != IR_BR && term->kind != IR_SWITCH)
+        return false;
+    Inst *def = reaching_def(bb, vec_len(bb->insts) - 1, term->a, defs);
+    if (def == NULL || def->kind != IR_IMM)
+        return false;
+    int val = def->imm;
+
+    BB *target = term->els;
+    if (term->kind == IR_BR && val != 0)
+        target = term->then;
+    if (term->kind == IR_SWITCH) {
+        for (int i = 0; i < vec_len(term->targets); i++) {
+            if (term->cases[i] == val) {
+                target = vec_at(term->targets, i);
+                break;
+            }
+        }
+    }
+    make_jump(term, target);
+    return true;
+}
+
+// jump threading
+
+// follows the blocks consisting of a single jump; the number of steps is
+// bounded so that an empty infinite loop ends the walk
+static BB *skip_jumps(BB *bb) {
+    for (int i = 0; i < ir->num_bbs; i++) {
+        Inst *term = bb_term(bb);
+        if (vec_len(bb->insts) != 1 || term->kind != IR_JMP)
+            break;
+        bb = term->then;
+    }
+    return bb;
+}
+
+static bool thread_jumps(BB *bb) {
+    Inst *term = bb_term(bb);
+    bool changed = false;
+    BB *target;
+
+    if (term->then) {
+        target = skip_jumps(term->then);
+        if (target != term->then) {
+            term->then = target;
+            changed = true;
+        }
+    }
+    if (term->els) {
+        target = skip_jumps(term->els);
+        if (target != term->els) {
+            term->els = target;
+            changed = true;
+        }
+    }
+    if (term->kind == IR_SWITCH) {
+        for (int i = 0; i < vec_len(term->targets); i++) {
+            BB *succ = vec_at(term->targets, i);
+            target = skip_jumps(succ);
+            if (target != succ) {
+                vec_set(term->targets, i, target);
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+// straight-line blocks
+
+static bool merge_blocks() {
+    int *preds = calloc(ir->num_bbs, sizeof(int));
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        for (int j = 0; j < bb_num_succs(bb); j++)
+            preds[bb_succ(bb, j)->id]++;
+    }
+
+    BB *entry = vec_at(ir->blocks, 0);
+    bool *merged = calloc(ir->num_bbs, sizeof(bool));
+    bool changed = false;
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        if (merged[bb->id])
+            continue;
+        while (true) {
+            Inst *term = bb_term(bb);
+            if (term->kind != IR_JMP)
+                break;
+            BB *succ = term->then;
+            if (succ == bb || succ == entry || preds[succ->id] != 1)
+                break;
+            vec_pop(bb->insts);
+            for (int j = 0; j < vec_len(succ->insts); j++)
+                vec_push(bb->insts, vec_at(succ->insts, j));
+            merged[succ->id] = true;
+            changed = true;
+        }
+    }
+
+    Vec *blocks = vec_new();
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        if (!merged[bb->id])
+            vec_push(blocks, bb);
+    }
+    ir->blocks = blocks;
+    return changed;
+}
+
+void simplify_cfg(IRFunc *irf) {
+    ir = irf;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        defs = single_defs(ir);
+        for (int i = 0; i < vec_len(ir->blocks); i++) {
+            BB *bb = vec_at(ir->blocks, i);
+            if (fold_branch(bb))
+                changed = true;
+            if (thread_jumps(bb))
+                changed = true;
+        }
+        if (remove_unreachable(ir))
+            changed = true;
+        if (merge_blocks())
+            changed = true;
+    }
+}
+
+// dead code
+
+// params stay so that they keep leading the entry block
+static bool is_pure(Inst *inst) {
+    switch (inst->kind) {
+    case IR_PARAM: case IR_STORE: case IR_CALL: case IR_VASTART:
+        return false;
+    default:
+        return !is_terminator(inst);
+    }
+}
+
+// removes the dead instructions of bb, given the registers live on its exit
+static bool sweep_block(BB *bb, int *live) {
+    Vec *kept = vec_new();
+    bool changed = false;
+    int uses[6];
+    for (int i = vec_len(bb->insts) - 1; i >= 0; i--) {
+        Inst *inst = vec_at(bb->insts, i);
+        if (has_dst(inst) && !vset_has(live, inst->dst)) {
+            if (is_pure(inst)) {
+                changed = true;
+                continue;
+            }
+            if (inst->kind == IR_CALL) {
+                inst->dst = 0;
+                changed = true;
+            }
+        }
+
+        if (has_dst(inst))
+            vset_del(live, inst->dst);
+        int n = inst_uses(inst, uses);
+        for (int k = 0; k < n; k++)
+            vset_add(live, uses[k]);
+        vec_push(kept, inst);
+    }
+
+    Vec *insts = vec_new();
+    for (int i = vec_len(kept) - 1; i >= 0; i--)
+        vec_push(insts, vec_at(kept, i));
+    bb->insts = insts;
+    return changed;
+}
+
+void eliminate_dead_code(IRFunc *irf) {
+    ir = irf;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        int **live_out = get_live_out(ir);
+        for (int i = 0; i < vec_len(ir->blocks); i++)
+            if (sweep_block(vec_at(ir->blocks, i), vset_copy(ir, live_out[i])))
+                changed = true;
+        if (changed)
+            invalidate_liveness(ir);
+    }
+}
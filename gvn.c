@@ -0,0 +1,339 @@
+#include "ccatd.h"
+
+// Global value numbering.
+//
+// The blocks are visited down the dominator tree, giving every value a
+// number; two computations of the same operation on operands of the same
+// numbers compute the same value. A computation whose value an earlier one in
+// a dominating block already holds in a register becomes a copy of it.
+//
+// Registers are not in SSA form, so only a register with a single definition
+// holds the same value wherever that definition dominates, and only those
+// are kept to be copied from. Any other register gets a new number at the
+// start of each block and whenever it is assigned.
+//
+// A load is redundant if an earlier one read the same bytes and no store or
+// call between them may have written them. The loads are followed only along
+// the edges into blocks with a single predecessor.
+//
+// Constants and the addresses of variables are numbered but not replaced, as
+// recomputing them is cheaper than holding a register.
+//
+// An operand copied from a register with a single definition is read from
+// that register instead, leaving the copy dead. That definition must come
+// before the copy and not be run again after it, as in a loop it would
+// assign the register the value of the next iteration.
+//
+// The blocks not reachable from the entry are dropped first, as they would
+// go on reading the copies left dead.
+
+typedef struct {
+    Inst_kind kind;
+    int size;
+    int a;      // the numbers of the operands
+    int b;
+    int imm;
+    char *name;
+    int value;  // the number of the result
+    int reg;    // the register holding it, or 0
+} Expr;
+
+typedef struct {
+    int addr;   // the number of the address
+    int size;
+    Inst *def;  // the definition of the address, or NULL
+    int reg;    // the register holding the value read
+} Load;
+
+static IRFunc *ir;
+static Inst **defs;       // the only definition of each register
+static BB **def_bbs;      // the block of that definition
+static int *def_pos;      // its position in the block
+static int *checked;      // the register each copy was checked to forward, or 0
+static bool *forwards;    // whether the copy can forward it
+static bool *escaped;
+static Vec **preds;
+static BB **idom;
+static Vec **children;    // the blocks each block immediately dominates
+static int *numbers;      // the number of the value in each register, or 0
+static int num_values;
+static Vec *exprs;        // the computations available, innermost last
+static Vec **loads_out;   // the loads available at the end of each block
+
+static int new_value() {
+    return ++num_values;
+}
+
+// the number of the value in v, numbering it anew if unknown
+static int value_of(int v) {
+    if (v == 0)
+        return 0;
+    if (numbers[v] == 0)
+        numbers[v] = new_value();
+    return numbers[v];
+}
+
+static bool is_commutative(Inst_kind kind) {
+    switch (kind) {
+    case IR_ADD: case IR_MUL: case IR_MULH: case IR_AND: case IR_OR: case IR_XOR:
+    case IR_EQ: case IR_NE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_numbered(Inst *inst) {
+    switch (inst->kind) {
+    case IR_IMM: case IR_LADDR: case IR_GADDR: case IR_MOV:
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_MULH: case IR_DIV: case IR_MOD:
+    case IR_AND: case IR_OR: case IR_XOR: case IR_SHL: case IR_SHR: case IR_SAR:
+    case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_NOT: case IR_SEXT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_remat(Inst *inst) {
+    return inst->kind == IR_IMM || inst->kind == IR_LADDR || inst->kind == IR_GADDR;
+}
+
+static Expr *find_expr(Expr *key) {
+    for (int i = vec_len(exprs) - 1; i >= 0; i--) {
+        Expr *e = vec_at(exprs, i);
+        if (e->kind == key->kind && e->size == key->size && e->a == key->a && e->b == key->b
+            && e->imm == key->imm && (e->name == key->name || !strcmp(e->name, key->name)))
+            return e;
+    }
+    return NULL;
+}
+
+static void make_copy(Inst *inst, int reg) {
+    inst->kind = IR_MOV;
+    inst->a = reg;
+    inst->b = 0;
+    inst->imm = 0;
+    inst->name = NULL;
+}
+
+static void number_expr(Inst *inst) {
+    if (inst->kind == IR_MOV) {
+        numbers[inst->dst] = value_of(inst->a);
+        return;
+    }
+
+    Expr *key = calloc(1, sizeof(Expr));
+    key->kind = inst->kind;
+    key->size = inst->size;
+    key->a = value_of(inst->a);
+    key->b = value_of(inst->b);
+    key->imm = inst->imm;
+    key->name = inst->name;
+    if (is_commutative(inst->kind) && key->a > key->b) {
+        int t = key->a;
+        key->a = key->b;
+        key->b = t;
+    }
+
+    Expr *found = find_expr(key);
+    if (found == NULL) {
+        key->value = new_value();
+        if (defs[inst->dst] == inst)
+            key->reg = inst->dst;
+        vec_push(exprs, key);
+        numbers[inst->dst] = key->value;
+        return;
+    }
+    numbers[inst->dst] = found->value;
+    if (found->reg != 0 && !is_remat(inst))
+        make_copy(inst, found->reg);
+    else if (found->reg == 0 && defs[inst->dst] == inst)
+        found->reg = inst->dst;
+}
+
+// whether there is a path of at least one edge from bb to target
+static bool reaches(BB *bb, BB *target) {
+    bool *seen = calloc(ir->num_bbs, sizeof(bool));
+    Vec *work = vec_new();
+    vec_push(work, bb);
+    while (vec_len(work) > 0) {
+        BB *b = vec_pop(work);
+        for (int i = 0; i < bb_num_succs(b); i++) {
+            BB *succ = bb_succ(b, i);
+            if (succ == target)
+                return true;
+            if (!seen[succ->id]) {
+                seen[succ->id] = true;
+                vec_push(work, succ);
+            }
+        }
+    }
+    return false;
+}
+
+// whether the copy v of src holds the value src has wherever v is read
+static bool can_forward(int v, int src) {
+    if (checked[v] == src)
+        return forwards[v];
+    BB *bb = def_bbs[v];
+    BB *src_bb = def_bbs[src];
+    if (src_bb == bb)
+        forwards[v] = def_pos[src] < def_pos[v] && !reaches(bb, bb);
+    else
+        forwards[v] = dominates(idom, src_bb, bb) && !reaches(bb, src_bb);
+    checked[v] = src;
+    return forwards[v];
+}
+
+// the register v copies, or v
+static int forward(int v) {
+    for (int i = 0; i < ir->num_vregs; i++) {
+        Inst *def = defs[v];
+        if (def == NULL || def->kind != IR_MOV)
+            break;
+        Inst *src = defs[def->a];
+        if (src == NULL || src->size != def->size || !can_forward(v, def->a))
+            break;
+        v = def->a;
+    }
+    return v;
+}
+
+static void forward_copies(Inst *inst) {
+    if (inst->a)
+        inst->a = forward(inst->a);
+    if (inst->b)
+        inst->b = forward(inst->b);
+    for (int i = 0; inst->args != NULL && i < inst->nargs; i++)
+        inst->args[i] = forward(inst->args[i]);
+}
+
+// memory
+
+static void kill_loads(Vec *loads, Inst *inst) {
+    Vec *kept = vec_new();
+    for (int i = 0; i < vec_len(loads); i++) {
+        Load *load = vec_at(loads, i);
+        bool killed;
+        if (inst->kind == IR_STORE)
+            killed = may_alias(defs[inst->a], inst->size, load->def, load->size, escaped);
+        else // a call or va_start writes anything but the locals not escaped
+            killed = load->def == NULL || load->def->kind != IR_LADDR || escaped[load->def->imm];
+        if (!killed)
+            vec_push(kept, load);
+    }
+    // the loads are updated in place so that the caller sees the change
+    while (vec_len(loads) > 0)
+        vec_pop(loads);
+    for (int i = 0; i < vec_len(kept); i++)
+        vec_push(loads, vec_at(kept, i));
+}
+
+static void number_load(Inst *inst, Vec *loads) {
+    int addr = value_of(inst->a);
+    for (int i = 0; i < vec_len(loads); i++) {
+        Load *load = vec_at(loads, i);
+        if (load->addr == addr && load->size == inst->size) {
+            numbers[inst->dst] = value_of(load->reg);
+            make_copy(inst, load->reg);
+            // a byte is loaded sign-extended to 4 bytes
+            if (inst->size == 1)
+                inst->size = 4;
+            return;
+        }
+    }
+
+    numbers[inst->dst] = new_value();
+    if (defs[inst->dst] != inst)
+        return;
+    Load *load = calloc(1, sizeof(Load));
+    load->addr = addr;
+    load->size = inst->size;
+    load->def = defs[inst->a];
+    load->reg = inst->dst;
+    vec_push(loads, load);
+}
+
+// the walk
+
+static void number_block(BB *bb) {
+    // the registers assigned more than once are known only within a block
+    for (int v = 1; v <= ir->num_vregs; v++)
+        if (defs[v] == NULL)
+            numbers[v] = 0;
+
+    Vec *loads = vec_new();
+    Vec *ps = preds[bb->id];
+    if (vec_len(ps) == 1) {
+        BB *pred = vec_at(ps, 0);
+        Vec *in = loads_out[pred->id];
+        for (int i = 0; in != NULL && i < vec_len(in); i++)
+            vec_push(loads, vec_at(in, i));
+    }
+
+    for (int i = 0; i < vec_len(bb->insts); i++) {
+        Inst *inst = vec_at(bb->insts, i);
+        forward_copies(inst);
+        if (is_numbered(inst))
+            number_expr(inst);
+        else if (inst->kind == IR_LOAD)
+            number_load(inst, loads);
+        else if (inst->kind == IR_STORE || inst->kind == IR_CALL || inst->kind == IR_VASTART)
+            kill_loads(loads, inst);
+        if (has_dst(inst) && !is_numbered(inst) && inst->kind != IR_LOAD)
+            numbers[inst->dst] = new_value();
+    }
+    loads_out[bb->id] = loads;
+}
+
+static void walk(BB *bb) {
+    int scope = vec_len(exprs);
+    number_block(bb);
+    Vec *kids = children[bb->id];
+    for (int i = 0; i < vec_len(kids); i++)
+        walk(vec_at(kids, i));
+    while (vec_len(exprs) > scope)
+        vec_pop(exprs);
+}
+
+void number_values(IRFunc *irf) {
+    ir = irf;
+    if (remove_unreachable(ir))
+        invalidate_analyses(ir);
+    defs = single_defs(ir);
+    escaped = escaped_locals(ir, defs);
+    preds = get_preds(ir);
+    idom = get_idoms(ir);
+
+    def_bbs = calloc(ir->num_vregs + 1, sizeof(BB *));
+    def_pos = calloc(ir->num_vregs + 1, sizeof(int));
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            if (has_dst(inst) && defs[inst->dst] == inst) {
+                def_bbs[inst->dst] = bb;
+                def_pos[inst->dst] = j;
+            }
+        }
+    }
+    checked = calloc(ir->num_vregs + 1, sizeof(int));
+    forwards = calloc(ir->num_vregs + 1, sizeof(bool));
+
+    children = calloc(ir->num_bbs, sizeof(Vec *));
+    for (int i = 0; i < ir->num_bbs; i++)
+        children[i] = vec_new();
+    BB *entry = vec_at(ir->blocks, 0);
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        if (bb != entry && idom[bb->id] != NULL)
+            vec_push(children[idom[bb->id]->id], bb);
+    }
+
+    numbers = calloc(ir->num_vregs + 1, sizeof(int));
+    num_values = 0;
+    exprs = vec_new();
+    loads_out = calloc(ir->num_bbs, sizeof(Vec *));
+    walk(entry);
+}
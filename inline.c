@@ -0,0 +1,216 @@
+#include "ccatd.h"
+
+// Inlining.
+//
+// A call is replaced with a copy of the body of the callee when the callee is
+// defined in this file, takes a fixed number of arguments, doesn't call itself
+// and has at most inline_threshold instructions, or twice as many if it is
+// declared inline. The virtual registers and blocks of the copy are renumbered
+// into the caller, its params become moves from the arguments and its returns
+// jumps to the rest of the calling block.
+//
+// The locals of every copy share one area below those of the caller, since
+// the inlined bodies never run at the same time.
+
+int inline_threshold = 30;
+
+static IRFunc *ir;   // the caller
+static int area;     // the offset of the area of the inlined locals
+static BB **copies;  // the id of a block of the callee -> its copy
+static int base;     // added to the virtual registers of the callee
+
+static int num_insts(IRFunc *f) {
+    int n = 0;
+    for (int i = 0; i < vec_len(f->blocks); i++) {
+        BB *bb = vec_at(f->blocks, i);
+        n += vec_len(bb->insts);
+    }
+    return n;
+}
+
+static bool calls_itself(IRFunc *f) {
+    for (int i = 0; i < vec_len(f->blocks); i++) {
+        BB *bb = vec_at(f->blocks, i);
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            if (inst->kind == IR_CALL && !strcmp(inst->name, f->func->name))
+                return true;
+        }
+    }
+    return false;
+}
+
+// returns the body to put in place of call, or NULL
+static IRFunc *callee_of(Inst *call, Map *bodies) {
+    if (call->kind != IR_CALL || inline_threshold <= 0)
+        return NULL;
+    IRFunc *callee = map_find(bodies, call->name);
+    if (callee == NULL || callee == ir)
+        return NULL;
+    Func *func = callee->func;
+    if (func->is_varargs || vec_len(func->params) != call->nargs)
+        return NULL;
+    int limit = func->is_inline ? 2 * inline_threshold : inline_threshold;
+    if (num_insts(callee) > limit || calls_itself(callee))
+        return NULL;
+    return callee;
+}
+
+// copying
+
+static int renumber(int v) {
+    return v ? v + base : 0;
+}
+
+static Inst *copy_inst(Inst *inst) {
+    Inst *copy = inst_new(inst->kind, inst->size);
+    copy->dst = renumber(inst->dst);
+    copy->a = renumber(inst->a);
+    copy->b = renumber(inst->b);
+    copy->index = renumber(inst->index);
+    copy->scale = inst->scale;
+    copy->imm = inst->imm;
+    copy->nargs = inst->nargs;
+    copy->cases = inst->cases;
+    copy->name = inst->name;
+    if (inst->args) {
+        copy->args = calloc(inst->nargs + 1, sizeof(int));
+        for (int i = 0; i < inst->nargs; i++)
+            copy->args[i] = renumber(inst->args[i]);
+    }
+    if (inst->then)
+        copy->then = copies[inst->then->id];
+    if (inst->els)
+        copy->els = copies[inst->els->id];
+    if (inst->targets) {
+        copy->targets = vec_new();
+        for (int i = 0; i < vec_len(inst->targets); i++) {
+            BB *target = vec_at(inst->targets, i);
+            vec_push(copy->targets, copies[target->id]);
+        }
+    }
+    return copy;
+}
+
+// appends the copy of inst to bb, turning params and returns into the
+// passing of values to and from the caller
+static void inline_inst(BB *bb, Inst *inst, Inst *call, BB *rest) {
+    if (inst->kind == IR_RET) {
+        if (call->dst) {
+            Inst *ret = inst_new(inst->a ? IR_MOV : IR_IMM, call->size);
+            ret->dst = call->dst;
+            ret->a = renumber(inst->a);
+            vec_push(bb->insts, ret);
+        }
+        Inst *jmp = inst_new(IR_JMP, 0);
+        jmp->then = rest;
+        vec_push(bb->insts, jmp);
+        return;
+    }
+
+    Inst *copy = copy_inst(inst);
+    if (inst->kind == IR_PARAM) {
+        copy->kind = IR_MOV;
+        copy->a = call->args[inst->imm];
+        copy->imm = 0;
+    } else if (inst->kind == IR_LADDR) {
+        copy->imm += area;
+    }
+    vec_push(bb->insts, copy);
+}
+
+// copies the blocks of callee into the caller, appending them to layout, and
+// returns the copy of its entry
+static BB *inline_body(IRFunc *callee, Inst *call, BB *rest, Vec *layout) {
+    base = ir->num_vregs;
+    ir->num_vregs += callee->num_vregs;
+    if (area + callee->frame > ir->frame)
+        ir->frame = area + callee->frame;
+
+    copies = calloc(callee->num_bbs, sizeof(BB *));
+    for (int i = 0; i < vec_len(callee->blocks); i++) {
+        BB *bb = vec_at(callee->blocks, i);
+        copies[bb->id] = bb_new(ir);
+    }
+    for (int i = 0; i < vec_len(callee->blocks); i++) {
+        BB *bb = vec_at(callee->blocks, i);
+        BB *copy = copies[bb->id];
+        for (int j = 0; j < vec_len(bb->insts); j++)
+            inline_inst(copy, vec_at(bb->insts, j), call, rest);
+        vec_push(layout, copy);
+    }
+    BB *entry = vec_at(callee->blocks, 0);
+    return copies[entry->id];
+}
+
+// inlines the calls in bb, which is appended to layout with the blocks split
+// off it and the bodies copied in
+static bool inline_block(BB *bb, Map *bodies, Vec *layout) {
+    bool inlined = false;
+    vec_push(layout, bb);
+    Vec *insts = bb->insts;
+    bb->insts = vec_new();
+    for (int i = 0; i < vec_len(insts); i++) {
+        Inst *inst = vec_at(insts, i);
+        IRFunc *callee = callee_of(inst, bodies);
+        if (callee == NULL) {
+            vec_push(bb->insts, inst);
+            continue;
+        }
+
+        BB *rest = bb_new(ir);
+        Inst *jmp = inst_new(IR_JMP, 0);
+        jmp->then = inline_body(callee, inst, rest, layout);
+        vec_push(bb->insts, jmp);
+        vec_push(layout, rest);
+        bb = rest;
+        inlined = true;
+    }
+    return inlined;
+}
+
+bool inline_calls(IRFunc *irf, Map *bodies) {
+    ir = irf;
+    area = (ir->frame + 7) / 8 * 8;
+
+    Vec *layout = vec_new();
+    bool inlined = false;
+    for (int i = 0; i < vec_len(ir->blocks); i++)
+        if (inline_block(vec_at(ir->blocks, i), bodies, layout))
+            inlined = true;
+    ir->blocks = layout;
+    return inlined;
+}
+
+// unused functions
+
+static bool is_referenced(char *name, Vec *irs) {
+    for (int i = 0; i < vec_len(irs); i++) {
+        IRFunc *f = vec_at(irs, i);
+        for (int j = 0; j < vec_len(f->blocks); j++) {
+            BB *bb = vec_at(f->blocks, j);
+            for (int k = 0; k < vec_len(bb->insts); k++) {
+                Inst *inst = vec_at(bb->insts, k);
+                if ((inst->kind == IR_CALL || inst->kind == IR_GADDR) && !strcmp(inst->name, name))
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+// leaves out the static functions no longer called once their calls have
+// been inlined, including those called only from the ones left out
+Vec *drop_inlined(Vec *irs) {
+    while (true) {
+        Vec *kept = vec_new();
+        for (int i = 0; i < vec_len(irs); i++) {
+            IRFunc *f = vec_at(irs, i);
+            if (!f->func->is_static || is_referenced(f->func->name, irs))
+                vec_push(kept, f);
+        }
+        if (vec_len(kept) == vec_len(irs))
+            return kept;
+        irs = kept;
+    }
+}
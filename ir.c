@@ -0,0 +1,550 @@
+#include "ccatd.h"
+
+static char *inst_names[31] = {
+    "imm", "mov", "param", "laddr", "gaddr", "load", "store",
+    "add", "sub", "mul", "mulh", "div", "mod", "and", "or", "xor",
+    "shl", "shr", "sar", "eq", "ne", "lt", "le", "not", "sext", "call",
+    "vastart", "jmp", "br", "switch", "ret"
+};
+
+BB *bb_new(IRFunc *ir) {
+    BB *bb = calloc(1, sizeof(BB));
+    bb->id = ir->num_bbs++;
+    bb->insts = vec_new();
+    return bb;
+}
+
+Inst *inst_new(Inst_kind kind, int size) {
+    Inst *inst = calloc(1, sizeof(Inst));
+    inst->kind = kind;
+    inst->size = size;
+    return inst;
+}
+
+bool is_terminator(Inst *inst) {
+    return inst->kind >= IR_JMP;
+}
+
+bool has_dst(Inst *inst) {
+    switch (inst->kind) {
+    case IR_STORE: case IR_VASTART:
+    case IR_JMP: case IR_BR: case IR_SWITCH: case IR_RET:
+        return false;
+    case IR_CALL:
+        return inst->dst != 0;
+    default:
+        return true;
+    }
+}
+
+// stores the virtual registers read by inst into uses (at most 6 of them)
+// and returns the number of them
+int inst_uses(Inst *inst, int *uses) {
+    if (inst->kind == IR_CALL) {
+        for (int i = 0; i < inst->nargs; i++)
+            uses[i] = inst->args[i];
+        return inst->nargs;
+    }
+
+    int n = 0;
+    if (inst->a)
+        uses[n++] = inst->a;
+    if (inst->b)
+        uses[n++] = inst->b;
+    if (inst->index)
+        uses[n++] = inst->index;
+    return n;
+}
+
+Inst *bb_term(BB *bb) {
+    return vec_at(bb->insts, vec_len(bb->insts) - 1);
+}
+
+int bb_num_succs(BB *bb) {
+    Inst *term = bb_term(bb);
+    switch (term->kind) {
+    case IR_JMP:
+        return 1;
+    case IR_BR:
+        return 2;
+    case IR_SWITCH:
+        return vec_len(term->targets) + 1;
+    default:
+        return 0;
+    }
+}
+
+// the successors of a switch are its case blocks followed by the default
+BB *bb_succ(BB *bb, int i) {
+    Inst *term = bb_term(bb);
+    if (term->kind == IR_SWITCH)
+        return i < vec_len(term->targets) ? vec_at(term->targets, i) : term->els;
+    return i == 0 ? term->then : term->els;
+}
+
+// definitions
+
+// returns the only definition of each virtual register, or NULL for those
+// with none or several
+Inst **single_defs(IRFunc *ir) {
+    int *count = calloc(ir->num_vregs + 1, sizeof(int));
+    Inst **defs = calloc(ir->num_vregs + 1, sizeof(Inst *));
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            if (!has_dst(inst))
+                continue;
+            count[inst->dst]++;
+            defs[inst->dst] = inst;
+        }
+    }
+    for (int v = 1; v <= ir->num_vregs; v++)
+        if (count[v] != 1)
+            defs[v] = NULL;
+    return defs;
+}
+
+// returns the definition of v read by the pos-th instruction of bb: the last
+// one before it in bb, or else the only one in the function, or NULL
+Inst *reaching_def(BB *bb, int pos, int v, Inst **single) {
+    for (int i = pos - 1; i >= 0; i--) {
+        Inst *inst = vec_at(bb->insts, i);
+        if (has_dst(inst) && inst->dst == v)
+            return inst;
+    }
+    return single[v];
+}
+
+// whether v is used by inst only as the address it loads from or stores to
+static bool is_address_use(Inst *inst, int v) {
+    return (inst->kind == IR_LOAD && inst->a == v)
+        || (inst->kind == IR_STORE && inst->a == v && inst->b != v);
+}
+
+// returns whether the address of the local variable at each offset is taken,
+// that is, used other than to load from or store to it
+bool *escaped_locals(IRFunc *ir, Inst **defs) {
+    bool *escaped = calloc(ir->frame + 1, sizeof(bool));
+    int uses[6];
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            int n = inst_uses(inst, uses);
+            for (int k = 0; k < n; k++) {
+                Inst *def = defs[uses[k]];
+                if (def != NULL && def->kind == IR_LADDR && !is_address_use(inst, uses[k]))
+                    escaped[def->imm] = true;
+            }
+        }
+    }
+    return escaped;
+}
+
+// whether a store of store_size bytes to the address defined by s may write
+// what a load of load_size bytes from the address defined by l reads. The
+// definitions are NULL if unknown. A local whose address is never taken is
+// accessed only through its own address.
+bool may_alias(Inst *s, int store_size, Inst *l, int load_size, bool *escaped) {
+    bool s_local = s != NULL && s->kind == IR_LADDR;
+    bool l_local = l != NULL && l->kind == IR_LADDR;
+    bool s_global = s != NULL && s->kind == IR_GADDR;
+    bool l_global = l != NULL && l->kind == IR_GADDR;
+    if (s_local && l_local)
+        return -s->imm < -l->imm + load_size && -l->imm < -s->imm + store_size;
+    if (s_local)
+        return escaped[s->imm] && !l_global;
+    if (l_local)
+        return escaped[l->imm] && !s_global;
+    if (s_global && l_global)
+        return !strcmp(s->name, l->name);
+    return true;
+}
+
+// liveness
+
+// sets of virtual registers are bitsets of num_vregs + 1 bits
+static int set_words(IRFunc *ir) {
+    return ir->num_vregs / 32 + 1;
+}
+
+int *vset_new(IRFunc *ir) {
+    return calloc(set_words(ir), sizeof(int));
+}
+
+bool vset_has(int *set, int v) {
+    return (set[v / 32] & (1 << (v % 32))) != 0;
+}
+
+void vset_add(int *set, int v) {
+    set[v / 32] |= 1 << (v % 32);
+}
+
+void vset_del(int *set, int v) {
+    set[v / 32] &= ~(1 << (v % 32));
+}
+
+int *vset_copy(IRFunc *ir, int *set) {
+    int *copy = vset_new(ir);
+    for (int w = 0; w < set_words(ir); w++)
+        copy[w] = set[w];
+    return copy;
+}
+
+// maps the id of each block to its position in ir->blocks
+int *block_index(IRFunc *ir) {
+    int *index = calloc(ir->num_bbs, sizeof(int));
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        index[bb->id] = i;
+    }
+    return index;
+}
+
+// computes the registers live on entry to and on exit from each block by the
+// usual backward data-flow iteration; both are indexed by the block position
+void compute_liveness(IRFunc *ir, int **live_in, int **live_out) {
+    Vec *blocks = ir->blocks;
+    int len = vec_len(blocks);
+    int words = set_words(ir);
+    int **gen = calloc(len, sizeof(int *));  // read before written in the block
+    int **kill = calloc(len, sizeof(int *)); // written in the block
+    int uses[6];
+
+    for (int i = 0; i < len; i++) {
+        BB *bb = vec_at(blocks, i);
+        gen[i] = vset_new(ir);
+        kill[i] = vset_new(ir);
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            int n = inst_uses(inst, uses);
+            for (int k = 0; k < n; k++)
+                if (!vset_has(kill[i], uses[k]))
+                    vset_add(gen[i], uses[k]);
+            if (has_dst(inst))
+                vset_add(kill[i], inst->dst);
+        }
+        live_in[i] = vset_new(ir);
+        live_out[i] = vset_new(ir);
+    }
+
+    int *index = block_index(ir);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = len - 1; i >= 0; i--) {
+            BB *bb = vec_at(blocks, i);
+            int *out = live_out[i];
+            for (int j = 0; j < bb_num_succs(bb); j++) {
+                int *succ_in = live_in[index[bb_succ(bb, j)->id]];
+                for (int w = 0; w < words; w++)
+                    out[w] |= succ_in[w];
+            }
+            for (int w = 0; w < words; w++) {
+                int in = gen[i][w] | (out[w] & ~kill[i][w]);
+                if (in != live_in[i][w]) {
+                    live_in[i][w] = in;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+// dominators
+
+// returns the predecessors of each block by its id
+Vec **compute_preds(IRFunc *ir) {
+    Vec **preds = calloc(ir->num_bbs, sizeof(Vec *));
+    for (int i = 0; i < ir->num_bbs; i++)
+        preds[i] = vec_new();
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        for (int j = 0; j < bb_num_succs(bb); j++)
+            vec_push(preds[bb_succ(bb, j)->id], bb);
+    }
+    return preds;
+}
+
+static void visit_postorder(BB *bb, bool *seen, Vec *order) {
+    seen[bb->id] = true;
+    for (int i = 0; i < bb_num_succs(bb); i++) {
+        BB *succ = bb_succ(bb, i);
+        if (!seen[succ->id])
+            visit_postorder(succ, seen, order);
+    }
+    vec_push(order, bb);
+}
+
+// returns the blocks reachable from the entry in reverse postorder
+Vec *reverse_postorder(IRFunc *ir) {
+    bool *seen = calloc(ir->num_bbs, sizeof(bool));
+    Vec *post = vec_new();
+    visit_postorder(vec_at(ir->blocks, 0), seen, post);
+    Vec *order = vec_new();
+    for (int i = vec_len(post) - 1; i >= 0; i--)
+        vec_push(order, vec_at(post, i));
+    return order;
+}
+
+// drops the blocks not reachable from the entry, returning whether there was
+// any
+bool remove_unreachable(IRFunc *ir) {
+    bool *seen = calloc(ir->num_bbs, sizeof(bool));
+    Vec *stack = vec_new();
+    BB *entry = vec_at(ir->blocks, 0);
+    seen[entry->id] = true;
+    vec_push(stack, entry);
+    while (vec_len(stack) > 0) {
+        BB *bb = vec_pop(stack);
+        for (int i = 0; i < bb_num_succs(bb); i++) {
+            BB *succ = bb_succ(bb, i);
+            if (!seen[succ->id]) {
+                seen[succ->id] = true;
+                vec_push(stack, succ);
+            }
+        }
+    }
+
+    Vec *blocks = vec_new();
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        if (seen[bb->id])
+            vec_push(blocks, bb);
+    }
+    bool changed = vec_len(blocks) != vec_len(ir->blocks);
+    ir->blocks = blocks;
+    return changed;
+}
+
+// returns the immediate dominator of each block by its id, computed as in
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"; that of
+// the entry is the entry itself, and that of an unreachable block is NULL
+BB **compute_idoms(IRFunc *ir) {
+    Vec *order = reverse_postorder(ir);
+    Vec **preds = compute_preds(ir);
+    int *num = calloc(ir->num_bbs, sizeof(int));
+    for (int i = 0; i < vec_len(order); i++) {
+        BB *bb = vec_at(order, i);
+        num[bb->id] = i;
+    }
+
+    BB **idom = calloc(ir->num_bbs, sizeof(BB *));
+    BB *entry = vec_at(order, 0);
+    idom[entry->id] = entry;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 1; i < vec_len(order); i++) {
+            BB *bb = vec_at(order, i);
+            BB *new_idom = NULL;
+            for (int j = 0; j < vec_len(preds[bb->id]); j++) {
+                BB *p = vec_at(preds[bb->id], j);
+                if (idom[p->id] == NULL)
+                    continue;
+                if (new_idom == NULL) {
+                    new_idom = p;
+                    continue;
+                }
+                // the nearest common dominator of p and new_idom
+                while (p != new_idom) {
+                    while (num[p->id] > num[new_idom->id])
+                        p = idom[p->id];
+                    while (num[new_idom->id] > num[p->id])
+                        new_idom = idom[new_idom->id];
+                }
+            }
+            if (idom[bb->id] != new_idom) {
+                idom[bb->id] = new_idom;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+// whether every path from the entry to b passes through a
+bool dominates(BB **idom, BB *a, BB *b) {
+    while (true) {
+        if (a == b)
+            return true;
+        if (idom[b->id] == NULL || idom[b->id] == b)
+            return false;
+        b = idom[b->id];
+    }
+}
+
+// dump
+
+static void dump_address(Inst *inst) {
+    if (inst->a)
+        printf(" [%%%d", inst->a);
+    else if (inst->name)
+        printf(" [%s", inst->name);
+    else
+        printf(" [rbp");
+    if (inst->index)
+        printf("+%%%d*%d", inst->index, inst->scale);
+    if (inst->imm)
+        printf(inst->imm > 0 ? "+%d" : "%d", inst->imm);
+    printf("]");
+}
+
+static void dump_inst(Inst *inst) {
+    printf("  ");
+    if (has_dst(inst))
+        printf("%%%d = ", inst->dst);
+    printf("%s", inst_names[inst->kind]);
+    if (inst->size)
+        printf(".%d", inst->size);
+
+    switch (inst->kind) {
+    case IR_IMM: case IR_PARAM:
+        printf(" %d", inst->imm);
+        break;
+    case IR_LADDR:
+        printf(" rbp-%d", inst->imm);
+        break;
+    case IR_GADDR:
+        printf(" %s", inst->name);
+        break;
+    case IR_SEXT:
+        printf(" %%%d from %d", inst->a, inst->imm);
+        break;
+    case IR_LOAD:
+        dump_address(inst);
+        break;
+    case IR_STORE:
+        dump_address(inst);
+        printf(", %%%d", inst->b);
+        break;
+    case IR_CALL:
+        printf(inst->is_tail ? " tail %s(" : " %s(", inst->name);
+        for (int i = 0; i < inst->nargs; i++)
+            printf(i == 0 ? "%%%d" : ", %%%d", inst->args[i]);
+        printf(")");
+        break;
+    case IR_JMP:
+        printf(" bb%d", inst->then->id);
+        break;
+    case IR_BR:
+        printf(" %%%d, bb%d, bb%d", inst->a, inst->then->id, inst->els->id);
+        if (inst->imm != 0)
+            printf(inst->imm > 0 ? " likely" : " unlikely");
+        break;
+    case IR_SWITCH: {
+        printf(" %%%d [", inst->a);
+        for (int i = 0; i < vec_len(inst->targets); i++) {
+            BB *target = vec_at(inst->targets, i);
+            printf(i == 0 ? "%d: bb%d" : ", %d: bb%d", inst->cases[i], target->id);
+        }
+        printf("] bb%d", inst->els->id);
+        break;
+    }
+    default:
+        if (inst->a)
+            printf(" %%%d", inst->a);
+        if (inst->b)
+            printf(", %%%d", inst->b);
+    }
+    printf("\n");
+}
+
+void ir_dump(IRFunc *ir) {
+    printf("function %s\n", ir->func->name);
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        printf("bb%d:\n", bb->id);
+        for (int j = 0; j < vec_len(bb->insts); j++)
+            dump_inst(vec_at(bb->insts, j));
+    }
+    printf("\n");
+}
+
+// verifier
+
+static void verify_size(IRFunc *ir, Inst *inst) {
+    int size = inst->size;
+    switch (inst->kind) {
+    case IR_LOAD: case IR_STORE:
+        if (size == 1 || size == 4 || size == 8)
+            return;
+        break;
+    case IR_SEXT:
+        if ((size == 4 || size == 8) && (inst->imm == 1 || inst->imm == 4) && inst->imm < size)
+            return;
+        break;
+    case IR_JMP: case IR_VASTART:
+        return;
+    case IR_CALL: case IR_RET:
+        if (size == 0 || size == 4 || size == 8)
+            return;
+        break;
+    default:
+        if (size == 4 || size == 8)
+            return;
+    }
+    error("[ir] %s: invalid size %d of %s", ir->func->name, size, inst_names[inst->kind]);
+}
+
+void ir_verify(IRFunc *ir) {
+    char *name = ir->func->name;
+    if (vec_len(ir->blocks) == 0)
+        error("[ir] %s: no entry block", name);
+
+    bool *in_func = calloc(ir->num_bbs, sizeof(bool));
+    bool *defined = calloc(ir->num_vregs + 1, sizeof(bool));
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        if (bb->id < 0 || bb->id >= ir->num_bbs || in_func[bb->id])
+            error("[ir] %s: invalid block id %d", name, bb->id);
+        in_func[bb->id] = true;
+
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            if (!has_dst(inst))
+                continue;
+            if (inst->dst <= 0 || inst->dst > ir->num_vregs)
+                error("[ir] %s: bb%d: invalid destination %%%d", name, bb->id, inst->dst);
+            defined[inst->dst] = true;
+        }
+    }
+
+    int uses[6];
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        int len = vec_len(bb->insts);
+        if (len == 0 || !is_terminator(bb_term(bb)))
+            error("[ir] %s: bb%d does not end with a terminator", name, bb->id);
+
+        for (int j = 0; j < len; j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            if (j < len - 1 && is_terminator(inst))
+                error("[ir] %s: bb%d: a terminator in the middle of the block", name, bb->id);
+            if (inst->kind == IR_PARAM) {
+                if (i != 0 || inst->imm != j || inst->imm >= 6)
+                    error("[ir] %s: bb%d: params must lead the entry block", name, bb->id);
+            }
+            if (inst->index && inst->scale != 1 && inst->scale != 2 && inst->scale != 4 && inst->scale != 8)
+                error("[ir] %s: bb%d: invalid scale %d", name, bb->id, inst->scale);
+            if (inst->kind == IR_CALL && inst->nargs > 6)
+                error("[ir] %s: bb%d: too many arguments", name, bb->id);
+            if (inst->kind == IR_CALL && inst->is_tail && (j != len - 2 || bb_term(bb)->kind != IR_RET))
+                error("[ir] %s: bb%d: a tail call not followed by a return", name, bb->id);
+            verify_size(ir, inst);
+
+            int n = inst_uses(inst, uses);
+            for (int k = 0; k < n; k++) {
+                if (uses[k] <= 0 || uses[k] > ir->num_vregs || !defined[uses[k]])
+                    error("[ir] %s: bb%d: %%%d is used but never defined", name, bb->id, uses[k]);
+            }
+        }
+
+        for (int k = 0; k < bb_num_succs(bb); k++) {
+            BB *succ = bb_succ(bb, k);
+            if (succ == NULL || !in_func[succ->id] || vec_at(ir->blocks, 0) == succ)
+                error("[ir] %s: bb%d: invalid jump target", name, bb->id);
+        }
+    }
+}
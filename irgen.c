@@ -0,0 +1,654 @@
+#include "ccatd.h"
+
+// Lowering of the AST of a function into the IR.
+//
+// Every integer value is held in a virtual register of 4 bytes, and a char
+// is kept sign-extended to 4 bytes. Pointers take 8 bytes. Conversions
+// between them are explicit IR_SEXT instructions.
+
+static IRFunc *ir;
+static BB *cur;
+static Map *break_targets;    // loop or switch label -> BB
+static Map *continue_targets; // loop label -> BB
+static BB *unlikely;          // the target of the branches expected not to be taken
+
+static int gen_rval(Node *node);
+static int gen_addr(Node *node);
+static void gen_stmt(Node *node);
+
+// emission
+
+static bool terminated(BB *bb) {
+    return vec_len(bb->insts) > 0 && is_terminator(bb_term(bb));
+}
+
+static void set_block(BB *bb);
+
+static Inst *emit(Inst_kind kind, int size) {
+    // code following a jump is unreachable until the next label
+    if (terminated(cur))
+        set_block(bb_new(ir));
+
+    Inst *inst = inst_new(kind, size);
+    vec_push(cur->insts, inst);
+    return inst;
+}
+
+static int new_vreg() {
+    return ++ir->num_vregs;
+}
+
+static int emit_op(Inst_kind kind, int size, int a, int b) {
+    Inst *inst = emit(kind, size);
+    inst->dst = new_vreg();
+    inst->a = a;
+    inst->b = b;
+    return inst->dst;
+}
+
+static void emit_imm_to(int dst, int size, int val) {
+    Inst *inst = emit(IR_IMM, size);
+    inst->dst = dst;
+    inst->imm = val;
+}
+
+static int emit_imm(int size, int val) {
+    int dst = new_vreg();
+    emit_imm_to(dst, size, val);
+    return dst;
+}
+
+static void emit_mov_to(int dst, int size, int a) {
+    Inst *inst = emit(IR_MOV, size);
+    inst->dst = dst;
+    inst->a = a;
+}
+
+static void emit_store(int size, int addr, int val) {
+    Inst *inst = emit(IR_STORE, size);
+    inst->a = addr;
+    inst->b = val;
+}
+
+static int emit_sext(int size, int from, int a) {
+    Inst *inst = emit(IR_SEXT, size);
+    inst->dst = new_vreg();
+    inst->a = a;
+    inst->imm = from;
+    return inst->dst;
+}
+
+static void emit_jmp(BB *target) {
+    Inst *inst = emit(IR_JMP, 0);
+    inst->then = target;
+}
+
+// starts a block, which becomes the next one in the output order. The
+// current block falls through into it unless it ends with a terminator.
+static void set_block(BB *bb) {
+    if (cur != NULL && !terminated(cur))
+        emit_jmp(bb);
+    vec_push(ir->blocks, bb);
+    cur = bb;
+}
+
+static void emit_br(int size, int cond, BB *then, BB *els) {
+    Inst *inst = emit(IR_BR, size);
+    inst->a = cond;
+    inst->then = then;
+    inst->els = els;
+    if (unlikely != NULL && then != els)
+        inst->imm = then == unlikely ? -1 : els == unlikely ? 1 : 0;
+}
+
+// types
+
+static int width_of(Type *type) {
+    return is_pointer_compat(type) ? 8 : 4;
+}
+
+// converts a value of type `from' into type `to'
+static int convert(int v, Type *from, Type *to) {
+    if (to->ty == TY_VOID)
+        return v;
+    if (to->ty == TY_CHAR && from->ty != TY_CHAR)
+        return emit_sext(4, 1, v);
+    if (width_of(to) == 8 && width_of(from) == 4)
+        return emit_sext(8, 4, v);
+    return v;
+}
+
+// keeps the result of an arithmetic of type char within a char
+static int wrap(int v, Type *type) {
+    if (type->ty == TY_CHAR)
+        return emit_sext(4, 1, v);
+    return v;
+}
+
+static int gen_load(Type *type, int addr) {
+    if (type->ty == TY_ARRAY || type->ty == TY_STRUCT)
+        return addr;
+
+    Inst *inst = emit(IR_LOAD, type_size(type));
+    inst->dst = new_vreg();
+    inst->a = addr;
+    return inst->dst;
+}
+
+static void gen_store(Type *type, int addr, int val) {
+    emit_store(type_size(type), addr, val);
+}
+
+static int string_label(Node *node) {
+    for (int i = 0; i < vec_len(string_literals); i++) {
+        char *str = vec_at(string_literals, i);
+        if (!strcmp(node->name, str))
+            return i;
+    }
+    error_loc(node->loc, "[internal] string not found");
+    return -1;
+}
+
+// expressions
+
+static int gen_addr(Node *node) {
+    switch (node->kind) {
+    case ND_VAR: {
+        Inst *inst = emit(IR_LADDR, 8);
+        inst->dst = new_vreg();
+        inst->imm = node->val;
+        return inst->dst;
+    }
+    case ND_GVAR: {
+        Inst *inst = emit(IR_GADDR, 8);
+        inst->dst = new_vreg();
+        inst->name = node->name;
+        return inst->dst;
+    }
+    case ND_DEREF:
+        return gen_rval(node->lhs);
+    case ND_ATTR: {
+        int base = gen_addr(node->lhs);
+        if (node->val == 0)
+            return base;
+        return emit_op(IR_ADD, 8, base, emit_imm(8, node->val));
+    }
+    default:
+        error_loc(node->loc, "term should be a left value");
+        return 0;
+    }
+}
+
+static Inst_kind binary_inst(Node_kind kind) {
+    switch (kind) {
+    case ND_ADD: case ND_ADDEQ: return IR_ADD;
+    case ND_SUB: case ND_SUBEQ: return IR_SUB;
+    case ND_MUL: case ND_MULEQ: return IR_MUL;
+    case ND_DIV: case ND_DIVEQ: return IR_DIV;
+    case ND_MOD: case ND_MODEQ: return IR_MOD;
+    case ND_AND: case ND_ANDEQ: return IR_AND;
+    case ND_IOR: case ND_IOREQ: return IR_OR;
+    case ND_XOR: case ND_XOREQ: return IR_XOR;
+    case ND_LSH: case ND_LSHEQ: return IR_SHL;
+    case ND_RSH: case ND_RSHEQ: return IR_SHR;
+    case ND_EQ: return IR_EQ;
+    case ND_NEQ: return IR_NE;
+    case ND_LT: return IR_LT;
+    default: return IR_LE; // ND_LTE
+    }
+}
+
+// scales an integer added to or subtracted from a pointer
+static int scale_index(int v, Type *int_type, Type *ptr_type) {
+    v = convert(v, int_type, ptr_type);
+    int size = type_size(ptr_type->ptr_to);
+    if (size == 1)
+        return v;
+    return emit_op(IR_MUL, 8, v, emit_imm(8, size));
+}
+
+// computes `l op r' where l and r are of type lty and rty
+static int gen_binary(Node_kind kind, Type *type, int l, Type *lty, int r, Type *rty) {
+    Inst_kind op = binary_inst(kind);
+
+    if (op == IR_ADD || op == IR_SUB) {
+        if (is_pointer_compat(lty) && is_pointer_compat(rty)) {
+            // the difference is a multiple of the size, divided exactly by
+            // shifting out the factors of two and multiplying by the inverse
+            // of the odd rest
+            int diff = emit_op(IR_SUB, 8, l, r);
+            int size = type_size(lty->ptr_to);
+            int k = 0;
+            while (size % 2 == 0) {
+                size = size / 2;
+                k++;
+            }
+            if (k > 0)
+                diff = emit_op(IR_SAR, 8, diff, emit_imm(4, k));
+            if (size > 1)
+                diff = emit_op(IR_MUL, 4, diff, emit_imm(4, mul_inverse(size)));
+            return diff;
+        }
+        if (is_pointer_compat(lty))
+            return emit_op(op, 8, l, scale_index(r, rty, lty));
+        if (is_pointer_compat(rty))
+            return emit_op(op, 8, scale_index(l, lty, rty), r);
+    }
+
+    if (IR_EQ <= op && op <= IR_LE) {
+        int size = is_pointer_compat(lty) || is_pointer_compat(rty) ? 8 : 4;
+        if (size == 8) {
+            l = convert(l, lty, type_ptr_char);
+            r = convert(r, rty, type_ptr_char);
+        }
+        return emit_op(op, size, l, r);
+    }
+
+    return wrap(emit_op(op, 4, l, r), type);
+}
+
+static int gen_call(Node *node) {
+    if (!strcmp("__builtin_expect", node->name))
+        return gen_rval(vec_at(node->block, 0));
+    if (!strcmp("__builtin_va_start", node->name)) {
+        int ap = gen_rval(vec_at(node->block, 0));
+        Inst *inst = emit(IR_VASTART, 0);
+        inst->a = ap;
+        return emit_imm(4, 0);
+    }
+
+    Func *called = map_find(func_env, node->name);
+    int nargs = vec_len(node->block);
+    int *args = calloc(nargs + 1, sizeof(int));
+    for (int i = 0; i < nargs; i++) {
+        Node *e = vec_at(node->block, i);
+        Type *type = e->type;
+        args[i] = gen_rval(e);
+        if (i < vec_len(called->params)) {
+            Node *param = vec_at(called->params, i);
+            args[i] = convert(args[i], type, param->type);
+            type = param->type;
+        }
+        // `long' is 4 bytes in ccatd but 8 bytes in the C library
+        if (width_of(type) == 4)
+            args[i] = emit_sext(8, 4, args[i]);
+    }
+
+    Type *ret_type = called->ret_type;
+    Inst *inst = emit(IR_CALL, ret_type->ty == TY_VOID ? 0 : width_of(ret_type));
+    inst->name = node->name;
+    inst->args = args;
+    inst->nargs = nargs;
+    inst->imm = called->is_varargs;
+    if (ret_type->ty == TY_VOID)
+        return 0;
+
+    inst->dst = new_vreg();
+    // the upper bytes of a returned char are unspecified
+    if (ret_type->ty == TY_CHAR)
+        return emit_sext(4, 1, inst->dst);
+    return inst->dst;
+}
+
+// evaluates cond and branches on it. The logical operators become chains of
+// branches on their operands, whose values are never computed as 0 or 1.
+// __builtin_expect(e, c) branches on e, hinting which way the branches go.
+static void gen_branch(Node *cond, BB *then, BB *els) {
+    if (cond->kind == ND_CALL && !strcmp("__builtin_expect", cond->name)) {
+        Node *expected = vec_at(cond->block, 1);
+        BB *outer = unlikely;
+        if (expected->kind == ND_NUM)
+            unlikely = expected->val ? els : then;
+        gen_branch(vec_at(cond->block, 0), then, els);
+        unlikely = outer;
+        return;
+    }
+    if (cond->kind == ND_NEG) {
+        gen_branch(cond->lhs, els, then);
+        return;
+    }
+    if (cond->kind == ND_LAND || cond->kind == ND_LOR) {
+        BB *rhs = bb_new(ir);
+        if (cond->kind == ND_LAND)
+            gen_branch(cond->lhs, rhs, els);
+        else
+            gen_branch(cond->lhs, then, rhs);
+        set_block(rhs);
+        gen_branch(cond->rhs, then, els);
+        return;
+    }
+    int v = gen_rval(cond);
+    emit_br(width_of(cond->type), v, then, els);
+}
+
+static int gen_logical(Node *node) {
+    int result = new_vreg();
+    BB *set_true = bb_new(ir);
+    BB *set_false = bb_new(ir);
+    BB *end = bb_new(ir);
+
+    gen_branch(node, set_true, set_false);
+
+    set_block(set_true);
+    emit_imm_to(result, 4, 1);
+    emit_jmp(end);
+    set_block(set_false);
+    emit_imm_to(result, 4, 0);
+    set_block(end);
+    return result;
+}
+
+static int gen_incdec(Node *node) {
+    bool incr = node->kind == ND_PREINCR || node->kind == ND_POSTINCR;
+    bool post = node->kind == ND_POSTINCR || node->kind == ND_POSTDECR;
+    Type *type = node->lhs->type;
+
+    int addr = gen_addr(node->lhs);
+    int old = gen_load(type, addr);
+    int size = width_of(type);
+    int delta = emit_imm(size, is_pointer(type) ? type_size(type->ptr_to) : 1);
+    int new = wrap(emit_op(incr ? IR_ADD : IR_SUB, size, old, delta), type);
+    gen_store(type, addr, new);
+    return post ? old : new;
+}
+
+static int gen_rval(Node *node) {
+    switch (node->kind) {
+    case ND_NUM: case ND_CHAR: case ND_SIZEOF:
+        return emit_imm(4, node->val);
+    case ND_STRING: {
+        Inst *inst = emit(IR_GADDR, 8);
+        inst->dst = new_vreg();
+        inst->name = calloc(16, sizeof(char));
+        sprintf(inst->name, ".LC%d", string_label(node));
+        return inst->dst;
+    }
+    case ND_VAR: case ND_GVAR: case ND_DEREF: case ND_ATTR:
+        return gen_load(node->type, gen_addr(node));
+    case ND_ADDR:
+        return gen_addr(node->lhs);
+    case ND_SEQ:
+        gen_rval(node->lhs);
+        return gen_rval(node->rhs);
+    case ND_ASGN: {
+        int addr = gen_addr(node->lhs);
+        int v = convert(gen_rval(node->rhs), node->rhs->type, node->lhs->type);
+        gen_store(node->lhs->type, addr, v);
+        return v;
+    }
+    case ND_CALL:
+        return gen_call(node);
+    case ND_CAST:
+        return convert(gen_rval(node->lhs), node->lhs->type, node->type);
+    case ND_NEG: {
+        int size = width_of(node->lhs->type);
+        int v = gen_rval(node->lhs);
+        return emit_op(IR_EQ, size, v, emit_imm(size, 0));
+    }
+    case ND_BCOMPL:
+        return wrap(emit_op(IR_NOT, 4, gen_rval(node->lhs), 0), node->type);
+    case ND_COND: {
+        int result = new_vreg();
+        int size = width_of(node->type);
+        BB *then = bb_new(ir);
+        BB *els = bb_new(ir);
+        BB *end = bb_new(ir);
+
+        gen_branch(node->cond, then, els);
+        set_block(then);
+        emit_mov_to(result, size, convert(gen_rval(node->lhs), node->lhs->type, node->type));
+        emit_jmp(end);
+        set_block(els);
+        emit_mov_to(result, size, convert(gen_rval(node->rhs), node->rhs->type, node->type));
+        set_block(end);
+        return result;
+    }
+    case ND_LAND: case ND_LOR:
+        return gen_logical(node);
+    case ND_PREINCR: case ND_PREDECR: case ND_POSTINCR: case ND_POSTDECR:
+        return gen_incdec(node);
+    default:
+        break;
+    }
+
+    if (ND_ADDEQ <= node->kind && node->kind <= ND_XOREQ) {
+        Type *lty = node->lhs->type;
+        int addr = gen_addr(node->lhs);
+        int l = gen_load(lty, addr);
+        int r = gen_rval(node->rhs);
+        int v = gen_binary(node->kind, lty, l, lty, r, node->rhs->type);
+        v = convert(v, node->type, lty);
+        gen_store(lty, addr, v);
+        return v;
+    }
+
+    if (ND_ADD <= node->kind && node->kind <= ND_LTE) {
+        int l = gen_rval(node->lhs);
+        int r = gen_rval(node->rhs);
+        return gen_binary(node->kind, node->type, l, node->lhs->type, r, node->rhs->type);
+    }
+
+    error_loc(node->loc, "[ir] unsupported expression: %d", node->kind);
+    return 0;
+}
+
+// statements
+
+static void gen_vardecl(Node *node) {
+    Node *var = node->lhs;
+    Node *init = node->rhs;
+    if (init == NULL)
+        return;
+
+    if (init->kind == ND_ARRAY) {
+        Type *elem_type = var->type->ptr_to;
+        int elem_size = type_size(elem_type);
+        for (int i = 0; i < vec_len(init->block); i++) {
+            Node *e = vec_at(init->block, i);
+            int addr = gen_addr(var);
+            if (i > 0)
+                addr = emit_op(IR_ADD, 8, addr, emit_imm(8, i * elem_size));
+            gen_store(elem_type, addr, convert(gen_rval(e), e->type, elem_type));
+        }
+        return;
+    }
+
+    if (var->type->ty == TY_ARRAY && init->kind == ND_STRING) {
+        // copies the characters including the terminating null
+        int base = gen_addr(var);
+        int len = strlen(init->name);
+        for (int i = 0; i <= len && i < var->type->array_size; i++) {
+            int addr = emit_op(IR_ADD, 8, base, emit_imm(8, i));
+            emit_store(1, addr, emit_imm(4, init->name[i]));
+        }
+        return;
+    }
+
+    int addr = gen_addr(var);
+    gen_store(var->type, addr, convert(gen_rval(init), init->type, var->type));
+}
+
+static void gen_switch(Node *node) {
+    int v = gen_rval(node->cond);
+    BB *end = bb_new(ir);
+    map_put(break_targets, node->name, end);
+
+    Inst *sw = emit(IR_SWITCH, 4);
+    sw->a = v;
+    sw->targets = vec_new();
+    sw->els = end;
+
+    int len = vec_len(node->block);
+    Map *labels = map_new();
+    int ncases = 0;
+    for (int i = 0; i < len; i++) {
+        Node *stmt = vec_at(node->block, i);
+        if (stmt->kind == ND_CASE || stmt->kind == ND_DEFAULT)
+            map_put(labels, stmt->name, bb_new(ir));
+        if (stmt->kind == ND_CASE)
+            ncases++;
+    }
+
+    sw->cases = calloc(ncases + 1, sizeof(int));
+    for (int i = 0; i < len; i++) {
+        Node *stmt = vec_at(node->block, i);
+        if (stmt->kind == ND_CASE) {
+            sw->cases[vec_len(sw->targets)] = stmt->lhs->val;
+            vec_push(sw->targets, map_find(labels, stmt->name));
+        } else if (stmt->kind == ND_DEFAULT) {
+            sw->els = map_find(labels, stmt->name);
+        }
+    }
+
+    for (int i = 0; i < len; i++) {
+        Node *stmt = vec_at(node->block, i);
+        if (stmt->kind == ND_CASE || stmt->kind == ND_DEFAULT)
+            set_block(map_find(labels, stmt->name));
+        else
+            gen_stmt(stmt);
+    }
+    set_block(end);
+}
+
+static void gen_stmt(Node *node) {
+    switch (node->kind) {
+    case ND_VARDECL:
+        gen_vardecl(node);
+        return;
+    case ND_RETURN: {
+        Type *ret_type = ir->func->ret_type;
+        int v = 0;
+        if (node->lhs != NULL) {
+            v = gen_rval(node->lhs);
+            if (ret_type->ty != TY_VOID)
+                v = convert(v, node->lhs->type, ret_type);
+        }
+        Inst *inst = emit(IR_RET, 0);
+        if (v != 0 && ret_type->ty != TY_VOID) {
+            inst->a = v;
+            inst->size = width_of(ret_type);
+        }
+        return;
+    }
+    case ND_IF: {
+        BB *then = bb_new(ir);
+        BB *els = bb_new(ir);
+        BB *end = node->rhs == NULL ? els : bb_new(ir);
+        gen_branch(node->cond, then, els);
+        set_block(then);
+        gen_stmt(node->lhs);
+        if (node->rhs != NULL) {
+            emit_jmp(end);
+            set_block(els);
+            gen_stmt(node->rhs);
+        }
+        set_block(end);
+        return;
+    }
+    case ND_WHILE: {
+        BB *cond = bb_new(ir);
+        BB *body = bb_new(ir);
+        BB *end = bb_new(ir);
+        map_put(break_targets, node->name, end);
+        map_put(continue_targets, node->name, cond);
+
+        set_block(cond);
+        gen_branch(node->cond, body, end);
+        set_block(body);
+        gen_stmt(node->body);
+        emit_jmp(cond);
+        set_block(end);
+        return;
+    }
+    case ND_FOR: {
+        BB *cond = bb_new(ir);
+        BB *body = bb_new(ir);
+        BB *step = bb_new(ir);
+        BB *end = bb_new(ir);
+        map_put(break_targets, node->name, end);
+        map_put(continue_targets, node->name, step);
+
+        if (node->lhs != NULL)
+            gen_stmt(node->lhs);
+        set_block(cond);
+        if (node->cond != NULL)
+            gen_branch(node->cond, body, end);
+        set_block(body);
+        gen_stmt(node->body);
+        set_block(step);
+        if (node->rhs != NULL)
+            gen_stmt(node->rhs);
+        emit_jmp(cond);
+        set_block(end);
+        return;
+    }
+    case ND_DOWHILE: {
+        BB *body = bb_new(ir);
+        BB *cond = bb_new(ir);
+        BB *end = bb_new(ir);
+        map_put(break_targets, node->name, end);
+        map_put(continue_targets, node->name, cond);
+
+        set_block(body);
+        gen_stmt(node->body);
+        set_block(cond);
+        gen_branch(node->cond, body, end);
+        set_block(end);
+        return;
+    }
+    case ND_BREAK:
+        emit_jmp(map_find(break_targets, node->name));
+        return;
+    case ND_CONTINUE:
+        emit_jmp(map_find(continue_targets, node->name));
+        return;
+    case ND_BLOCK:
+        for (int i = 0; i < vec_len(node->block); i++)
+            gen_stmt(vec_at(node->block, i));
+        return;
+    case ND_SWITCH:
+        gen_switch(node);
+        return;
+    default:
+        gen_rval(node);
+    }
+}
+
+IRFunc *gen_ir(Func *func) {
+    ir = calloc(1, sizeof(IRFunc));
+    ir->func = func;
+    ir->frame = func->offset;
+    ir->blocks = vec_new();
+    cur = NULL;
+    break_targets = map_new();
+    continue_targets = map_new();
+
+    // the entry block moves the arguments into their stack slots
+    set_block(bb_new(ir));
+    int params_len = vec_len(func->params);
+    for (int i = 0; i < params_len; i++) {
+        Inst *inst = emit(IR_PARAM, 8);
+        inst->dst = new_vreg();
+        inst->imm = i;
+    }
+    for (int i = 0; i < params_len; i++) {
+        Node *param = vec_at(func->params, i);
+        Inst *inst = emit(IR_LADDR, 8);
+        inst->dst = new_vreg();
+        inst->imm = param->val;
+        emit_store(8, inst->dst, i + 1);
+    }
+    // no jump may target the entry block
+    set_block(bb_new(ir));
+
+    for (int i = 0; i < vec_len(func->block); i++)
+        gen_stmt(vec_at(func->block, i));
+
+    // falling off the end of a function
+    if (!terminated(cur)) {
+        int v = strcmp(func->name, "main") ? 0 : emit_imm(4, 0);
+        Inst *ret = emit(IR_RET, v ? 4 : 0);
+        ret->a = v;
+    }
+    return ir;
+}
@@ -0,0 +1,187 @@
+#include "ccatd.h"
+
+// Block layout.
+//
+// Given how often each block runs, the blocks are laid out in chains: a
+// block is followed by its hottest successor not placed yet, so that the
+// branch to it falls through, and a chain ends where there is none. The next
+// chain starts at the hottest block left. The blocks never run go last, in
+// their original order, keeping cold paths out of the hot ones.
+//
+// A loop whose header tests its exit is then rotated: the header is moved
+// below the latch jumping back to it, so that an iteration ends with the
+// conditional branch to the top of the body instead of a jump to the test.
+// The loop is entered by a jump to the header, taken once.
+//
+// Without a profile, how often a block runs is estimated from the depth of
+// the loops it is in, except that the blocks reached only along the edges a
+// __builtin_expect() hint expects not to be taken are taken as never run.
+
+// whether the edge from bb to succ is expected not to be taken
+static bool is_unlikely(BB *bb, BB *succ) {
+    Inst *term = bb_term(bb);
+    if (term->kind != IR_BR || term->then == term->els)
+        return false;
+    return (term->imm < 0 && term->then == succ) || (term->imm > 0 && term->els == succ);
+}
+
+static bool is_header(BB *bb, Vec **preds, BB **idom) {
+    Vec *ps = preds[bb->id];
+    for (int i = 0; i < vec_len(ps); i++)
+        if (dominates(idom, bb, vec_at(ps, i)))
+            return true;
+    return false;
+}
+
+// the blocks of the natural loop of the header, by id
+static bool *loop_body(IRFunc *ir, BB *header, Vec **preds, BB **idom) {
+    bool *in = calloc(ir->num_bbs, sizeof(bool));
+    in[header->id] = true;
+    Vec *work = vec_new();
+    Vec *ps = preds[header->id];
+    for (int i = 0; i < vec_len(ps); i++) {
+        BB *p = vec_at(ps, i);
+        if (dominates(idom, header, p))
+            vec_push(work, p);
+    }
+    while (vec_len(work) > 0) {
+        BB *bb = vec_pop(work);
+        if (in[bb->id])
+            continue;
+        in[bb->id] = true;
+        Vec *bps = preds[bb->id];
+        for (int i = 0; i < vec_len(bps); i++)
+            vec_push(work, vec_at(bps, i));
+    }
+    return in;
+}
+
+// 8 runs of a block for each loop it is in, or none if it is cold
+static int *estimate_freq(IRFunc *ir) {
+    Vec **preds = get_preds(ir);
+    BB **idom = get_idoms(ir);
+    int *depth = calloc(ir->num_bbs, sizeof(int));
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        if (!is_header(bb, preds, idom))
+            continue;
+        bool *in = loop_body(ir, bb, preds, idom);
+        for (int id = 0; id < ir->num_bbs; id++)
+            if (in[id])
+                depth[id]++;
+    }
+
+    // a block is cold if every edge into it but those closing a loop is
+    // unlikely or comes from a cold block
+    bool *cold = calloc(ir->num_bbs, sizeof(bool));
+    Vec *rpo = reverse_postorder(ir);
+    for (int i = 1; i < vec_len(rpo); i++) {
+        BB *bb = vec_at(rpo, i);
+        Vec *ps = preds[bb->id];
+        bool hot = false;
+        for (int j = 0; j < vec_len(ps); j++) {
+            BB *p = vec_at(ps, j);
+            if (!dominates(idom, bb, p) && !cold[p->id] && !is_unlikely(p, bb))
+                hot = true;
+        }
+        cold[bb->id] = !hot;
+    }
+
+    int *freq = calloc(ir->num_bbs, sizeof(int));
+    for (int id = 0; id < ir->num_bbs; id++) {
+        if (cold[id])
+            continue;
+        freq[id] = 1;
+        for (int d = 0; d < depth[id] && d < 8; d++)
+            freq[id] = freq[id] * 8;
+    }
+    return freq;
+}
+
+static int position(Vec *blocks, BB *bb) {
+    for (int i = 0; i < vec_len(blocks); i++)
+        if (vec_at(blocks, i) == bb)
+            return i;
+    return -1;
+}
+
+// moves the block at position from to position to, below it
+static void move_down(Vec *blocks, int from, int to) {
+    BB *bb = vec_at(blocks, from);
+    for (int i = from; i < to; i++)
+        vec_set(blocks, i, vec_at(blocks, i + 1));
+    vec_set(blocks, to, bb);
+}
+
+static void rotate_loops(IRFunc *ir) {
+    Vec **preds = get_preds(ir);
+    BB **idom = get_idoms(ir);
+    for (int i = 1; i < vec_len(ir->blocks); i++) {
+        BB *header = vec_at(ir->blocks, i);
+        Inst *term = bb_term(header);
+        if (term->kind != IR_BR || !is_header(header, preds, idom))
+            continue;
+        bool *in = loop_body(ir, header, preds, idom);
+        if (in[term->then->id] == in[term->els->id])
+            continue;
+        // the header must fall through into the rest of the loop
+        BB *body = in[term->then->id] ? term->then : term->els;
+        if (vec_at(ir->blocks, i + 1) != body)
+            continue;
+
+        // the lowest latch jumping back to the header
+        int latch = -1;
+        Vec *ps = preds[header->id];
+        for (int j = 0; j < vec_len(ps); j++) {
+            BB *p = vec_at(ps, j);
+            int pos = position(ir->blocks, p);
+            if (in[p->id] && bb_term(p)->kind == IR_JMP && pos > latch)
+                latch = pos;
+        }
+        if (latch > i) {
+            move_down(ir->blocks, i, latch);
+            i--; // the body, now in its place, may start an inner loop
+        }
+    }
+}
+
+// orders the blocks by freq, indexed by the id of a block
+void lay_out_blocks(IRFunc *ir, int *freq) {
+    bool *placed = calloc(ir->num_bbs, sizeof(bool));
+    Vec *order = vec_new();
+    BB *bb = vec_at(ir->blocks, 0);
+    while (bb != NULL) {
+        vec_push(order, bb);
+        placed[bb->id] = true;
+
+        BB *next = NULL;
+        for (int i = 0; i < bb_num_succs(bb); i++) {
+            BB *succ = bb_succ(bb, i);
+            if (!placed[succ->id] && freq[succ->id] > 0 && (next == NULL || freq[succ->id] > freq[next->id]))
+                next = succ;
+        }
+        if (next == NULL) {
+            for (int i = 0; i < vec_len(ir->blocks); i++) {
+                BB *b = vec_at(ir->blocks, i);
+                if (!placed[b->id] && freq[b->id] > 0 && (next == NULL || freq[b->id] > freq[next->id]))
+                    next = b;
+            }
+        }
+        bb = next;
+    }
+
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *b = vec_at(ir->blocks, i);
+        if (!placed[b->id])
+            vec_push(order, b);
+    }
+    ir->blocks = order;
+    rotate_loops(ir);
+    // the liveness is indexed by the positions of the blocks
+    invalidate_liveness(ir);
+}
+
+// lays out the blocks by how often they are estimated to run
+void place_blocks(IRFunc *ir) {
+    lay_out_blocks(ir, estimate_freq(ir));
+}
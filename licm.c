@@ -0,0 +1,323 @@
+#include "ccatd.h"
+
+// Loop-invariant code motion.
+//
+// The natural loops are found from the back edges, the edges to a block that
+// dominates their source. Every loop first gets a preheader, a block outside
+// it that only jumps to its header, and then, from the innermost loop out,
+// the computations whose operands don't change in the loop are moved there.
+//
+// A load is moved only if no store or call in the loop may write what it
+// reads. A local whose address is never taken is written only by the stores
+// to it; other locals and globals may also be written by the stores through
+// pointers and by calls. Loads through pointers, divisions and remainders
+// may fault, so they are moved only from the blocks run on every trip.
+//
+// Constants and the addresses of variables are not moved on their own, as
+// recomputing them is cheaper than holding a register across the loop. Those
+// read by a computation being moved are copied into the preheader with it.
+
+typedef struct {
+    BB *header;
+    bool *body; // indexed by the id of a block
+    int size;
+} Loop;
+
+static IRFunc *ir;
+static Inst **defs;     // the only definition of each virtual register
+static bool *escaped;   // the local variables whose addresses are taken
+static int *loop_defs;  // the number of definitions of each register in the loop
+static int *copies;     // the copy in the preheader of each register, or 0
+
+// loops
+
+static bool reachable(BB **idom, BB *bb) {
+    return idom[bb->id] != NULL;
+}
+
+// finds the natural loops, merging those with the same header, and returns
+// them from the smallest
+static Vec *find_loops() {
+    Vec **preds = get_preds(ir);
+    BB **idom = get_idoms(ir);
+    Loop **by_header = calloc(ir->num_bbs, sizeof(Loop *));
+    Vec *loops = vec_new();
+
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        if (!reachable(idom, bb))
+            continue;
+        for (int j = 0; j < bb_num_succs(bb); j++) {
+            BB *header = bb_succ(bb, j);
+            if (!dominates(idom, header, bb))
+                continue;
+
+            Loop *loop = by_header[header->id];
+            if (loop == NULL) {
+                loop = calloc(1, sizeof(Loop));
+                loop->header = header;
+                loop->body = calloc(ir->num_bbs, sizeof(bool));
+                loop->body[header->id] = true;
+                loop->size = 1;
+                by_header[header->id] = loop;
+                vec_push(loops, loop);
+            }
+
+            // the blocks reaching the back edge without passing the header
+            Vec *stack = vec_new();
+            vec_push(stack, bb);
+            while (vec_len(stack) > 0) {
+                BB *b = vec_pop(stack);
+                if (loop->body[b->id])
+                    continue;
+                loop->body[b->id] = true;
+                loop->size++;
+                for (int k = 0; k < vec_len(preds[b->id]); k++) {
+                    BB *p = vec_at(preds[b->id], k);
+                    if (reachable(idom, p))
+                        vec_push(stack, p);
+                }
+            }
+        }
+    }
+
+    // insertion sort, which keeps the order of the loops of the same size
+    for (int i = 1; i < vec_len(loops); i++) {
+        Loop *loop = vec_at(loops, i);
+        int j = i;
+        while (j > 0) {
+            Loop *prev = vec_at(loops, j - 1);
+            if (prev->size <= loop->size)
+                break;
+            vec_set(loops, j, prev);
+            j--;
+        }
+        vec_set(loops, j, loop);
+    }
+    return loops;
+}
+
+static void retarget(Inst *term, BB *from, BB *to) {
+    if (term->then == from)
+        term->then = to;
+    if (term->els == from)
+        term->els = to;
+    if (term->kind == IR_SWITCH)
+        for (int i = 0; i < vec_len(term->targets); i++)
+            if (vec_at(term->targets, i) == from)
+                vec_set(term->targets, i, to);
+}
+
+// returns the only block entering the loop from outside, or NULL
+static BB *entering_block(Loop *loop, Vec **preds) {
+    Vec *ps = preds[loop->header->id];
+    BB *entering = NULL;
+    for (int i = 0; i < vec_len(ps); i++) {
+        BB *p = vec_at(ps, i);
+        if (loop->body[p->id])
+            continue;
+        if (entering != NULL && entering != p)
+            return NULL;
+        entering = p;
+    }
+    return entering;
+}
+
+static BB *find_preheader(Loop *loop, Vec **preds) {
+    BB *entering = entering_block(loop, preds);
+    if (entering == NULL || bb_num_succs(entering) != 1)
+        return NULL;
+    return entering;
+}
+
+// gives the loop a preheader unless it has one
+static void insert_preheader(Loop *loop) {
+    Vec **preds = compute_preds(ir);
+    if (find_preheader(loop, preds) != NULL)
+        return;
+
+    BB *header = loop->header;
+    BB *pre = bb_new(ir);
+    Inst *jmp = inst_new(IR_JMP, 0);
+    jmp->then = header;
+    vec_push(pre->insts, jmp);
+
+    Vec *ps = preds[header->id];
+    for (int i = 0; i < vec_len(ps); i++) {
+        BB *p = vec_at(ps, i);
+        if (!loop->body[p->id])
+            retarget(bb_term(p), header, pre);
+    }
+
+    Vec *blocks = vec_new();
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        if (bb == header)
+            vec_push(blocks, pre);
+        vec_push(blocks, bb);
+    }
+    ir->blocks = blocks;
+}
+
+// memory
+
+static bool is_local(Inst *addr) {
+    return addr != NULL && addr->kind == IR_LADDR;
+}
+
+static bool is_global(Inst *addr) {
+    return addr != NULL && addr->kind == IR_GADDR;
+}
+
+// whether a store or a call in the loop may write what load reads
+static bool is_clobbered(Loop *loop, Inst *load) {
+    Inst *l = defs[load->a];
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        if (!loop->body[bb->id])
+            continue;
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            if (inst->kind == IR_STORE && may_alias(defs[inst->a], inst->size, l, load->size, escaped))
+                return true;
+            if ((inst->kind == IR_CALL || inst->kind == IR_VASTART) && !(is_local(l) && !escaped[l->imm]))
+                return true;
+        }
+    }
+    return false;
+}
+
+// invariance
+
+static bool is_remat(Inst *def) {
+    return def != NULL && (def->kind == IR_IMM || def->kind == IR_LADDR || def->kind == IR_GADDR);
+}
+
+// whether bb runs on every trip through the loop that leaves it
+static bool runs_every_trip(Loop *loop, BB **idom, BB *bb) {
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *b = vec_at(ir->blocks, i);
+        if (!loop->body[b->id])
+            continue;
+        for (int j = 0; j < bb_num_succs(b); j++)
+            if (!loop->body[bb_succ(b, j)->id] && !dominates(idom, bb, b))
+                return false;
+    }
+    return true;
+}
+
+static bool is_invariant(Loop *loop, BB **idom, BB *bb, Inst *inst) {
+    switch (inst->kind) {
+    case IR_IMM: case IR_LADDR: case IR_GADDR:
+    case IR_PARAM: case IR_STORE: case IR_CALL: case IR_VASTART:
+        return false;
+    default:
+        if (is_terminator(inst) || defs[inst->dst] != inst)
+            return false;
+    }
+
+    int uses[6];
+    int n = inst_uses(inst, uses);
+    for (int i = 0; i < n; i++)
+        if (loop_defs[uses[i]] > 0 && !is_remat(defs[uses[i]]))
+            return false;
+
+    if (inst->kind == IR_LOAD) {
+        if (is_clobbered(loop, inst))
+            return false;
+        Inst *addr = defs[inst->a];
+        if (is_local(addr) || is_global(addr))
+            return true;
+    }
+    if (inst->kind == IR_LOAD || inst->kind == IR_DIV || inst->kind == IR_MOD)
+        return runs_every_trip(loop, idom, bb);
+    return true;
+}
+
+// hoisting
+
+// returns the register holding the value of v in the preheader pre
+static int hoisted_operand(BB *pre, int v) {
+    if (loop_defs[v] == 0)
+        return v;
+    if (copies[v] == 0) {
+        Inst *def = defs[v];
+        Inst *copy = inst_new(def->kind, def->size);
+        copy->dst = ++ir->num_vregs;
+        copy->imm = def->imm;
+        copy->name = def->name;
+        vec_push(pre->insts, copy);
+        copies[v] = copy->dst;
+    }
+    return copies[v];
+}
+
+// moves inst to the end of pre, whose terminator has been taken off
+static void hoist(BB *pre, Inst *inst) {
+    if (inst->a)
+        inst->a = hoisted_operand(pre, inst->a);
+    if (inst->b)
+        inst->b = hoisted_operand(pre, inst->b);
+    vec_push(pre->insts, inst);
+    loop_defs[inst->dst] = 0;
+}
+
+static void hoist_loop(Loop *loop) {
+    Vec **preds = get_preds(ir);
+    BB **idom = get_idoms(ir);
+    BB *pre = find_preheader(loop, preds);
+    if (pre == NULL)
+        return;
+
+    defs = single_defs(ir);
+    loop_defs = calloc(ir->num_vregs + 1, sizeof(int));
+    copies = calloc(ir->num_vregs + 1, sizeof(int));
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        if (!loop->body[bb->id])
+            continue;
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            if (has_dst(inst))
+                loop_defs[inst->dst]++;
+        }
+    }
+
+    Inst *term = vec_pop(pre->insts);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < vec_len(ir->blocks); i++) {
+            BB *bb = vec_at(ir->blocks, i);
+            if (!loop->body[bb->id])
+                continue;
+            Vec *kept = vec_new();
+            for (int j = 0; j < vec_len(bb->insts); j++) {
+                Inst *inst = vec_at(bb->insts, j);
+                if (is_invariant(loop, idom, bb, inst)) {
+                    hoist(pre, inst);
+                    changed = true;
+                } else {
+                    vec_push(kept, inst);
+                }
+            }
+            bb->insts = kept;
+        }
+    }
+    vec_push(pre->insts, term);
+}
+
+void hoist_invariants(IRFunc *irf) {
+    ir = irf;
+    Vec *loops = find_loops();
+    for (int i = 0; i < vec_len(loops); i++)
+        insert_preheader(vec_at(loops, i));
+
+    // the preheaders are now part of the loops around
+    invalidate_analyses(ir);
+    loops = find_loops();
+    defs = single_defs(ir);
+    escaped = escaped_locals(ir, defs);
+    for (int i = 0; i < vec_len(loops); i++)
+        hoist_loop(vec_at(loops, i));
+}
@@ -1,7 +1,7 @@
 #include "ccatd.h"
 
 static void append_type_param(Vec *params, Type* t) {
-    Node *node = calloc(1, sizeof(Node));
+    Node *node = node_new();
     node->type = t;
     node->kind = ND_VAR;
     vec_push(params, node);
@@ -63,6 +63,9 @@ static void init() {
     Type *assert_equals_args[2] = {type_int, type_int};
     push_function("assert_equals", assert_equals_args, 2, type_int, false);
 
+    Type *builtin_expect_args[2] = {type_int, type_int};
+    push_function("__builtin_expect", builtin_expect_args, 2, type_int, false);
+
     Type *builtin_va_start_args[1] = {type_void};
     push_function("__builtin_va_start", builtin_va_start_args, 1, type_void, true);
 }
@@ -90,14 +93,87 @@ static char *read_file(char *path) {
     return buf;
 }
 
+// generates the IR of the functions defined and optimizes it, returning those
+// to be output
+static Vec *lower() {
+    Vec *irs = vec_new();
+    for (int i = 0; i < vec_len(functions); i++) {
+        Func *func = vec_at(functions, i);
+        if (func->is_extern)
+            continue;
+        IRFunc *ir = gen_ir(func);
+        ir_verify(ir);
+        vec_push(irs, ir);
+    }
+    return run_pipeline(irs);
+}
+
 int main(int argc, char **argv) {
-    if (argc != 2) {
+    char *path = NULL;
+    int opt_level = 0;
+    char *passes = NULL;
+    bool dump_ir = false;
+    char *profile_use = NULL;
+    for (int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (!strcmp(arg, "-O0")) {
+            opt_level = 0;
+        } else if (!strcmp(arg, "-O1")) {
+            opt_level = 1;
+        } else if (!strcmp(arg, "-O2") || !strcmp(arg, "--ir")) {
+            opt_level = 2;
+        } else if (!strncmp(arg, "--passes=", 9)) {
+            passes = arg + 9;
+        } else if (!strcmp(arg, "--verify-each")) {
+            verify_each = true;
+        } else if (!strcmp(arg, "--time-passes")) {
+            time_passes = true;
+        } else if (!strcmp(arg, "--dump-ir")) {
+            dump_ir = true;
+        } else if (!strncmp(arg, "--inline-threshold=", 19)) {
+            inline_threshold = strtol(arg + 19, NULL, 10);
+        } else if (!strcmp(arg, "-fno-omit-frame-pointer")) {
+            omit_frame_pointer = false;
+        } else if (!strcmp(arg, "-fomit-frame-pointer")) {
+            omit_frame_pointer = true;
+        } else if (!strcmp(arg, "-fprofile-generate")) {
+            profile_generate = "ccatd.prof";
+        } else if (!strncmp(arg, "-fprofile-generate=", 19)) {
+            profile_generate = arg + 19;
+        } else if (!strcmp(arg, "-fprofile-use")) {
+            profile_use = "ccatd.prof";
+        } else if (!strncmp(arg, "-fprofile-use=", 14)) {
+            profile_use = arg + 14;
+        } else if (!strcmp(arg, "--peephole-stats")) {
+            peephole_stats = true;
+        } else if (!strncmp(arg, "--tokenize-jobs=", 16)) {
+            tokenize_jobs = strtol(arg + 16, NULL, 10);
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "unknown option: %s\n", arg);
+            return 1;
+        } else if (path == NULL) {
+            path = arg;
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (path == NULL) {
         fprintf(stderr, "invalid number of argument(s)\n");
         return 1;
     }
+    // the profile counts the blocks of the IR, optimized as at -O2 by default
+    if ((profile_generate != NULL || profile_use != NULL) && opt_level == 0)
+        opt_level = 2;
+    // -O0 generates the code from the AST in one walk, without the IR
+    bool use_ir = opt_level > 0 || passes != NULL || dump_ir;
+    if (passes != NULL)
+        set_pipeline(passes);
+    else if (opt_level > 0)
+        set_opt_level(opt_level);
     init();
 
-    char *code = read_file(argv[1]);
+    char *code = read_file(path);
     tokenize(code);
     parse();
 
@@ -108,6 +184,21 @@ int main(int argc, char **argv) {
         sema_func(func);
     }
 
+    Vec *irs = NULL;
+    if (use_ir)
+        irs = lower();
+    if (profile_use != NULL) {
+        load_profile(read_file(profile_use));
+        irs = apply_profile(irs);
+    }
+    if (dump_ir) {
+        for (int i = 0; i < vec_len(irs); i++)
+            ir_dump(vec_at(irs, i));
+        if (time_passes)
+            print_pass_times();
+        return 0;
+    }
+
     printf("  .intel_syntax noprefix\n");
 
     gen_globals();
@@ -119,8 +210,27 @@ int main(int argc, char **argv) {
             printf("  .globl %s\n", func->name);
     }
 
-    for (int i = 0; i < len; i++)
-        gen_func(vec_at(functions, i));
+    if (!use_ir) {
+        for (int i = 0; i < len; i++) {
+            gen_func(vec_at(functions, i));
+            flush_asm();
+        }
+    } else {
+        for (int i = 0; i < vec_len(irs); i++) {
+            IRFunc *ir = vec_at(irs, i);
+            reg_alloc(ir);
+            gen_x86(ir);
+            flush_asm();
+        }
+    }
+
+    if (profile_generate != NULL)
+        gen_profile_runtime();
+
+    if (peephole_stats)
+        print_peephole_stats();
+    if (time_passes)
+        print_pass_times();
     return 0;
 }
 
@@ -1,6 +1,6 @@
 #include "ccatd.h"
 
-int index = 0;
+int pos = 1; // the current token number
 Vec *functions;
 Map *global_vars;
 Environment *variable_env;
@@ -16,8 +16,9 @@ static Node *consume_declarator(Type* typ);
 static Node *declarator(Type* typ);
 
 static Func *parse_func(Node *decl, bool is_static, bool is_extern);
-static Type *parse_struct(Location *start);
-static Type *parse_enum(Location *start);
+static Type *parse_struct(int start);
+static Type *parse_enum(int start);
+static Node *enumerator(Type *typ);
 
 static Vec *block();
 static Node *stmt();
@@ -43,20 +44,20 @@ static Node *postfix();
 static Node *primary();
 static Vec *args();
 
-static Token *lookahead_any();
-static Token *lookahead(Token_kind kind);
-static Token *lookahead_keyword(char *str);
-static Token *consume(Token_kind kind);
-static Token *consume_keyword(char *str);
-static Token *expect(Token_kind kind);
-static Token *expect_keyword(char *str);
-static Token *consume_value_identifier();
-static Token *value_identifier();
+static int lookahead_any();
+static int lookahead(Token_kind kind);
+static int lookahead_keyword(char *str);
+static int consume(Token_kind kind);
+static int consume_keyword(char *str);
+static int expect(Token_kind kind);
+static int expect_keyword(char *str);
+static int consume_value_identifier();
+static int value_identifier();
 static Type *consume_type_identifier();
 
-static Node *mknode(Node_kind kind, Location *loc);
-static Node *binop(Node_kind kind, Node *lhs, Node *rhs, Location *loc);
-Node *mknum(int v, Location *loc);
+static Node *mknode(Node_kind kind, int loc);
+static Node *binop(Node_kind kind, Node *lhs, Node *rhs, int loc);
+Node *mknum(int v, int loc);
 
 // Parse
 
@@ -68,8 +69,7 @@ void parse() {
     enum_env = env_new(NULL);
     aliases = env_new(builtin_aliases);
 
-    int len = vec_len(tokens);
-    while (index < len)
+    while (pos <= num_tokens)
         toplevel();
 }
 
@@ -78,17 +78,20 @@ static int MASK_EXTERN  = 1 << 1;
 static int MASK_STATIC  = 1 << 2;
 
 static void toplevel() {
-    Token *tk;
+    int tk;
     int storage_class = 0;
+    int inline_tk = 0;
     while (true) {
-        int m = ((tk = consume_keyword("typedef")) != NULL) ? MASK_TYPEDEF
-              : ((tk = consume_keyword("extern")) != NULL) ? MASK_EXTERN
-              : ((tk = consume_keyword("static")) != NULL) ? MASK_STATIC
+        if (inline_tk == 0 && (inline_tk = consume_keyword("inline")))
+            continue;
+        int m = (tk = consume_keyword("typedef")) ? MASK_TYPEDEF
+              : (tk = consume_keyword("extern")) ? MASK_EXTERN
+              : (tk = consume_keyword("static")) ? MASK_STATIC
               : 0;
         if (m == 0)
             break;
         if (storage_class)
-            error_loc(tk->loc, "[parse] multiple storage classes");
+            error_loc(token_locs[tk], "[parse] multiple storage classes");
         storage_class |= m;
     }
 
@@ -119,9 +122,12 @@ static void toplevel() {
     }
     if (is_func(decl->type)) {
         Func *func = parse_func(decl, is_static, is_extern);
+        func->is_inline = inline_tk != 0;
         vec_push(functions, func);
         return;
     }
+    if (inline_tk)
+        error_loc(token_locs[inline_tk], "[parse] only functions can be inline");
 
     decl->kind = ND_GVAR;
     decl->is_extern = is_extern;
@@ -129,7 +135,7 @@ static void toplevel() {
     decl->rhs = NULL;
     if (consume_keyword("=")) {
         if (is_extern)
-            error_loc(tk->loc, "[parse] extern variable declaration shouldn't have a value");
+            error_loc(token_locs[tk], "[parse] extern variable declaration shouldn't have a value");
         decl->rhs = initializer();
     }
     expect_keyword(";");
@@ -188,8 +194,8 @@ static Func *parse_func(Node *decl, bool is_static, bool is_extern) {
     return func;
 }
 
-static Type *parse_struct(Location *start) {
-    Token *strc_id = consume(TK_IDT);
+static Type *parse_struct(int start) {
+    int strc_id = consume(TK_IDT);
     Vec *fields = NULL;
     if (consume_keyword("{")) {
         fields = vec_new();
@@ -203,11 +209,11 @@ static Type *parse_struct(Location *start) {
         }
     }
 
-    if (strc_id == NULL && fields == NULL)
+    if (!strc_id && fields == NULL)
         error_loc(start, "[parse] invalid struct statement");
 
     Struct *strc = calloc(1, sizeof(Struct));
-    strc->name = (strc_id == NULL) ? NULL : strc_id->str;
+    strc->name = strc_id ? token_str(strc_id) : NULL;
     strc->loc = start;
 
     Type *typ = calloc(1, sizeof(Type));
@@ -250,18 +256,18 @@ static Type *parse_struct(Location *start) {
     return typ;
 }
 
-static Type *parse_enum(Location *start) {
-    Token *enum_id = consume(TK_IDT);
+static Type *parse_enum(int start) {
+    int enum_id = consume(TK_IDT);
 
     Type *typ = calloc(1, sizeof(Type));
     typ->ty = TY_ENUM;
 
     if (consume_keyword("{")) {
         typ->enums = vec_new();
-        vec_push(typ->enums, expect(TK_IDT));
+        vec_push(typ->enums, enumerator(typ));
         while (!consume_keyword("}")) {
             expect_keyword(",");
-            vec_push(typ->enums, expect(TK_IDT));
+            vec_push(typ->enums, enumerator(typ));
         }
     }
 
@@ -269,28 +275,23 @@ static Type *parse_enum(Location *start) {
     if (typ->enum_decl) {
         int len = vec_len(typ->enums);
         for (int i = 0; i < len; i++) {
-            Token *tk = vec_at(typ->enums, i);
-            Node *id = mknode(ND_GVAR, tk->loc);
-            id->type = typ;
-            id->name = tk->str;
-            id->is_enum = true;
-            id->val = i;
+            Node *id = vec_at(typ->enums, i);
             map_put(variable_env->map, id->name, id);
         }
     }
 
-    if (enum_id == NULL && typ->enums == NULL)
+    if (!enum_id && typ->enums == NULL)
         error_loc(start, "[parse] invalid struct statement");
 
-    if (enum_id != NULL) {
-        Vec *existing = map_find(enum_env->map, enum_id->str);
+    if (enum_id) {
+        Vec *existing = map_find(enum_env->map, token_str(enum_id));
         if (enum_decl && existing != NULL)
             error_loc(start, "[parse] duplicate enum type");
 
         if (enum_decl)
-            env_push(enum_env, enum_id->str, typ->enums);
+            env_push(enum_env, token_str(enum_id), typ->enums);
         else {
-            existing = env_find(enum_env, enum_id->str);
+            existing = env_find(enum_env, token_str(enum_id));
             if (existing == NULL)
                 error_loc(start, "[parse] undefined enum type");
             typ->enums = existing;
@@ -300,19 +301,30 @@ static Type *parse_enum(Location *start) {
     return typ;
 }
 
+// the value is assigned in the semantic analysis
+static Node *enumerator(Type *typ) {
+    int tk = expect(TK_IDT);
+    Node *id = mknode(ND_GVAR, token_locs[tk]);
+    id->type = typ;
+    id->name = token_str(tk);
+    id->is_enum = true;
+    id->rhs = consume_keyword("=") ? conditional() : NULL;
+    return id;
+}
+
 static Type *consume_type_spec() {
-    Token *tk;
+    int tk;
     if ((tk = consume_keyword("struct")))
-        return parse_struct(tk->loc);
+        return parse_struct(token_locs[tk]);
     if ((tk = consume_keyword("enum")))
-        return parse_enum(tk->loc);
+        return parse_enum(token_locs[tk]);
     return consume_type_identifier();
 }
 
 static Type *type_spec() {
     Type *typ = consume_type_spec();
     if (typ == NULL)
-        error_loc(lookahead_any()->loc, "[parse] type expected");
+        error_loc(token_locs[lookahead_any()], "[parse] type expected");
     return typ;
 }
 
@@ -320,16 +332,16 @@ static Node *consume_declarator(Type *spec) {
     Type *typ = spec;
     while (consume_keyword("*")) typ = ptr_of(typ);
 
-    Token *id = consume_value_identifier();
-    if (id == NULL) {
+    int id = consume_value_identifier();
+    if (!id) {
         if (typ != spec)
-            error_loc(lookahead_any()->loc, "[parse] identifier expected in declarator");
+            error_loc(token_locs[lookahead_any()], "[parse] identifier expected in declarator");
         return NULL;
     }
 
-    Node *decl = calloc(1, sizeof(Node));
-    decl->loc = id->loc;
-    decl->name = id->str;
+    Node *decl = node_new();
+    decl->loc = token_locs[id];
+    decl->name = token_str(id);
 
     if (lookahead_keyword("(")) {
         decl->type = func_returns(typ);
@@ -338,8 +350,8 @@ static Node *consume_declarator(Type *spec) {
 
     decl->type = typ;
     while (consume_keyword("[")) {
-        Token *len = consume(TK_NUM);
-        decl->type = array_of(decl->type, len->val);
+        int len = consume(TK_NUM);
+        decl->type = array_of(decl->type, token_vals[len]);
         expect_keyword("]");
     }
     return decl;
@@ -348,7 +360,7 @@ static Node *consume_declarator(Type *spec) {
 static Node *declarator(Type *spec) {
     Node *decl = consume_declarator(spec);
     if (decl == NULL)
-        error_loc(lookahead_any()->loc, "[parse] identifier expected in declarator");
+        error_loc(token_locs[lookahead_any()], "[parse] identifier expected in declarator");
     return decl;
 }
 
@@ -369,31 +381,31 @@ static Vec *block() {
 }
 
 static Node *stmt() {
-    Token *tk;
+    int tk;
     Node *node;
     Type *typ;
     if ((tk = consume_keyword("return"))) {
         Node *ret = NULL;
-        if (consume_keyword(";") == NULL) {
+        if (!consume_keyword(";")) {
             ret = expr();
             expect_keyword(";");
         }
-        node = binop(ND_RETURN, ret, NULL, tk->loc);
+        node = binop(ND_RETURN, ret, NULL, token_locs[tk]);
     } else if ((tk = consume_keyword("if"))) {
-        node = mknode(ND_IF, tk->loc);
+        node = mknode(ND_IF, token_locs[tk]);
         expect_keyword("(");
         node->cond = expr();
         expect_keyword(")");
         node->lhs = stmt();
         node->rhs = consume_keyword("else") ? stmt() : NULL;
     } else if ((tk = consume_keyword("while"))) {
-        node = mknode(ND_WHILE, tk->loc);
+        node = mknode(ND_WHILE, token_locs[tk]);
         expect_keyword("(");
         node->cond = expr();
         expect_keyword(")");
         node->body = stmt();
     } else if ((tk = consume_keyword("for"))) {
-        node = mknode(ND_FOR, tk->loc);
+        node = mknode(ND_FOR, token_locs[tk]);
         expect_keyword("(");
         if (!consume_keyword(";")) {
             if ((typ = consume_type_spec())) {
@@ -415,7 +427,7 @@ static Node *stmt() {
         }
         node->body = stmt();
     } else if ((tk = consume_keyword("do"))) {
-        node = mknode(ND_DOWHILE, tk->loc);
+        node = mknode(ND_DOWHILE, token_locs[tk]);
         node->body = stmt();
         expect_keyword("while");
         expect_keyword("(");
@@ -424,26 +436,26 @@ static Node *stmt() {
         expect_keyword(";");
     } else if ((tk = consume_keyword("break"))) {
         expect_keyword(";");
-        node = mknode(ND_BREAK, tk->loc);
+        node = mknode(ND_BREAK, token_locs[tk]);
     } else if ((tk = consume_keyword("continue"))) {
         expect_keyword(";");
-        node = mknode(ND_CONTINUE, tk->loc);
+        node = mknode(ND_CONTINUE, token_locs[tk]);
     } else if ((tk = consume_keyword("switch"))) {
-        node = mknode(ND_SWITCH, tk->loc);
+        node = mknode(ND_SWITCH, token_locs[tk]);
         expect_keyword("(");
         node->cond = expr();
         expect_keyword(")");
         node->block = block();
     } else if ((tk = consume_keyword("case"))) {
-        node = mknode(ND_CASE, tk->loc);
+        node = mknode(ND_CASE, token_locs[tk]);
         node->lhs = expr();
         expect_keyword(":");
     } else if ((tk = consume_keyword("default"))) {
-        node = mknode(ND_DEFAULT, tk->loc);
+        node = mknode(ND_DEFAULT, token_locs[tk]);
         expect_keyword(":");
     } else if ((tk = lookahead_keyword("{"))) {
         Vec *vec = block();
-        node = mknode(ND_BLOCK, tk->loc);
+        node = mknode(ND_BLOCK, token_locs[tk]);
         node->block = vec;
     } else if ((typ = consume_type_spec())) {
         Node *lhs = declarator(typ);
@@ -460,7 +472,7 @@ static Node *stmt() {
 
 // Expressions
 
-static Node *initializer_list(Location *start) {
+static Node *initializer_list(int start) {
     Node *ret = mknode(ND_ARRAY, start);
     ret->block = vec_new();
     if (consume_keyword("}"))
@@ -475,45 +487,45 @@ static Node *initializer_list(Location *start) {
 }
 
 static Node *initializer() {
-    Token *tk = NULL;
+    int tk = 0;
     if ((tk = consume_keyword("{")))
-        return initializer_list(tk->loc);
+        return initializer_list(token_locs[tk]);
     return expr();
 }
 
 static Node *expr() {
     Node *node = assignment();
-    for (Token *tk; (tk = consume_keyword(","));)
-        node = binop(ND_SEQ, node, assignment(), tk->loc);
+    for (int tk; (tk = consume_keyword(","));)
+        node = binop(ND_SEQ, node, assignment(), token_locs[tk]);
     return node;
 }
 
 // TODO: assignment ::= conditional | unary unary-op assignment
 static Node *assignment() {
     Node *node = conditional();
-    Token *tk;
+    int tk;
     if ((tk = consume_keyword("=")))
-        return binop(ND_ASGN, node, assignment(), tk->loc);
+        return binop(ND_ASGN, node, assignment(), token_locs[tk]);
     if ((tk = consume_keyword("+=")))
-        return binop(ND_ADDEQ, node, assignment(), tk->loc);
+        return binop(ND_ADDEQ, node, assignment(), token_locs[tk]);
     if ((tk = consume_keyword("-=")))
-        return binop(ND_SUBEQ, node, assignment(), tk->loc);
+        return binop(ND_SUBEQ, node, assignment(), token_locs[tk]);
     if ((tk = consume_keyword("*=")))
-        return binop(ND_MULEQ, node, assignment(), tk->loc);
+        return binop(ND_MULEQ, node, assignment(), token_locs[tk]);
     if ((tk = consume_keyword("/=")))
-        return binop(ND_DIVEQ, node, assignment(), tk->loc);
+        return binop(ND_DIVEQ, node, assignment(), token_locs[tk]);
     if ((tk = consume_keyword("%=")))
-        return binop(ND_MODEQ, node, assignment(), tk->loc);
+        return binop(ND_MODEQ, node, assignment(), token_locs[tk]);
     if ((tk = consume_keyword("<<=")))
-        return binop(ND_LSHEQ, node, assignment(), tk->loc);
+        return binop(ND_LSHEQ, node, assignment(), token_locs[tk]);
     if ((tk = consume_keyword(">>=")))
-        return binop(ND_RSHEQ, node, assignment(), tk->loc);
+        return binop(ND_RSHEQ, node, assignment(), token_locs[tk]);
     if ((tk = consume_keyword("&=")))
-        return binop(ND_ANDEQ, node, assignment(), tk->loc);
+        return binop(ND_ANDEQ, node, assignment(), token_locs[tk]);
     if ((tk = consume_keyword("|=")))
-        return binop(ND_IOREQ, node, assignment(), tk->loc);
+        return binop(ND_IOREQ, node, assignment(), token_locs[tk]);
     if ((tk = consume_keyword("^=")))
-        return binop(ND_XOREQ, node, assignment(), tk->loc);
+        return binop(ND_XOREQ, node, assignment(), token_locs[tk]);
     return node;
 }
 
@@ -532,46 +544,46 @@ static Node *conditional() {
 
 static Node *logical_or() {
     Node *node = logical_and();
-    for (Token *tk; (tk = consume_keyword("||"));)
-        node = binop(ND_LOR, node, logical_and(), tk->loc);
+    for (int tk; (tk = consume_keyword("||"));)
+        node = binop(ND_LOR, node, logical_and(), token_locs[tk]);
     return node;
 }
 
 static Node *logical_and() {
     Node *node = inclusive_or();
-    for (Token *tk; (tk = consume_keyword("&&"));)
-        node = binop(ND_LAND, node, inclusive_or(), tk->loc);
+    for (int tk; (tk = consume_keyword("&&"));)
+        node = binop(ND_LAND, node, inclusive_or(), token_locs[tk]);
     return node;
 }
 
 static Node *inclusive_or() {
     Node *node = exclusive_or();
-    for (Token *tk; (tk = consume_keyword("|"));)
-        node = binop(ND_IOR, node, exclusive_or(), tk->loc);
+    for (int tk; (tk = consume_keyword("|"));)
+        node = binop(ND_IOR, node, exclusive_or(), token_locs[tk]);
     return node;
 }
 
 static Node *exclusive_or() {
     Node *node = and_expr();
-    for (Token *tk; (tk = consume_keyword("^"));)
-        node = binop(ND_XOR, node, and_expr(), tk->loc);
+    for (int tk; (tk = consume_keyword("^"));)
+        node = binop(ND_XOR, node, and_expr(), token_locs[tk]);
     return node;
 }
 
 static Node *and_expr() {
     Node *node = equality();
-    for (Token *tk; (tk = consume_keyword("&"));)
-        node = binop(ND_AND, node, equality(), tk->loc);
+    for (int tk; (tk = consume_keyword("&"));)
+        node = binop(ND_AND, node, equality(), token_locs[tk]);
     return node;
 }
 
 static Node *equality() {
     Node *node = relational();
-    for (Token *tk;;) {
+    for (int tk;;) {
         if ((tk = consume_keyword("==")))
-            node = binop(ND_EQ, node, relational(), tk->loc);
+            node = binop(ND_EQ, node, relational(), token_locs[tk]);
         else if ((tk = consume_keyword("!=")))
-            node = binop(ND_NEQ, node, relational(), tk->loc);
+            node = binop(ND_NEQ, node, relational(), token_locs[tk]);
         else break;
     }
     return node;
@@ -579,15 +591,15 @@ static Node *equality() {
 
 static Node *relational() {
     Node *node = shift();
-    for (Token *tk;;) {
+    for (int tk;;) {
         if ((tk = consume_keyword("<")))
-            node = binop(ND_LT, node, shift(), tk->loc);
+            node = binop(ND_LT, node, shift(), token_locs[tk]);
         else if ((tk = consume_keyword("<=")))
-            node = binop(ND_LTE, node, shift(), tk->loc);
+            node = binop(ND_LTE, node, shift(), token_locs[tk]);
         else if ((tk = consume_keyword(">")))
-            node = binop(ND_LT, shift(), node, tk->loc);
+            node = binop(ND_LT, shift(), node, token_locs[tk]);
         else if ((tk = consume_keyword(">=")))
-            node = binop(ND_LTE, shift(), node, tk->loc);
+            node = binop(ND_LTE, shift(), node, token_locs[tk]);
         else break;
     }
     return node;
@@ -595,11 +607,11 @@ static Node *relational() {
 
 static Node *shift() {
     Node *node = add();
-    for (Token *tk;;) {
+    for (int tk;;) {
         if ((tk = consume_keyword("<<")))
-            node = binop(ND_LSH, node, add(), tk->loc);
+            node = binop(ND_LSH, node, add(), token_locs[tk]);
         else if ((tk = consume_keyword(">>")))
-            node = binop(ND_RSH, node, add(), tk->loc);
+            node = binop(ND_RSH, node, add(), token_locs[tk]);
         else break;
     }
     return node;
@@ -607,11 +619,11 @@ static Node *shift() {
 
 static Node *add() {
     Node *node = mul();
-    for (Token *tk;;) {
+    for (int tk;;) {
         if ((tk = consume_keyword("+")))
-            node = binop(ND_ADD, node, mul(), tk->loc);
+            node = binop(ND_ADD, node, mul(), token_locs[tk]);
         else if ((tk = consume_keyword("-")))
-            node = binop(ND_SUB, node, mul(), tk->loc);
+            node = binop(ND_SUB, node, mul(), token_locs[tk]);
         else break;
     }
     return node;
@@ -619,34 +631,34 @@ static Node *add() {
 
 static Node *mul() {
     Node *node = cast();
-    for (Token *tk;;) {
+    for (int tk;;) {
         if ((tk = consume_keyword("*")))
-            node = binop(ND_MUL, node, cast(), tk->loc);
+            node = binop(ND_MUL, node, cast(), token_locs[tk]);
         else if ((tk = consume_keyword("/")))
-            node = binop(ND_DIV, node, cast(), tk->loc);
+            node = binop(ND_DIV, node, cast(), token_locs[tk]);
         else if ((tk = consume_keyword("%")))
-            node = binop(ND_MOD, node, cast(), tk->loc);
+            node = binop(ND_MOD, node, cast(), token_locs[tk]);
         else break;
     }
     return node;
 }
 
 static Node *consume_cast() {
-    int backtrack = index;
-    Token *start = consume_keyword("(");
-    if (start == NULL)
+    int backtrack = pos;
+    int start = consume_keyword("(");
+    if (!start)
         return NULL;
 
     Type *typ = consume_type_identifier();
     if (typ == NULL) {
-        index = backtrack;
+        pos = backtrack;
         return NULL;
     }
     while (consume_keyword("*"))
         typ = ptr_of(typ);
     expect_keyword(")");
 
-    Node *node = mknode(ND_CAST, start->loc);
+    Node *node = mknode(ND_CAST, token_locs[start]);
     node->type = typ;
     node->lhs = cast();
     return node;
@@ -660,7 +672,7 @@ static Node *cast() {
     return unary();
 }
 
-static Node *parse_sizeof(Location *loc) {
+static Node *parse_sizeof(int loc) {
     if (consume_keyword("(")) {
         Node *node = parse_sizeof(loc);
         expect_keyword(")");
@@ -669,7 +681,7 @@ static Node *parse_sizeof(Location *loc) {
     Type *typ = consume_type_spec();
     if (typ != NULL) {
         while (consume_keyword("*")) typ = ptr_of(typ);
-        Node *node = calloc(1, sizeof(Node));
+        Node *node = node_new();
         node->type = typ;
         return binop(ND_SIZEOF, node, NULL, loc);
     }
@@ -677,43 +689,43 @@ static Node *parse_sizeof(Location *loc) {
 }
 
 static Node *unary() {
-    Token *tk;
-    return (tk = consume_keyword("sizeof")) ? parse_sizeof(tk->loc)
-         : (tk = consume_keyword("++"))     ? binop(ND_PREINCR, unary(), NULL, tk->loc)
-         : (tk = consume_keyword("--"))     ? binop(ND_PREDECR, unary(), NULL, tk->loc)
+    int tk;
+    return (tk = consume_keyword("sizeof")) ? parse_sizeof(token_locs[tk])
+         : (tk = consume_keyword("++"))     ? binop(ND_PREINCR, unary(), NULL, token_locs[tk])
+         : (tk = consume_keyword("--"))     ? binop(ND_PREDECR, unary(), NULL, token_locs[tk])
          : consume_keyword("+")             ? unary()
-         : (tk = consume_keyword("-"))      ? binop(ND_SUB, mknum(0, tk->loc), unary(), tk->loc)
-         : (tk = consume_keyword("&"))      ? binop(ND_ADDR, mul(), NULL, tk->loc)
-         : (tk = consume_keyword("*"))      ? binop(ND_DEREF, mul(), NULL, tk->loc)
-         : (tk = consume_keyword("!"))      ? binop(ND_NEG, unary(), NULL, tk->loc)
-         : (tk = consume_keyword("~"))      ? binop(ND_BCOMPL, unary(), NULL, tk->loc)
+         : (tk = consume_keyword("-"))      ? binop(ND_SUB, mknum(0, token_locs[tk]), unary(), token_locs[tk])
+         : (tk = consume_keyword("&"))      ? binop(ND_ADDR, mul(), NULL, token_locs[tk])
+         : (tk = consume_keyword("*"))      ? binop(ND_DEREF, mul(), NULL, token_locs[tk])
+         : (tk = consume_keyword("!"))      ? binop(ND_NEG, unary(), NULL, token_locs[tk])
+         : (tk = consume_keyword("~"))      ? binop(ND_BCOMPL, unary(), NULL, token_locs[tk])
          : postfix();
 }
 
 static Node *postfix() {
     Node *node = primary();
-    for (Token *tk;;) {
+    for (int tk;;) {
         if ((tk = consume_keyword("["))) {
             Node *index_node = expr();
             expect_keyword("]");
-            Node *add_node = binop(ND_ADD, node, index_node, tk->loc);
-            Node *next_node = binop(ND_DEREF, add_node, NULL, tk->loc);
+            Node *add_node = binop(ND_ADD, node, index_node, token_locs[tk]);
+            Node *next_node = binop(ND_DEREF, add_node, NULL, token_locs[tk]);
             node = next_node;
         } else if ((tk = consume_keyword("."))) {
-            Token *attr = value_identifier();
-            Node *attr_node = binop(ND_ATTR, node, NULL, tk->loc);
-            attr_node->attr = attr;
+            int attr = value_identifier();
+            Node *attr_node = binop(ND_ATTR, node, NULL, token_locs[tk]);
+            attr_node->name = token_str(attr);
             node = attr_node;
         } else if ((tk = consume_keyword("->"))) {
-            Token *attr = value_identifier();
-            Node *l = binop(ND_DEREF, node, NULL, tk->loc);
-            Node *next_node = binop(ND_ATTR, l, NULL, tk->loc);
-            next_node->attr = attr;
+            int attr = value_identifier();
+            Node *l = binop(ND_DEREF, node, NULL, token_locs[tk]);
+            Node *next_node = binop(ND_ATTR, l, NULL, token_locs[tk]);
+            next_node->name = token_str(attr);
             node = next_node;
         } else if ((tk = consume_keyword("++")))
-            node = binop(ND_POSTINCR, node, NULL, tk->loc);
+            node = binop(ND_POSTINCR, node, NULL, token_locs[tk]);
         else if ((tk = consume_keyword("--")))
-            node = binop(ND_POSTDECR, node, NULL, tk->loc);
+            node = binop(ND_POSTDECR, node, NULL, token_locs[tk]);
         else
             break;
     }
@@ -721,7 +733,7 @@ static Node *postfix() {
 }
 
 static Node *primary() {
-    Token *tk = NULL;
+    int tk = 0;
     Node *node = NULL;
     if ((tk = consume_keyword("("))) {
         node = expr();
@@ -730,28 +742,28 @@ static Node *primary() {
 
     if ((tk = consume_value_identifier())) {
         if (consume_keyword("(")) { // CALL
-            node = mknode(ND_CALL, tk->loc);
-            node->name = tk->str;
+            node = mknode(ND_CALL, token_locs[tk]);
+            node->name = token_str(tk);
             node->block = args();
         } else { // variable
-            node = mknode(ND_VAR, tk->loc);
-            node->name = tk->str;
+            node = mknode(ND_VAR, token_locs[tk]);
+            node->name = token_str(tk);
         }
     } else if ((tk = consume(TK_NUM))) { // number
-        node = mknum(tk->val, tk->loc);
+        node = mknum(token_vals[tk], token_locs[tk]);
     } else if ((tk = consume(TK_STRING))) {
-        node = mknode(ND_STRING, tk->loc);
+        node = mknode(ND_STRING, token_locs[tk]);
         node->type = type_ptr_char;
-        node->name = tk->str;
+        node->name = token_str(tk);
     } else if ((tk = consume(TK_CHAR))) {
-        node = mknode(ND_CHAR, tk->loc);
-        node->val = tk->val;
+        node = mknode(ND_CHAR, token_locs[tk]);
+        node->val = token_vals[tk];
         node->type = type_char;
     }
 
     if (node == NULL) {
         tk = lookahead_any();
-        error_loc(tk->loc, "invalid expression or statement");
+        error_loc(token_locs[tk], "invalid expression or statement");
     }
     return node;
 }
@@ -770,101 +782,119 @@ static Vec *args() {
 
 // Parse helpers
 
-static Token *lookahead_any() {
-    if (index >= vec_len(tokens))
-        return NULL;
-    return vec_at(tokens, index);
+static int lookahead_any() {
+    return pos <= num_tokens ? pos : 0;
 }
 
-static Token *lookahead(Token_kind kind) {
-    Token *tk = lookahead_any();
-    return (tk != NULL && tk->kind == kind) ? tk : NULL;
+static int lookahead(Token_kind kind) {
+    int tk = lookahead_any();
+    return token_kinds[tk] == kind ? tk : 0;
 }
 
-static Token *lookahead_keyword(char *str) {
-    Token *tk = lookahead(TK_KWD);
-    return (tk != NULL && !strcmp(str, tk->str)) ? tk : NULL;
+static bool is_keyword(int tk, char *str) {
+    int len = token_lens[tk];
+    return token_kinds[tk] == TK_KWD
+        && !strncmp(str, source + token_locs[tk], len) && str[len] == '\0';
 }
 
-static Token *consume(Token_kind kind) {
-    Token *tk = vec_at(tokens, index);
-    if (tk->kind != kind)
-        return NULL;
-    index++;
+static int lookahead_keyword(char *str) {
+    int tk = lookahead_any();
+    return is_keyword(tk, str) ? tk : 0;
+}
+
+static int consume(Token_kind kind) {
+    int tk = lookahead(kind);
+    if (tk)
+        pos++;
     return tk;
 }
 
-static Token *consume_keyword(char *str) {
-    Token *tk = lookahead(TK_KWD);
-    if (tk == NULL || strcmp(str, tk->str))
-        return NULL;
-    index++;
+static int consume_keyword(char *str) {
+    int tk = lookahead_keyword(str);
+    if (tk)
+        pos++;
     return tk;
 }
 
-static Token *consume_value_identifier() {
-    Token *tk = lookahead(TK_IDT);
-    if (tk == NULL)
-        return NULL;
-    Type *typ = env_find(aliases, tk->str);
+static int consume_value_identifier() {
+    int tk = lookahead(TK_IDT);
+    if (!tk)
+        return 0;
+    Type *typ = env_find(aliases, token_str(tk));
     if (typ != NULL)
-        return NULL;
-    index++;
+        return 0;
+    pos++;
     return tk;
 }
 
-static Token *value_identifier() {
-    Token *tk = lookahead(TK_IDT);
-    Type *typ = env_find(aliases, tk->str);
+static int value_identifier() {
+    int tk = lookahead(TK_IDT);
+    if (!tk)
+        error_loc(token_locs[lookahead_any()], "[parse] identifier expected");
+    Type *typ = env_find(aliases, token_str(tk));
     if (typ != NULL)
-        error_loc(tk->loc, "[parse] type");
-    index++;
+        error_loc(token_locs[tk], "[parse] type");
+    pos++;
     return tk;
 }
 
-static Token *expect(Token_kind kind) {
-    Token *tk = lookahead_any();
-    if (tk->kind != kind)
-        error_loc(tk->loc, "%s expected\n", kind);
-    index++;
+static int expect(Token_kind kind) {
+    int tk = lookahead(kind);
+    if (!tk)
+        error_loc(token_locs[lookahead_any()], "%d expected\n", kind);
+    pos++;
     return tk;
 }
 
-static Token *expect_keyword(char* str) {
-    Token *tk = lookahead_any();
-    if (tk->kind != TK_KWD || strcmp(str, tk->str))
-        error_loc(tk->loc, "\"%s\" expected", str);
-    index++;
+static int expect_keyword(char* str) {
+    int tk = lookahead_keyword(str);
+    if (!tk)
+        error_loc(token_locs[lookahead_any()], "\"%s\" expected", str);
+    pos++;
     return tk;
 }
 
 static Type *consume_type_identifier() {
-    Token *id = lookahead(TK_IDT);
-    if (id == NULL)
+    int id = lookahead(TK_IDT);
+    if (!id)
         return NULL;
-    Type *typ = env_find(aliases, id->str);
+    Type *typ = env_find(aliases, token_str(id));
     if (typ != NULL)
-        index++;
+        pos++;
     return typ;
 }
 
 // Node helpers
 
-static Node *mknode(Node_kind kind, Location* loc) {
-    Node *node = calloc(1, sizeof(Node));
+// Nodes are carved out of large zeroed chunks instead of being allocated
+// one by one, so that nodes built together also sit together in memory.
+static Node *node_pool;
+static int node_pool_left = 0;
+
+Node *node_new() {
+    if (node_pool_left == 0) {
+        node_pool_left = 1024;
+        node_pool = calloc(node_pool_left, sizeof(Node));
+    }
+    node_pool_left--;
+    return node_pool++;
+}
+
+static Node *mknode(Node_kind kind, int loc) {
+    Node *node = node_new();
     node->kind = kind;
     node->loc = loc;
     return node;
 }
 
-static Node *binop(Node_kind kind, Node *lhs, Node *rhs, Location *loc) {
+static Node *binop(Node_kind kind, Node *lhs, Node *rhs, int loc) {
     Node *node = mknode(kind, loc);
     node->lhs = lhs;
     node->rhs = rhs;
     return node;
 }
 
-Node *mknum(int v, Location *loc) {
+Node *mknum(int v, int loc) {
     Node *node = mknode(ND_NUM, loc);
     node->type = type_int;
     node->kind = ND_NUM;
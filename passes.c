@@ -0,0 +1,232 @@
+#include "ccatd.h"
+
+// The pass manager.
+//
+// The IR of the functions is optimized by a pipeline of named passes. Each
+// pass of the pipeline runs over every function before the next one starts,
+// so that the inliner copies callees optimized as far as their callers. The
+// pipeline is one of the presets of -O1 and -O2 or a list given with
+// --passes=; -O0 skips the IR altogether for the code generator walking the
+// AST. The presets end by laying out the blocks, which no pass after it
+// reorders.
+//
+// The predecessors, the dominator tree and the liveness of a function are
+// computed on demand by get_preds(), get_idoms() and get_live_in/out(), and
+// kept until a pass may have invalidated them: liveness by any change to the
+// code, and the others by a change to the CFG. A pass declares which of the
+// two it may change in pass_table.
+
+bool time_passes = false;
+bool verify_each = false;
+
+// name, what the pass may change: "cfg", "code" or "none"
+static char *pass_table[20] = {
+    "promote", "code",
+    "tailcall", "cfg",
+    "simplify-cfg", "cfg",
+    "gvn", "code",
+    "licm", "cfg",
+    "strength", "code",
+    "dce", "none", // keeps the liveness up to date itself
+    "inline", "cfg",
+    "layout", "none", // keeps the liveness up to date itself
+    "verify", "none"
+};
+
+static char *o1_pipeline = "promote,simplify-cfg,gvn,dce,simplify-cfg,layout";
+static char *o2_pipeline = "promote,tailcall,simplify-cfg,gvn,licm,strength,dce,simplify-cfg,inline,promote,tailcall,simplify-cfg,gvn,licm,strength,dce,simplify-cfg,layout";
+
+static Vec *pipeline; // the names of the passes
+static Map *bodies;   // the name of each function -> its IR
+
+// timing
+
+typedef struct {
+    char *name;
+    int runs;
+    long ticks;
+} Timer;
+
+static Map *timers;
+
+static void record(char *name, long start) {
+    long ticks = clock() - start;
+    if (timers == NULL)
+        timers = map_new();
+    Timer *t = map_find(timers, name);
+    if (t == NULL) {
+        t = calloc(1, sizeof(Timer));
+        t->name = name;
+        map_put(timers, name, t);
+    }
+    t->runs++;
+    t->ticks += ticks;
+}
+
+// the time of an analysis is also counted in that of the pass asking for it
+void print_pass_times() {
+    if (timers == NULL)
+        return;
+    fprintf(stderr, "%-16s %6s %12s\n", "pass", "runs", "time (us)");
+    Vec *ts = timers->values;
+    for (int i = 0; i < vec_len(ts); i++) {
+        Timer *t = vec_at(ts, i);
+        fprintf(stderr, "%-16s %6d %12d\n", t->name, t->runs, (int)(t->ticks * (1000000 / CLOCKS_PER_SEC)));
+    }
+}
+
+// analyses
+
+Vec **get_preds(IRFunc *ir) {
+    if (ir->preds == NULL) {
+        long start = clock();
+        ir->preds = compute_preds(ir);
+        record("(preds)", start);
+    }
+    return ir->preds;
+}
+
+BB **get_idoms(IRFunc *ir) {
+    if (ir->idoms == NULL) {
+        long start = clock();
+        ir->idoms = compute_idoms(ir);
+        record("(dominators)", start);
+    }
+    return ir->idoms;
+}
+
+static void ensure_liveness(IRFunc *ir) {
+    if (ir->live_in != NULL)
+        return;
+    long start = clock();
+    int len = vec_len(ir->blocks);
+    ir->live_in = calloc(len, sizeof(int *));
+    ir->live_out = calloc(len, sizeof(int *));
+    compute_liveness(ir, ir->live_in, ir->live_out);
+    record("(liveness)", start);
+}
+
+int **get_live_in(IRFunc *ir) {
+    ensure_liveness(ir);
+    return ir->live_in;
+}
+
+int **get_live_out(IRFunc *ir) {
+    ensure_liveness(ir);
+    return ir->live_out;
+}
+
+void invalidate_liveness(IRFunc *ir) {
+    ir->live_in = NULL;
+    ir->live_out = NULL;
+}
+
+void invalidate_analyses(IRFunc *ir) {
+    ir->preds = NULL;
+    ir->idoms = NULL;
+    invalidate_liveness(ir);
+}
+
+// passes
+
+// the index of the pass in pass_table, or -1
+static int find_pass(char *name) {
+    for (int i = 0; i < 20; i += 2)
+        if (!strcmp(pass_table[i], name))
+            return i;
+    return -1;
+}
+
+static void invalidate_after(IRFunc *ir, char *name) {
+    int i = find_pass(name);
+    char *changes = i >= 0 ? pass_table[i + 1] : "code"; // fold-addresses
+    if (!strcmp(changes, "cfg"))
+        invalidate_analyses(ir);
+    else if (!strcmp(changes, "code"))
+        invalidate_liveness(ir);
+}
+
+void run_pass(IRFunc *ir, char *name) {
+    long start = clock();
+    if (!strcmp(name, "promote"))
+        promote_locals(ir);
+    else if (!strcmp(name, "tailcall"))
+        eliminate_tail_calls(ir);
+    else if (!strcmp(name, "simplify-cfg"))
+        simplify_cfg(ir);
+    else if (!strcmp(name, "gvn"))
+        number_values(ir);
+    else if (!strcmp(name, "licm"))
+        hoist_invariants(ir);
+    else if (!strcmp(name, "strength"))
+        reduce_strength(ir);
+    else if (!strcmp(name, "dce"))
+        eliminate_dead_code(ir);
+    else if (!strcmp(name, "layout"))
+        place_blocks(ir);
+    else if (!strcmp(name, "inline"))
+        inline_calls(ir, bodies);
+    else if (!strcmp(name, "fold-addresses"))
+        fold_addresses(ir);
+    else if (!strcmp(name, "verify"))
+        ir_verify(ir);
+    else
+        error("[passes] unknown pass: %s", name);
+    invalidate_after(ir, name);
+    record(name, start);
+
+    if (verify_each && strcmp(name, "verify"))
+        ir_verify(ir);
+}
+
+// sets the pipeline to the comma-separated list of passes
+void set_pipeline(char *passes) {
+    pipeline = vec_new();
+    char *p = passes;
+    while (*p) {
+        int len = strcspn(p, ",");
+        char *name = calloc(len + 1, sizeof(char));
+        strncpy(name, p, len);
+        if (find_pass(name) < 0)
+            error("[passes] unknown pass: %s", name);
+        vec_push(pipeline, name);
+        p = p + len;
+        if (*p == ',')
+            p++;
+    }
+}
+
+void set_opt_level(int level) {
+    set_pipeline(level == 1 ? o1_pipeline : o2_pipeline);
+}
+
+// runs the pipeline over the functions and lowers them for the backend,
+// returning those to be output
+Vec *run_pipeline(Vec *irs) {
+    if (pipeline == NULL)
+        set_opt_level(2);
+    bodies = map_new();
+    for (int i = 0; i < vec_len(irs); i++) {
+        IRFunc *ir = vec_at(irs, i);
+        map_put(bodies, ir->func->name, ir);
+    }
+
+    for (int i = 0; i < vec_len(pipeline); i++) {
+        char *name = vec_at(pipeline, i);
+        for (int j = 0; j < vec_len(irs); j++)
+            run_pass(vec_at(irs, j), name);
+    }
+    for (int j = 0; j < vec_len(irs); j++)
+        ir_verify(vec_at(irs, j));
+
+    // the other passes read the address of an access only from a, so the
+    // addresses are folded once they are done
+    irs = drop_inlined(irs);
+    for (int j = 0; j < vec_len(irs); j++) {
+        IRFunc *ir = vec_at(irs, j);
+        run_pass(ir, "fold-addresses");
+        run_pass(ir, "dce");
+        ir_verify(ir);
+    }
+    return irs;
+}
@@ -0,0 +1,441 @@
+#include "ccatd.h"
+
+// Peephole optimization of the emitted assembly.
+//
+// The code generators print the assembly of a function with emitf(). The
+// lines are parsed into instructions and kept until flush_asm(), which
+// rewrites them with the rules below until none applies and prints them.
+//
+// A rule replaces a window of consecutive instructions matching its pattern.
+// An operand of a pattern is either literal text or a variable `$<class><n>'
+// binding an operand of the class:
+//
+//   R  a 64-bit register    r  a 32-bit register    g  any register
+//   m  a memory operand     i  an immediate         n  an immediate >= 0
+//   s  2, 4 or 8            p  a power of 2 above 1
+//
+// One variable binds the same text wherever it appears, and two variables
+// never bind the same text. A replacement may also use `$32(v)' and `$64(v)'
+// for the other width of a register, and `$log(v)' for the log2 of a power
+// of 2. Instructions of a window are separated by `;'.
+//
+// Rules guarded by FLAGS_DEAD apply only if no instruction reads the flags
+// the window leaves before they are overwritten.
+
+typedef enum {
+    ASM_INST,
+    ASM_LABEL,
+    ASM_DIRECTIVE
+} Asm_kind;
+
+typedef struct {
+    Asm_kind kind;
+    char *text; // ASM_LABEL, ASM_DIRECTIVE
+    char *op;
+    int num_opnds;
+    char **opnds;
+} Asm;
+
+typedef struct {
+    char *name;
+    Vec *from; // Asm
+    Vec *to;   // the templates of the replacement
+    bool needs_dead_flags;
+    int fired;
+} Rule;
+
+// name, pattern, replacement, guard
+static char *rule_table[60] = {
+    "push-pop", "push $R1; pop $R1", "", "",
+    "push-pop-mov", "push $R1; pop $R2", "mov $R2, $R1", "",
+    "push-pop-imm", "push $i1; pop $R1", "mov $R1, $i1", "",
+    "push-pop-load", "push $m1; pop $R1", "mov $R1, $m1", "",
+    "mov-self", "mov $R1, $R1", "", "",
+    "mov-back", "mov $R1, $R2; mov $R2, $R1", "mov $R1, $R2", "",
+    "store-load", "mov $m1, $g1; mov $g1, $m1", "mov $m1, $g1", "",
+    "zero-32", "mov $r1, 0", "xor $r1, $r1", "FLAGS_DEAD",
+    "zero-64", "mov $R1, 0", "xor $32(R1), $32(R1)", "FLAGS_DEAD",
+    "frame-addr", "mov $R1, rbp; sub $R1, $n1", "lea $R1, [rbp-$n1]", "FLAGS_DEAD",
+    "lea-add", "mov $R1, $R2; add $R1, $R3", "lea $R1, [$R2+$R3]", "FLAGS_DEAD",
+    "lea-add-32", "mov $r1, $r2; add $r1, $r3", "lea $r1, [$64(r2)+$64(r3)]", "FLAGS_DEAD",
+    "lea-add-imm", "mov $R1, $R2; add $R1, $n1", "lea $R1, [$R2+$n1]", "FLAGS_DEAD",
+    "lea-scale", "mov $R1, $R2; imul $R1, $s1", "lea $R1, [$R2*$s1]", "FLAGS_DEAD",
+    "mul-pow2", "imul $g1, $p1", "shl $g1, $log(p1)", "FLAGS_DEAD"
+};
+
+static Vec *rules;
+
+bool peephole_stats = false;
+
+static Vec *code;          // the instructions of the current function
+static char emit_buf[4096];
+static char line_buf[4096];
+static int line_len = 0;
+
+// registers without rsp
+static char *regs64[15] = {
+    "rax", "rcx", "rdx", "rbx", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+static char *regs32[15] = {
+    "eax", "ecx", "edx", "ebx", "ebp", "esi", "edi",
+    "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
+};
+static char *regs8[15] = {
+    "al", "cl", "dl", "bl", "bpl", "sil", "dil",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"
+};
+
+// parsing
+
+static char *trim(char *s, int len) {
+    while (len > 0 && *s == ' ') {
+        s++;
+        len--;
+    }
+    while (len > 0 && s[len - 1] == ' ')
+        len--;
+    return mkstr(s, len);
+}
+
+static Asm *parse_asm(char *line) {
+    char *s = trim(line, strlen(line));
+    int len = strlen(s);
+    Asm *a = calloc(1, sizeof(Asm));
+    if (s[0] == '.' && s[len - 1] != ':') {
+        a->kind = ASM_DIRECTIVE;
+        a->text = s;
+        return a;
+    }
+    if (s[len - 1] == ':') {
+        a->kind = ASM_LABEL;
+        a->text = s;
+        return a;
+    }
+
+    a->kind = ASM_INST;
+    int op_len = strcspn(s, " ");
+    a->op = mkstr(s, op_len);
+    a->opnds = calloc(3, sizeof(char *));
+
+    // operands are separated by commas outside brackets
+    char *p = s + op_len;
+    int depth = 0;
+    char *start = p;
+    for (; *p; p++) {
+        if (*p == '[')
+            depth++;
+        else if (*p == ']')
+            depth--;
+        else if (*p == ',' && depth == 0) {
+            a->opnds[a->num_opnds++] = trim(start, p - start);
+            start = p + 1;
+        }
+    }
+    if (p > start)
+        a->opnds[a->num_opnds++] = trim(start, p - start);
+    return a;
+}
+
+void emitf(char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(emit_buf, 4096, fmt, ap);
+
+    if (code == NULL)
+        code = vec_new();
+    for (char *p = emit_buf; *p; p++) {
+        if (*p != '\n') {
+            line_buf[line_len++] = *p;
+            continue;
+        }
+        line_buf[line_len] = '\0';
+        if (line_len > 0)
+            vec_push(code, parse_asm(line_buf));
+        line_len = 0;
+    }
+}
+
+// matching
+
+static char *bound_names[8];
+static char *bound_values[8];
+static int num_bound;
+
+static int reg_index(char **regs, char *s) {
+    for (int i = 0; i < 15; i++)
+        if (!strcmp(regs[i], s))
+            return i;
+    return -1;
+}
+
+static bool is_imm(char *s) {
+    if (*s == '-')
+        s++;
+    if (*s == '\0')
+        return false;
+    for (; *s; s++)
+        if (!isdigit(*s))
+            return false;
+    return true;
+}
+
+static bool in_class(char cls, char *s) {
+    if (cls == 'R')
+        return reg_index(regs64, s) >= 0;
+    if (cls == 'r')
+        return reg_index(regs32, s) >= 0;
+    if (cls == 'g')
+        return reg_index(regs64, s) >= 0 || reg_index(regs32, s) >= 0 || reg_index(regs8, s) >= 0;
+    if (cls == 'm')
+        return strchr(s, '[') != NULL;
+    if (cls == 'i')
+        return is_imm(s);
+    if (cls == 'n')
+        return is_imm(s) && *s != '-';
+    if (cls == 's')
+        return !strcmp(s, "2") || !strcmp(s, "4") || !strcmp(s, "8");
+    if (cls == 'p') {
+        if (!is_imm(s))
+            return false;
+        int v = strtol(s, NULL, 10);
+        return v > 1 && (v & (v - 1)) == 0;
+    }
+    error("[peephole] unknown operand class: %c", cls);
+    return false;
+}
+
+static char *lookup(char *name) {
+    for (int i = 0; i < num_bound; i++)
+        if (!strcmp(bound_names[i], name))
+            return bound_values[i];
+    return NULL;
+}
+
+static bool match_opnd(char *pat, char *s) {
+    if (pat[0] != '$')
+        return !strcmp(pat, s);
+
+    char *name = pat + 1;
+    char *value = lookup(name);
+    if (value != NULL)
+        return !strcmp(value, s);
+    if (!in_class(name[0], s))
+        return false;
+    for (int i = 0; i < num_bound; i++)
+        if (!strcmp(bound_values[i], s))
+            return false;
+    bound_names[num_bound] = name;
+    bound_values[num_bound] = s;
+    num_bound++;
+    return true;
+}
+
+static bool match(Rule *rule, int i) {
+    int len = vec_len(rule->from);
+    if (i + len > vec_len(code))
+        return false;
+    num_bound = 0;
+    for (int j = 0; j < len; j++) {
+        Asm *a = vec_at(code, i + j);
+        Asm *pat = vec_at(rule->from, j);
+        if (a->kind != ASM_INST || strcmp(a->op, pat->op) || a->num_opnds != pat->num_opnds)
+            return false;
+        for (int k = 0; k < pat->num_opnds; k++)
+            if (!match_opnd(pat->opnds[k], a->opnds[k]))
+                return false;
+    }
+    return true;
+}
+
+static bool reads_flags(char *op) {
+    return (op[0] == 'j' && strcmp(op, "jmp"))
+        || !strncmp(op, "set", 3)
+        || !strncmp(op, "cmov", 4)
+        || !strcmp(op, "adc")
+        || !strcmp(op, "sbb");
+}
+
+static bool writes_flags(char *op) {
+    return !strcmp(op, "cmp") || !strcmp(op, "test")
+        || !strcmp(op, "add") || !strcmp(op, "sub")
+        || !strcmp(op, "and") || !strcmp(op, "or") || !strcmp(op, "xor")
+        || !strcmp(op, "imul") || !strcmp(op, "neg");
+}
+
+// whether the flags are overwritten before being read from the i-th
+// instruction on
+static bool flags_dead(int i) {
+    for (; i < vec_len(code); i++) {
+        Asm *a = vec_at(code, i);
+        if (a->kind != ASM_INST)
+            continue;
+        if (reads_flags(a->op) || !strcmp(a->op, "jmp"))
+            return false;
+        // calls and returns don't preserve the flags
+        if (writes_flags(a->op) || !strcmp(a->op, "call") || !strcmp(a->op, "ret"))
+            return true;
+    }
+    return true;
+}
+
+// rewriting
+
+static char *other_width(char *s, char **from, char **to) {
+    int i = reg_index(from, s);
+    if (i < 0)
+        i = reg_index(to, s);
+    if (i < 0)
+        error("[peephole] not a register: %s", s);
+    return to[i];
+}
+
+static char *log2_of(char *s) {
+    int v = strtol(s, NULL, 10);
+    int n = 0;
+    while (v > 1) {
+        v = v / 2;
+        n++;
+    }
+    char *buf = calloc(12, sizeof(char));
+    sprintf(buf, "%d", n);
+    return buf;
+}
+
+static Asm *expand(char *tmpl) {
+    StringBuilder *sb = strbld_new();
+    for (char *p = tmpl; *p;) {
+        if (*p != '$') {
+            strbld_append(sb, *p++);
+            continue;
+        }
+        p++;
+
+        char *fn = NULL;
+        if (!strncmp(p, "32(", 3) || !strncmp(p, "64(", 3)) {
+            fn = mkstr(p, 2);
+            p += 3;
+        } else if (!strncmp(p, "log(", 4)) {
+            fn = "log";
+            p += 4;
+        }
+
+        int len = 1;
+        while (isdigit(p[len]))
+            len++;
+        char *value = lookup(mkstr(p, len));
+        p += len;
+        if (value == NULL)
+            error("[peephole] unbound variable in %s", tmpl);
+
+        if (fn != NULL) {
+            p++; // ')'
+            if (!strcmp(fn, "32"))
+                value = other_width(value, regs64, regs32);
+            else if (!strcmp(fn, "64"))
+                value = other_width(value, regs32, regs64);
+            else
+                value = log2_of(value);
+        }
+        strbld_append_str(sb, value);
+    }
+    return parse_asm(strbld_build(sb));
+}
+
+// applies the rules once over the code and returns whether any fired
+static bool rewrite() {
+    Vec *out = vec_new();
+    bool changed = false;
+    int i = 0;
+    while (i < vec_len(code)) {
+        Rule *rule = NULL;
+        for (int r = 0; r < vec_len(rules); r++) {
+            Rule *cand = vec_at(rules, r);
+            if (!match(cand, i))
+                continue;
+            if (cand->needs_dead_flags && !flags_dead(i + vec_len(cand->from)))
+                continue;
+            rule = cand;
+            break;
+        }
+        if (rule == NULL) {
+            vec_push(out, vec_at(code, i++));
+            continue;
+        }
+
+        for (int j = 0; j < vec_len(rule->to); j++)
+            vec_push(out, expand(vec_at(rule->to, j)));
+        i += vec_len(rule->from);
+        rule->fired++;
+        changed = true;
+    }
+    code = out;
+    return changed;
+}
+
+// splits `a; b' into a and b
+static Vec *split_insts(char *s) {
+    Vec *insts = vec_new();
+    while (*s) {
+        int len = strcspn(s, ";");
+        vec_push(insts, trim(s, len));
+        s += len;
+        if (*s == ';')
+            s++;
+    }
+    return insts;
+}
+
+static void init_rules() {
+    rules = vec_new();
+    for (int i = 0; i < 60; i += 4) {
+        Rule *rule = calloc(1, sizeof(Rule));
+        rule->name = rule_table[i];
+        rule->from = vec_new();
+        Vec *pats = split_insts(rule_table[i + 1]);
+        for (int j = 0; j < vec_len(pats); j++)
+            vec_push(rule->from, parse_asm(vec_at(pats, j)));
+        rule->to = split_insts(rule_table[i + 2]);
+        rule->needs_dead_flags = !strcmp(rule_table[i + 3], "FLAGS_DEAD");
+        vec_push(rules, rule);
+    }
+}
+
+static void optimize() {
+    if (rules == NULL)
+        init_rules();
+    bool changed = true;
+    while (changed)
+        changed = rewrite();
+}
+
+void flush_asm() {
+    if (code == NULL)
+        return;
+    optimize();
+    for (int i = 0; i < vec_len(code); i++) {
+        Asm *a = vec_at(code, i);
+        if (a->kind == ASM_LABEL) {
+            printf("%s\n", a->text);
+            continue;
+        }
+        if (a->kind == ASM_DIRECTIVE) {
+            printf("  %s\n", a->text);
+            continue;
+        }
+        printf("  %s", a->op);
+        for (int j = 0; j < a->num_opnds; j++)
+            printf(j == 0 ? " %s" : ", %s", a->opnds[j]);
+        printf("\n");
+    }
+    code = NULL;
+}
+
+void print_peephole_stats() {
+    if (rules == NULL)
+        init_rules();
+    for (int r = 0; r < vec_len(rules); r++) {
+        Rule *rule = vec_at(rules, r);
+        fprintf(stderr, "%-16s %d\n", rule->name, rule->fired);
+    }
+}
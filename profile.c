@@ -0,0 +1,272 @@
+#include "ccatd.h"
+
+// Profile-guided optimization.
+//
+// With -fprofile-generate, every block and every call in the output counts
+// the times it runs in an 8-byte counter of an array in .bss. A routine run
+// before main() registers another with atexit() to append the counters to the
+// profile file, so that the counts of several runs add up. The lines are:
+//
+//   <function> <line> blocks <number of blocks> <count of calls>
+//   <function> <line> block <id> <count>
+//   <function> <line> call <index> <callee> <count>
+//
+// With -fprofile-use, the counts of the blocks of a function are looked up by
+// its name, and used only if it is still defined on the same line with as
+// many blocks, since they are numbered by the IR the profile was taken from.
+// The blocks are then laid out so that the hot paths fall through, a switch
+// tests its hot cases first, and the functions are output from the hottest.
+// The counts of the calls are there for people to read.
+//
+// Both instrument and look up the IR once the pipeline is done, so the same
+// optimization options must be given to both compilations.
+
+char *profile_generate; // the profile file written when the output runs, or NULL
+
+typedef struct {
+    char *fmt;   // the label of the format of the line
+    int func;    // the index of the function, whose name is .Lprof_name<func>
+    int a;
+    int b;
+    int counter;
+} Record;
+
+typedef struct {
+    int line;
+    int num_bbs; // or -1 if runs of different code were mixed in the profile
+    int *freq;   // the count of each block by its id
+    int calls;
+} FuncProfile;
+
+static Vec *records;
+static Vec *names;     // the functions instrumented
+static Vec *callees;   // the callee of each call, whose format is .Lprof_call<i>
+static int num_counters;
+static int base;       // the counter of block 0 of the current function
+static int func_line;
+static int num_calls;  // in the current function
+static Map *profiles;  // the name of each function -> FuncProfile
+
+// instrumentation
+
+static void add_record(char *fmt, int a, int b, int counter) {
+    Record *r = calloc(1, sizeof(Record));
+    r->fmt = fmt;
+    r->func = vec_len(names) - 1;
+    r->a = a;
+    r->b = b;
+    r->counter = counter;
+    vec_push(records, r);
+}
+
+static void count(int counter) {
+    emitf("  add QWORD PTR .Lprof_counters+%d[rip], 1\n", 8 * counter);
+}
+
+// allocates the counters of the blocks of the function about to be output
+void profile_func(IRFunc *ir) {
+    if (records == NULL) {
+        records = vec_new();
+        names = vec_new();
+        callees = vec_new();
+    }
+    base = num_counters;
+    num_counters += ir->num_bbs;
+    func_line = location_of(ir->func->loc)->line;
+    num_calls = 0;
+    vec_push(names, ir->func->name);
+
+    BB *entry = vec_at(ir->blocks, 0);
+    add_record(".Lprof_blocks", func_line, ir->num_bbs, base + entry->id);
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        add_record(".Lprof_block", func_line, bb->id, base + bb->id);
+    }
+}
+
+void profile_block(BB *bb) {
+    count(base + bb->id);
+}
+
+void profile_call(Inst *call) {
+    char *fmt = calloc(30, sizeof(char));
+    sprintf(fmt, ".Lprof_call%d", vec_len(callees));
+    vec_push(callees, call->name);
+    add_record(fmt, func_line, num_calls++, num_counters);
+    count(num_counters++);
+}
+
+// outputs the counters, the records describing them and the routines
+// appending them to the profile file at exit
+void gen_profile_runtime() {
+    if (num_counters == 0)
+        return;
+
+    printf("  .section .rodata\n");
+    printf(".Lprof_path:\n  .string \"%s\"\n", escape_string(profile_generate));
+    printf(".Lprof_mode:\n  .string \"a\"\n");
+    printf(".Lprof_blocks:\n  .string \"%%s %%d blocks %%d %%ld\\n\"\n");
+    printf(".Lprof_block:\n  .string \"%%s %%d block %%d %%ld\\n\"\n");
+    for (int i = 0; i < vec_len(callees); i++) {
+        char *callee = vec_at(callees, i);
+        printf(".Lprof_call%d:\n  .string \"%%s %%d call %%d %s %%ld\\n\"\n", i, callee);
+    }
+    for (int i = 0; i < vec_len(names); i++) {
+        char *name = vec_at(names, i);
+        printf(".Lprof_name%d:\n  .string \"%s\"\n", i, name);
+    }
+
+    // fprintf(fp, fmt, name, a, b, *counter) for each record
+    printf("  .data\n  .align 8\n.Lprof_records:\n");
+    for (int i = 0; i < vec_len(records); i++) {
+        Record *r = vec_at(records, i);
+        printf("  .quad %s\n  .quad .Lprof_name%d\n", r->fmt, r->func);
+        printf("  .long %d\n  .long %d\n", r->a, r->b);
+        printf("  .quad .Lprof_counters+%d\n", 8 * r->counter);
+    }
+    printf(".Lprof_records_end:\n");
+
+    printf("  .bss\n  .align 8\n.Lprof_counters:\n  .zero %d\n", 8 * num_counters);
+    printf("  .section .init_array,\"aw\"\n  .align 8\n  .quad .Lprof_init\n");
+
+    printf("  .text\n"
+           ".Lprof_init:\n"
+           "  lea rdi, .Lprof_dump[rip]\n"
+           "  jmp atexit\n");
+    printf(".Lprof_dump:\n"
+           "  push rbx\n"
+           "  push r12\n"
+           "  push r13\n"
+           "  lea rdi, .Lprof_path[rip]\n"
+           "  lea rsi, .Lprof_mode[rip]\n"
+           "  call fopen\n"
+           "  test rax, rax\n"
+           "  je .Lprof_done\n"
+           "  mov r12, rax\n"
+           "  lea rbx, .Lprof_records[rip]\n"
+           "  lea r13, .Lprof_records_end[rip]\n");
+    printf(".Lprof_loop:\n"
+           "  cmp rbx, r13\n"
+           "  je .Lprof_close\n"
+           "  mov rdi, r12\n"
+           "  mov rsi, [rbx]\n"
+           "  mov rdx, [rbx+8]\n"
+           "  mov ecx, [rbx+16]\n"
+           "  mov r8d, [rbx+20]\n"
+           "  mov r9, [rbx+24]\n"
+           "  mov r9, [r9]\n"
+           "  mov eax, 0\n"
+           "  call fprintf\n"
+           "  add rbx, 32\n"
+           "  jmp .Lprof_loop\n");
+    printf(".Lprof_close:\n"
+           "  mov rdi, r12\n"
+           "  call fclose\n"
+           ".Lprof_done:\n"
+           "  pop r13\n"
+           "  pop r12\n"
+           "  pop rbx\n"
+           "  ret\n");
+}
+
+// reading
+
+static char *cur; // the text of the profile being read
+
+// the next word of the line, or NULL at its end
+static char *next_word() {
+    while (*cur == ' ')
+        cur++;
+    if (*cur == '\0' || *cur == '\n')
+        return NULL;
+    int len = strcspn(cur, " \n");
+    char *w = mkstr(cur, len);
+    cur = cur + len;
+    return w;
+}
+
+static void read_line() {
+    char *name = next_word();
+    char *line = next_word();
+    char *kind = next_word();
+    char *a = next_word();
+    char *b = next_word();
+    char *c = next_word();
+    while (*cur != '\0' && *cur != '\n')
+        cur++;
+    if (*cur == '\n')
+        cur++;
+    if (name == NULL)
+        return;
+    if (b == NULL)
+        error("[profile] invalid line for %s", name);
+
+    FuncProfile *p = map_find(profiles, name);
+    int l = strtol(line, NULL, 10);
+    if (!strcmp(kind, "blocks")) {
+        int n = strtol(a, NULL, 10);
+        if (p == NULL) {
+            p = calloc(1, sizeof(FuncProfile));
+            p->line = l;
+            p->num_bbs = n;
+            p->freq = calloc(n + 1, sizeof(int));
+            map_put(profiles, name, p);
+        } else if (p->line != l || p->num_bbs != n) {
+            p->num_bbs = -1;
+        }
+        p->calls += strtol(b, NULL, 10);
+    } else if (!strcmp(kind, "block")) {
+        int id = strtol(a, NULL, 10);
+        if (p != NULL && p->line == l && 0 <= id && id < p->num_bbs)
+            p->freq[id] += strtol(b, NULL, 10);
+    } else if (strcmp(kind, "call") || c == NULL) {
+        error("[profile] invalid line for %s", name);
+    }
+}
+
+void load_profile(char *text) {
+    profiles = map_new();
+    cur = text;
+    while (*cur != '\0')
+        read_line();
+}
+
+// the profile of the function if it matches its IR, or NULL
+static FuncProfile *profile_of(IRFunc *ir) {
+    FuncProfile *p = map_find(profiles, ir->func->name);
+    if (p == NULL || p->line != location_of(ir->func->loc)->line || p->num_bbs != ir->num_bbs)
+        return NULL;
+    return p;
+}
+
+// lays out the blocks of the functions profiled and returns the functions
+// from the hottest, the others last in their order
+Vec *apply_profile(Vec *irs) {
+    Vec *sorted = vec_new();
+    Vec *cold = vec_new();
+    for (int i = 0; i < vec_len(irs); i++) {
+        IRFunc *ir = vec_at(irs, i);
+        FuncProfile *p = profile_of(ir);
+        if (p == NULL) {
+            vec_push(cold, ir);
+            continue;
+        }
+        ir->freq = p->freq;
+        lay_out_blocks(ir, p->freq);
+
+        // insertion sort, keeping the order of those run as often
+        vec_push(sorted, ir);
+        int j = vec_len(sorted) - 1;
+        while (j > 0) {
+            IRFunc *prev = vec_at(sorted, j - 1);
+            if (profile_of(prev)->calls >= p->calls)
+                break;
+            vec_set(sorted, j, prev);
+            j--;
+        }
+        vec_set(sorted, j, ir);
+    }
+    for (int i = 0; i < vec_len(cold); i++)
+        vec_push(sorted, vec_at(cold, i));
+    return sorted;
+}
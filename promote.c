@@ -0,0 +1,106 @@
+#include "ccatd.h"
+
+// Promotion of scalar locals to virtual registers.
+//
+// A local variable or parameter whose address is never taken is only read
+// and written through the address of its own slot, so its loads and stores
+// can be replaced with moves from and to a virtual register of its own. Since
+// a virtual register may be assigned in several blocks, this needs no phi
+// functions: the register allocator keeps the variable in a register where
+// it is live, and the slot is touched only if the register spills.
+//
+// A variable is promoted only if none of its loads is wider than its stores,
+// so that every load reads bytes the last store wrote.
+
+static IRFunc *ir;
+static Inst **defs;
+
+// the offset of the local variable addr points to, or 0 if it's not one
+static int local_offset(int addr) {
+    Inst *def = defs[addr];
+    if (def == NULL || def->kind != IR_LADDR)
+        return 0;
+    return def->imm;
+}
+
+// returns the register replacing the variable at each offset, or 0
+static int *choose_vars() {
+    int frame = ir->frame;
+    bool *escaped = escaped_locals(ir, defs);
+    int *max_load = calloc(frame + 1, sizeof(int));
+    int *min_store = calloc(frame + 1, sizeof(int));
+    int *width = calloc(frame + 1, sizeof(int));
+
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            if (inst->kind != IR_LOAD && inst->kind != IR_STORE)
+                continue;
+            int k = local_offset(inst->a);
+            if (k == 0)
+                continue;
+            if (inst->size > width[k])
+                width[k] = inst->size;
+            if (inst->kind == IR_LOAD && inst->size > max_load[k])
+                max_load[k] = inst->size;
+            if (inst->kind == IR_STORE && (min_store[k] == 0 || inst->size < min_store[k]))
+                min_store[k] = inst->size;
+        }
+    }
+
+    int *vars = calloc(frame + 1, sizeof(int));
+    for (int k = 1; k <= frame; k++) {
+        // a variable never stored to is left alone, being read uninitialized
+        if (min_store[k] == 0 || escaped[k] || max_load[k] > min_store[k])
+            continue;
+
+        // accesses at other offsets overlapping this one would see the slot
+        bool overlaps = false;
+        for (int l = 1; l <= frame && !overlaps; l++)
+            if (l != k && width[l] != 0 && -k < -l + width[l] && -l < -k + width[k])
+                overlaps = true;
+        if (!overlaps)
+            vars[k] = ++ir->num_vregs;
+    }
+    return vars;
+}
+
+void promote_locals(IRFunc *irf) {
+    ir = irf;
+    // the register save area of va_start is written outside the IR
+    if (ir->func->is_varargs)
+        return;
+    defs = single_defs(ir);
+    int *vars = choose_vars();
+
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            if (inst->kind != IR_LOAD && inst->kind != IR_STORE)
+                continue;
+            int var = vars[local_offset(inst->a)];
+            if (var == 0)
+                continue;
+
+            if (inst->kind == IR_STORE) {
+                inst->kind = IR_MOV;
+                inst->dst = var;
+                inst->a = inst->b;
+                inst->b = 0;
+                if (inst->size == 1)
+                    inst->size = 4;
+            } else if (inst->size == 1) {
+                // a byte load sign-extends what it reads
+                inst->kind = IR_SEXT;
+                inst->size = 4;
+                inst->a = var;
+                inst->imm = 1;
+            } else {
+                inst->kind = IR_MOV;
+                inst->a = var;
+            }
+        }
+    }
+}
@@ -0,0 +1,201 @@
+#include "ccatd.h"
+
+// Linear-scan register allocation.
+//
+// The instructions are numbered in the output order of the blocks, and every
+// virtual register gets one live interval covering its definitions, its uses
+// and the blocks it is live across. The intervals are visited by their start
+// and handed a free register; those crossing a call only take callee-saved
+// ones. When no register is left, whichever of the current interval and the
+// active ones ends last is spilled to a stack slot for its whole lifetime.
+//
+// rax, rcx and rdx are left out as the scratch registers of the backend.
+
+static Reg caller_saved[6] = {RSI, RDI, R8, R9, R10, R11};
+static Reg callee_saved[5] = {RBX, R12, R13, R14, R15};
+
+static IRFunc *ir;
+static int *starts;         // the first position of each interval, or -1
+static int *ends;           // the last position of each interval
+static int *calls_before;   // the number of calls at positions before each one
+static bool *live_at_start; // whether each interval starts live into a block
+
+// intervals
+
+static void extend(int v, int pos) {
+    if (starts[v] < 0 || pos < starts[v])
+        starts[v] = pos;
+    if (pos > ends[v])
+        ends[v] = pos;
+}
+
+// returns the number of positions
+static int build_intervals() {
+    Vec *blocks = ir->blocks;
+    int len = vec_len(blocks);
+    int **live_in = get_live_in(ir);
+    int **live_out = get_live_out(ir);
+
+    int num_insts = 0;
+    for (int i = 0; i < len; i++) {
+        BB *bb = vec_at(blocks, i);
+        num_insts += vec_len(bb->insts);
+    }
+
+    starts = calloc(ir->num_vregs + 1, sizeof(int));
+    ends = calloc(ir->num_vregs + 1, sizeof(int));
+    calls_before = calloc(num_insts + 1, sizeof(int));
+    live_at_start = calloc(ir->num_vregs + 1, sizeof(bool));
+    for (int v = 0; v <= ir->num_vregs; v++)
+        starts[v] = ends[v] = -1;
+
+    int pos = 0;
+    int calls = 0;
+    int uses[6];
+    for (int i = 0; i < len; i++) {
+        BB *bb = vec_at(blocks, i);
+        for (int v = 1; v <= ir->num_vregs; v++)
+            if (vset_has(live_in[i], v)) {
+                if (starts[v] < 0)
+                    live_at_start[v] = true;
+                extend(v, pos);
+            }
+
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            calls_before[pos] = calls;
+            int n = inst_uses(inst, uses);
+            for (int k = 0; k < n; k++)
+                extend(uses[k], pos);
+            if (has_dst(inst))
+                extend(inst->dst, pos);
+            if (inst->kind == IR_CALL)
+                calls++;
+            pos++;
+        }
+
+        for (int v = 1; v <= ir->num_vregs; v++)
+            if (vset_has(live_out[i], v))
+                extend(v, pos - 1);
+    }
+    calls_before[pos] = calls;
+
+    // the leading params are moved from the argument registers at once, so
+    // even one never read must not share a register with the others
+    BB *entry = vec_at(blocks, 0);
+    int num_params = 0;
+    while (num_params < vec_len(entry->insts) && ((Inst *)vec_at(entry->insts, num_params))->kind == IR_PARAM)
+        num_params++;
+    for (int j = 0; j < num_params; j++) {
+        Inst *param = vec_at(entry->insts, j);
+        extend(param->dst, 0);
+        extend(param->dst, num_params - 1);
+    }
+    return pos;
+}
+
+// whether a call is made while v is live; the arguments and the result of the
+// call itself don't count, but a call first in a block v is live into does
+static bool crosses_call(int v) {
+    int from = live_at_start[v] ? starts[v] : starts[v] + 1;
+    return calls_before[ends[v]] - calls_before[from] > 0;
+}
+
+// allocation
+
+static bool is_callee_saved(Reg r) {
+    for (int i = 0; i < 5; i++)
+        if (callee_saved[i] == r)
+            return true;
+    return false;
+}
+
+static void spill(int v) {
+    ir->regs[v] = -1;
+    ir->slots[v] = ir->num_slots++;
+}
+
+// returns a register none of the active intervals holds, or -1
+static int free_reg(int *active, int num_active, bool across_call) {
+    bool taken[16];
+    for (int i = 0; i < 16; i++)
+        taken[i] = false;
+    for (int i = 0; i < num_active; i++)
+        taken[ir->regs[active[i]]] = true;
+
+    if (!across_call)
+        for (int i = 0; i < 6; i++)
+            if (!taken[caller_saved[i]])
+                return caller_saved[i];
+    for (int i = 0; i < 5; i++)
+        if (!taken[callee_saved[i]])
+            return callee_saved[i];
+    return -1;
+}
+
+void reg_alloc(IRFunc *irf) {
+    ir = irf;
+    int num_vregs = ir->num_vregs;
+    int num_pos = build_intervals();
+
+    ir->regs = calloc(num_vregs + 1, sizeof(int));
+    ir->slots = calloc(num_vregs + 1, sizeof(int));
+    ir->num_slots = 0;
+    for (int v = 0; v <= num_vregs; v++)
+        ir->regs[v] = -1;
+
+    // sort the intervals by their start
+    int *count = calloc(num_pos + 1, sizeof(int));
+    for (int v = 1; v <= num_vregs; v++)
+        if (starts[v] >= 0)
+            count[starts[v] + 1]++;
+    for (int p = 0; p < num_pos; p++)
+        count[p + 1] += count[p];
+    int *order = calloc(num_vregs + 1, sizeof(int));
+    int num_intervals = 0;
+    for (int v = 1; v <= num_vregs; v++) {
+        if (starts[v] < 0)
+            continue;
+        order[count[starts[v]]++] = v;
+        num_intervals++;
+    }
+
+    int active[11];
+    int num_active = 0;
+    for (int i = 0; i < num_intervals; i++) {
+        int v = order[i];
+
+        // expire the intervals ended before this one, so that no register is
+        // both read and written by one instruction
+        int kept = 0;
+        for (int j = 0; j < num_active; j++)
+            if (ends[active[j]] >= starts[v])
+                active[kept++] = active[j];
+        num_active = kept;
+
+        bool across_call = crosses_call(v);
+        int r = free_reg(active, num_active, across_call);
+        if (r >= 0) {
+            ir->regs[v] = r;
+            active[num_active++] = v;
+            continue;
+        }
+
+        int victim = -1;
+        for (int j = 0; j < num_active; j++) {
+            int w = active[j];
+            if (across_call && !is_callee_saved(ir->regs[w]))
+                continue;
+            if (victim < 0 || ends[w] > ends[active[victim]])
+                victim = j;
+        }
+        if (victim < 0 || ends[active[victim]] <= ends[v]) {
+            spill(v);
+            continue;
+        }
+        int w = active[victim];
+        ir->regs[v] = ir->regs[w];
+        spill(w);
+        active[victim] = v;
+    }
+}
@@ -42,6 +42,7 @@ int isalpha(int c);
 int isdigit(int c);
 int fprintf(FILE *stream, char *fmt, ...);
 int vfprintf(FILE *stream, char *fmt, va_list ap);
+int vsnprintf(char *str, long size, char *fmt, va_list ap);
 int printf(char *fmt, ...);
 int sprintf(char *str, char *fmt, ...);
 
@@ -49,9 +50,19 @@ int strcmp(char *s1, char *s2);
 char *strerror(int errnum);
 
 long strlen(char *p);
+long strcspn(char *s, char *reject);
+char *strchr(char *s, int c);
+char *strstr(char *haystack, char *needle);
+
+long sysconf(int name);
+int fork();
+int waitpid(int pid, int *wstatus, int options);
+void *mmap(void *addr, long length, int prot, int flags, int fd, int offset);
+int munmap(void *addr, long length);
 int strncmp(char *p, char *q, int len);
 int strncpy(char *p, char *str, int len);
 int strtol(char *nptr, char **endptr, int base);
+long clock();
 EOF
 
   grep -v '^#' ccatd.h >> ${temp_c}
@@ -61,22 +72,44 @@ EOF
   sed -i 's/\berrno\b/__errno_location()/g' ${temp_c}
   sed -i 's/\bSEEK_SET\b/0/g' ${temp_c}
   sed -i 's/\bSEEK_END\b/2/g' ${temp_c}
+  sed -i 's/\b_SC_NPROCESSORS_ONLN\b/84/g' ${temp_c}
+  sed -i 's/\bPROT_READ\b/1/g; s/\bPROT_WRITE\b/2/g' ${temp_c}
+  sed -i 's/\bMAP_SHARED\b/1/g; s/\bMAP_ANONYMOUS\b/32/g' ${temp_c}
+  sed -i 's/\bMAP_FAILED\b/((void*)-1)/g' ${temp_c}
+  sed -i 's/\bCLOCKS_PER_SEC\b/1000000/g' ${temp_c}
 
   temp_s="_build/${1%.c}.s"
-  ./ccatd ${temp_c} > ${temp_s}
+  ./ccatd ${FLAGS} ${temp_c} > ${temp_s}
   gcc -I. -g -c -o _build/${1%.c}.o ${temp_s}
 }
 
 make build
 
+process 'address.c'
 process 'codegen.c'
 process 'containers.c'
+process 'dce.c'
+process 'gvn.c'
+process 'inline.c'
+process 'ir.c'
+process 'irgen.c'
+process 'layout.c'
+process 'licm.c'
 process 'main.c'
 process 'parse.c'
+process 'passes.c'
+process 'peephole.c'
+process 'profile.c'
+process 'promote.c'
+process 'regalloc.c'
 process 'semantic.c'
+process 'strength.c'
+process 'switch.c'
+process 'tailcall.c'
 process 'tokenize.c'
 process 'type.c'
 process 'util.c'
+process 'x86.c'
 
 gcc -static -g -o ccatd-ccatd _build/*.o
 
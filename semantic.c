@@ -2,7 +2,7 @@
 
 Map *func_env;
 Map *global_env;
-Environment *local_vars;
+Scope *local_vars;
 int jump_id = 0;
 Vec *break_labels;
 Vec *continue_labels;
@@ -22,14 +22,18 @@ void sema_func(Func *func);
 void sema_block(Vec* v, Func* f);
 void sema_stmt(Node* n, Func* f);
 void sema_expr(Node* n, Func* f);
+void sema_expr_type(Node* n, Func* f);
 void sema_lval(Node* n, Func* f);
 void sema_array(Type* t, Node* n, Func* f);
-void sema_type(Type* f);
+void sema_type(Type* t, Func* f);
+void sema_enum(Type* t, Func* f);
 
 // Helpers
 
 bool assignable(Type *lhs, Type *rhs);
 bool eq_type(Type *lhs, Type *rhs);
+int sema_const_int(Node *n, Func *f);
+void fold_expr(Node *n);
 char *gen_loop_label(char *prefix);
 
 // Global
@@ -56,6 +60,12 @@ void sema_globals() {
             continue;
         if (g->kind != ND_GVAR)
             error_loc(g->loc, "[semantic] a global variable expected");
+        if (g->is_enum) {
+            // enumerators are registered all at once with their first one
+            if (g == vec_at(g->type->enums, 0))
+                sema_enum(g->type, NULL);
+            continue;
+        }
 
         if (g->rhs != NULL) {
             sema_const(g);
@@ -77,7 +87,7 @@ void sema_const(Node *global) {
 void sema_const_aux(Node *node) {
     switch (node->kind) {
     case ND_NUM:
-        if (!eq_type(type_int, node->type))
+        if (!is_integer(node->type))
             error("[semantic] type mismatch in a global variable definition");
         return;
     case ND_STRING:
@@ -97,7 +107,7 @@ void sema_const_aux(Node *node) {
         Node *resolved = map_find(global_env, node->name);
         if (resolved == NULL)
             error_loc(node->loc, "[semantic] undefined variable");
-        node->kind = resolved->kind;
+        node->kind = resolved->is_enum ? ND_NUM : resolved->kind;
         node->type = resolved->type;
         node->val = resolved->val;
         return;
@@ -169,26 +179,31 @@ void sema_const_array(Type *type, Node *node) {
 
 // Functions, statements and expressions
 
-void sema_type(Type* typ) {
-    if (typ->ty == TY_ENUM) {
-        if (typ->enum_decl) {
-            int len = vec_len(typ->enums);
-            for (int i = 0; i < len; i++) {
-                Token *e = vec_at(typ->enums, i);
-                if (map_find(local_vars->map, e->str) != NULL)
-                    error_loc(e->loc, "[semantic] duplicate identifier");
-
-                Node *lvar = calloc(1, sizeof(Node));
-                lvar->kind = ND_VAR;
-                lvar->type = typ;
-                lvar->name = e->str;
-                lvar->is_enum = true;
-                env_push(local_vars, e->str, lvar);
-            }
-        }
-    }
+void sema_type(Type* typ, Func *func) {
+    if (typ->ty == TY_ENUM && typ->enum_decl)
+        sema_enum(typ, func);
     if (typ->ty == TY_PTR)
-        sema_type(typ->ptr_to);
+        sema_type(typ->ptr_to, func);
+}
+
+// assigns values to enumerators and registers them to the current scope;
+// `func' is NULL for global enums
+void sema_enum(Type *typ, Func *func) {
+    int next = 0;
+    int len = vec_len(typ->enums);
+    for (int i = 0; i < len; i++) {
+        Node *e = vec_at(typ->enums, i);
+        if (func != NULL && scope_find_local(local_vars, e->name) != NULL)
+            error_loc(e->loc, "[semantic] duplicate identifier");
+
+        e->val = e->rhs == NULL ? next : sema_const_int(e->rhs, func);
+        next = e->val + 1;
+
+        if (func == NULL)
+            map_put(global_env, e->name, e);
+        else
+            scope_push(local_vars, e->name, e);
+    }
 }
 
 bool type_sig_match(Type *l, Type *r) {
@@ -245,13 +260,13 @@ void sema_func(Func *func) {
     int stack_offset = func->is_varargs ? 56 : 0;
 
     // block
-    local_vars = env_new(NULL);
+    local_vars = scope_new();
     break_labels = vec_new();
     continue_labels = vec_new();
     for (int i = 0; i < params_len; i++) {
         Node* param = vec_at(func->params, i);
         param->val = stack_offset + 8 * (i + 1);
-        env_push(local_vars, param->name, param);
+        scope_push(local_vars, param->name, param);
     }
     max_scoped_stack_space = scoped_stack_space = stack_offset + 8 * params_len;
 
@@ -260,7 +275,7 @@ void sema_func(Func *func) {
 }
 
 void sema_block(Vec *block, Func *func) {
-    local_vars = env_new(local_vars);
+    scope_enter(local_vars);
     int revert_scoped_stack_space = scoped_stack_space;
 
     int block_len = vec_len(block);
@@ -268,12 +283,12 @@ void sema_block(Vec *block, Func *func) {
         sema_stmt(vec_at(block, i), func);
     }
 
-    local_vars = env_next(local_vars);
+    scope_leave(local_vars);
     scoped_stack_space = revert_scoped_stack_space;
 }
 
 void sema_case(Node *node) {
-    if (node->kind == ND_NUM || node->is_enum)
+    if (node->kind == ND_NUM)
         return;
     error_loc(node->loc, "[semantic] cannot be deduced to an integer");
 }
@@ -284,7 +299,7 @@ void sema_switch(Node *node, Func *func) {
 
     vec_push(break_labels, label);
     sema_expr(node->cond, func);
-    local_vars = env_new(local_vars);
+    scope_enter(local_vars);
     for (int i = 0; i < len; i++) {
         Node *stmt = vec_at(node->block, i);
         if (stmt->kind == ND_CASE) {
@@ -296,19 +311,19 @@ void sema_switch(Node *node, Func *func) {
         } else
             sema_stmt(stmt, func);
     }
-    local_vars = env_next(local_vars);
+    scope_leave(local_vars);
     vec_pop(break_labels);
 }
 
 void sema_stmt(Node *node, Func *func) {
     if (node->kind == ND_VARDECL) {
-        Node *lvar = map_find(local_vars->map, node->lhs->name);
+        Node *lvar = scope_find_local(local_vars, node->lhs->name);
         if (lvar != NULL)
             error_loc(node->loc, "[semantic] duplicate variable declaration");
 
         if (node->lhs->type == type_void)
             error_loc(node->loc, "[semantic] declaring a variable of void type is not fllowed");
-        sema_type(node->lhs->type);
+        sema_type(node->lhs->type, func);
 
         if (node->rhs != NULL) {
             if (node->lhs->type->ty == TY_ARRAY) {
@@ -326,7 +341,7 @@ void sema_stmt(Node *node, Func *func) {
         }
         scoped_stack_space += type_size(node->lhs->type);
         node->lhs->val = scoped_stack_space;
-        env_push(local_vars, node->lhs->name, node->lhs);
+        scope_push(local_vars, node->lhs->name, node->lhs);
         max_scoped_stack_space = scoped_stack_space > max_scoped_stack_space
             ? scoped_stack_space
             : max_scoped_stack_space;
@@ -418,7 +433,7 @@ Type *sema_expr_arith(Node *node, Func *func) {
     sema_expr(node->rhs, func);
     Type* lty = node->lhs->type;
     Type* rty = node->rhs->type;
-    Location *loc = node->loc;
+    int loc = node->loc;
 
     Type *ret;
     switch (node->kind) {
@@ -480,7 +495,7 @@ Type *sema_expr_assign(Node *node, Func *func) {
     sema_expr(node->rhs, func);
     Type* lty = node->lhs->type;
     Type* rty = node->rhs->type;
-    Location *loc = node->loc;
+    int loc = node->loc;
 
     switch (node->kind) {
     case ND_ADDEQ:
@@ -502,25 +517,25 @@ Type *sema_expr_assign(Node *node, Func *func) {
 }
 
 void sema_expr(Node* node, Func *func) {
+    sema_expr_type(node, func);
+    fold_expr(node);
+}
+
+void sema_expr_type(Node* node, Func *func) {
     switch (node->kind) {
     case ND_NUM: case ND_STRING: case ND_CHAR:
         return;
     case ND_VAR: {
-        Node *resolved_local = env_find(local_vars, node->name);
-        if (resolved_local != NULL) {
-            node->kind = resolved_local->kind;
-            node->type = resolved_local->type;
-            node->val = resolved_local->val;
-            return;
-        }
-
-        Node *resolved_global = map_find(func->global_vars, node->name);
-        if (resolved_global == NULL)
+        Node *resolved = scope_find(local_vars, node->name);
+        if (resolved == NULL)
+            resolved = map_find(func->global_vars, node->name);
+        if (resolved == NULL)
             error_loc(node->loc, "[semantic] undefined variable");
-        node->kind = resolved_global->kind;
-        node->type = resolved_global->type;
-        node->val = resolved_global->val;
-        node->is_enum = resolved_global->is_enum;
+
+        // an enumerator is folded into its value
+        node->kind = resolved->is_enum ? ND_NUM : resolved->kind;
+        node->type = resolved->type;
+        node->val = resolved->val;
         return;
     }
     case ND_SEQ:
@@ -553,7 +568,7 @@ void sema_expr(Node* node, Func *func) {
         return;
     case ND_NEG:
         sema_expr(node->lhs, func);
-        node->type = node->lhs->type;
+        node->type = type_int;
         return;
     case ND_BCOMPL:
         sema_expr(node->lhs, func);
@@ -600,7 +615,7 @@ void sema_expr(Node* node, Func *func) {
         int offset = 0;
         for (int i = 0; i < len; i++) {
             Node *field = vec_at(strc->fields, i);
-            if (!strcmp(field->name, node->attr->str)) {
+            if (!strcmp(field->name, node->name)) {
                 node->type = field->type;
                 node->val = offset;
                 return;
@@ -675,6 +690,255 @@ bool assignable(Type *lhs, Type *rhs) {
     return false;
 }
 
+// evaluates an integer constant expression (e.g. an enumerator value)
+int sema_const_int(Node *node, Func *func) {
+    switch (node->kind) {
+    case ND_NUM: case ND_CHAR:
+        return node->val;
+    case ND_VAR: {
+        Node *resolved = func == NULL
+            ? map_find(global_env, node->name)
+            : scope_find(local_vars, node->name);
+        if (resolved == NULL && func != NULL)
+            resolved = map_find(func->global_vars, node->name);
+        if (resolved == NULL || !resolved->is_enum)
+            error_loc(node->loc, "[semantic] an integer constant expected");
+        return resolved->val;
+    }
+    case ND_SIZEOF:
+        if (node->lhs->type == NULL)
+            error_loc(node->loc, "[semantic] an integer constant expected");
+        return type_size(node->lhs->type);
+    case ND_NEG:
+        return !sema_const_int(node->lhs, func);
+    case ND_BCOMPL:
+        return ~sema_const_int(node->lhs, func);
+    case ND_COND:
+        return sema_const_int(node->cond, func)
+            ? sema_const_int(node->lhs, func)
+            : sema_const_int(node->rhs, func);
+    default:
+        break;
+    }
+
+    if (!(ND_ADD <= node->kind && node->kind <= ND_LOR))
+        error_loc(node->loc, "[semantic] an integer constant expected");
+
+    int l = sema_const_int(node->lhs, func);
+    int r = sema_const_int(node->rhs, func);
+    switch (node->kind) {
+    case ND_ADD: return l + r;
+    case ND_SUB: return l - r;
+    case ND_MUL: return l * r;
+    case ND_DIV: case ND_MOD:
+        if (r == 0)
+            error_loc(node->loc, "[semantic] division by zero");
+        return node->kind == ND_DIV ? l / r : l % r;
+    case ND_LSH: return l << r;
+    case ND_RSH: return l >> r;
+    case ND_AND: return l & r;
+    case ND_IOR: return l | r;
+    case ND_XOR: return l ^ r;
+    case ND_EQ: return l == r;
+    case ND_NEQ: return l != r;
+    case ND_LT: return l < r;
+    case ND_LTE: return l <= r;
+    case ND_LAND: return l && r;
+    default: return l || r; // ND_LOR
+    }
+}
+
+// constant folding
+
+static bool is_const(Node *node) {
+    return node->kind == ND_NUM || node->kind == ND_CHAR;
+}
+
+// truncates v to the integer type as the generated code does
+static int wrap_int(int v, Type *type) {
+    if (type->ty != TY_CHAR)
+        return v;
+    v = v & 255;
+    return v >= 128 ? v - 256 : v;
+}
+
+static void make_const(Node *node, int v) {
+    node->kind = node->type->ty == TY_CHAR ? ND_CHAR : ND_NUM;
+    node->val = wrap_int(v, node->type);
+    node->cond = NULL;
+    node->lhs = NULL;
+    node->rhs = NULL;
+}
+
+static void replace_node(Node *node, Node *by) {
+    node->kind = by->kind;
+    node->val = by->val;
+    node->is_extern = by->is_extern;
+    node->is_static = by->is_static;
+    node->is_enum = by->is_enum;
+    node->cond = by->cond;
+    node->lhs = by->lhs;
+    node->rhs = by->rhs;
+    node->body = by->body;
+    node->block = by->block;
+    node->name = by->name;
+    node->type = by->type;
+}
+
+static bool has_side_effects(Node *node) {
+    if (node == NULL)
+        return false;
+    switch (node->kind) {
+    case ND_ASGN: case ND_CALL:
+    case ND_PREINCR: case ND_PREDECR: case ND_POSTINCR: case ND_POSTDECR:
+        return true;
+    default:
+        if (ND_ADDEQ <= node->kind && node->kind <= ND_XOREQ)
+            return true;
+        return has_side_effects(node->cond)
+            || has_side_effects(node->lhs)
+            || has_side_effects(node->rhs);
+    }
+}
+
+// computes `l op r' into result unless the compiler itself might disagree
+// with the generated code (e.g. dividing negative numbers)
+static bool fold_binary(Node_kind kind, int l, int r, int *result) {
+    switch (kind) {
+    case ND_ADD: *result = l + r; return true;
+    case ND_SUB: *result = l - r; return true;
+    case ND_MUL: *result = l * r; return true;
+    case ND_DIV: case ND_MOD:
+        if (l < 0 || r <= 0)
+            return false;
+        *result = kind == ND_DIV ? l / r : l % r;
+        return true;
+    case ND_LSH: case ND_RSH:
+        if (r < 0 || r > 31 || (kind == ND_RSH && l < 0))
+            return false;
+        *result = kind == ND_LSH ? l << r : l >> r;
+        return true;
+    case ND_AND: *result = l & r; return true;
+    case ND_IOR: *result = l | r; return true;
+    case ND_XOR: *result = l ^ r; return true;
+    case ND_EQ: *result = l == r; return true;
+    case ND_NEQ: *result = l != r; return true;
+    case ND_LT: *result = l < r; return true;
+    case ND_LTE: *result = l <= r; return true;
+    case ND_LAND: *result = l && r; return true;
+    case ND_LOR: *result = l || r; return true;
+    default: return false;
+    }
+}
+
+static bool is_const_of(Node *node, int v) {
+    return is_const(node) && node->val == v;
+}
+
+// replaces node by its operand x if it doesn't change the type
+static bool keep_operand(Node *node, Node *x) {
+    if (x->type->ty != node->type->ty)
+        return false;
+    replace_node(node, x);
+    return true;
+}
+
+// x+0, x*1, x&0 and the like
+static void simplify(Node *node) {
+    Node *lhs = node->lhs;
+    Node *rhs = node->rhs;
+    if (!is_integer(node->type) || !is_integer(lhs->type) || !is_integer(rhs->type))
+        return;
+
+    switch (node->kind) {
+    case ND_ADD: case ND_IOR: case ND_XOR:
+        if (is_const_of(rhs, 0) && keep_operand(node, lhs))
+            return;
+        if (is_const_of(lhs, 0))
+            keep_operand(node, rhs);
+        return;
+    case ND_SUB: case ND_LSH: case ND_RSH:
+        if (is_const_of(rhs, 0))
+            keep_operand(node, lhs);
+        return;
+    case ND_DIV:
+        if (is_const_of(rhs, 1))
+            keep_operand(node, lhs);
+        return;
+    case ND_MUL:
+        if (is_const_of(rhs, 1) && keep_operand(node, lhs))
+            return;
+        if (is_const_of(lhs, 1) && keep_operand(node, rhs))
+            return;
+        if ((is_const_of(rhs, 0) && !has_side_effects(lhs))
+                || (is_const_of(lhs, 0) && !has_side_effects(rhs)))
+            make_const(node, 0);
+        return;
+    case ND_AND:
+        if (is_const_of(rhs, -1) && keep_operand(node, lhs))
+            return;
+        if (is_const_of(lhs, -1) && keep_operand(node, rhs))
+            return;
+        if ((is_const_of(rhs, 0) && !has_side_effects(lhs))
+                || (is_const_of(lhs, 0) && !has_side_effects(rhs)))
+            make_const(node, 0);
+        return;
+    case ND_LAND:
+        if (is_const_of(lhs, 0))
+            make_const(node, 0);
+        return;
+    case ND_LOR:
+        if (is_const(lhs) && lhs->val != 0)
+            make_const(node, 1);
+        return;
+    default:
+        return;
+    }
+}
+
+// folds constant subexpressions of node, whose operands are already folded
+void fold_expr(Node *node) {
+    switch (node->kind) {
+    case ND_SIZEOF:
+        make_const(node, node->val);
+        return;
+    case ND_NEG:
+        if (is_const(node->lhs))
+            make_const(node, !node->lhs->val);
+        return;
+    case ND_BCOMPL:
+        if (is_const(node->lhs))
+            make_const(node, ~node->lhs->val);
+        return;
+    case ND_CAST:
+        if (is_const(node->lhs) && is_integer(node->type))
+            make_const(node, node->lhs->val);
+        return;
+    case ND_COND: {
+        if (!is_const(node->cond))
+            return;
+        Node *taken = node->cond->val ? node->lhs : node->rhs;
+        if (is_const(taken) && is_integer(node->type))
+            make_const(node, taken->val);
+        else if (eq_type(taken->type, node->type))
+            replace_node(node, taken);
+        return;
+    }
+    default:
+        break;
+    }
+
+    if (!(ND_ADD <= node->kind && node->kind <= ND_LOR))
+        return;
+    int v;
+    if (is_const(node->lhs) && is_const(node->rhs)
+            && fold_binary(node->kind, node->lhs->val, node->rhs->val, &v)) {
+        make_const(node, v);
+        return;
+    }
+    simplify(node);
+}
+
 char *gen_loop_label(char *prefix) {
     int len = strlen(prefix) + 11;
     char *str = calloc(len, sizeof(char));
@@ -0,0 +1,239 @@
+#include "ccatd.h"
+
+// Strength reduction.
+//
+// Multiplications by powers of two become shifts. Divisions and remainders
+// by other constants become a multiplication by a "magic number" keeping the
+// upper half of the product, followed by a shift and a correction rounding
+// negative quotients towards zero, as in Granlund and Montgomery, "Division
+// by Invariant Integers using Multiplication".
+//
+// The constants are computed with 32-bit ints only, which is all ccatd has to
+// build itself with.
+
+// returns k if c is 2^k, or -1
+int exact_log2(int c) {
+    if (c <= 0 || (c & (c - 1)) != 0)
+        return -1;
+    int k = 0;
+    while (c > 1) {
+        c = c >> 1;
+        k++;
+    }
+    return k;
+}
+
+// finds magic and shift such that for every 32-bit n
+//   n / d == ((n + mulh(n, magic)) >> shift) - (n >> 31)
+// with arithmetic shifts, where d > 2 isn't a power of two. The magic number
+// is 2^(31+l) / d + 1 - 2^32 for l = ceil(log2(d)), and the shift is l - 1.
+void div_magic(int d, int *magic, int *shift) {
+    int l = 0;
+    while (l < 31 && (1 << l) < d)
+        l++;
+
+    // long division of 2^(31+l) by d a bit at a time; twice the remainder is
+    // compared with d as r >= d - r so that nothing overflows
+    int q = 0;
+    int r = 1;
+    for (int i = 0; i < 31 + l; i++) {
+        if (r >= d - r) {
+            r = r - (d - r);
+            q = q * 2 + 1;
+        } else {
+            r = r * 2;
+            q = q * 2;
+        }
+    }
+    *magic = q + 1;
+    *shift = l - 1;
+}
+
+// returns the inverse of an odd d modulo 2^32 by Newton's iteration, each
+// step of which doubles the number of the correct low bits
+int mul_inverse(int d) {
+    int x = d; // correct to 3 bits, as d * d is 1 modulo 8
+    for (int i = 0; i < 4; i++)
+        x = x * (2 - d * x);
+    return x;
+}
+
+// the IR pass
+
+static IRFunc *ir;
+static Vec *out; // the instructions replacing the one reduced
+
+static int append_op(Inst_kind kind, int size, int a, int b) {
+    Inst *inst = inst_new(kind, size);
+    inst->dst = ++ir->num_vregs;
+    inst->a = a;
+    inst->b = b;
+    vec_push(out, inst);
+    return inst->dst;
+}
+
+static int append_imm(int size, int val) {
+    Inst *inst = inst_new(IR_IMM, size);
+    inst->dst = ++ir->num_vregs;
+    inst->imm = val;
+    vec_push(out, inst);
+    return inst->dst;
+}
+
+// n * c, or 0 if a multiplication is as good
+static int reduce_mul(int size, int n, int c) {
+    if (c == 0)
+        return append_imm(size, 0);
+    int k = exact_log2(c > 0 ? c : -c);
+    if (k < 0)
+        return 0;
+    int p = n;
+    if (k > 0) {
+        int amount = append_imm(4, k);
+        p = append_op(IR_SHL, size, n, amount);
+    }
+    if (c < 0) {
+        int zero = append_imm(size, 0);
+        p = append_op(IR_SUB, size, zero, p);
+    }
+    return p;
+}
+
+// n >> 31 (or 63), that is -1 if n is negative and 0 otherwise
+static int sign_of(int size, int n) {
+    int amount = append_imm(4, size * 8 - 1);
+    return append_op(IR_SAR, size, n, amount);
+}
+
+// 2^k - 1 if n is negative and 0 otherwise, added to n before dividing by
+// 2^k so that the quotient is rounded towards zero
+static int pow2_bias(int size, int n, int k) {
+    int sign = sign_of(size, n);
+    int amount = append_imm(4, size * 8 - k);
+    return append_op(IR_SHR, size, sign, amount);
+}
+
+// n / d for |d| > 1, or 0 if it has to be a division
+static int reduce_div(int size, int n, int d) {
+    int ad = d < 0 ? -d : d;
+    int k = exact_log2(ad);
+    int q;
+    if (k >= 0) {
+        int bias = pow2_bias(size, n, k);
+        int biased = append_op(IR_ADD, size, n, bias);
+        int amount = append_imm(4, k);
+        q = append_op(IR_SAR, size, biased, amount);
+    } else if (size == 4) {
+        int magic;
+        int shift;
+        div_magic(ad, &magic, &shift);
+        int m = append_imm(4, magic);
+        int high = append_op(IR_MULH, 4, n, m);
+        q = append_op(IR_ADD, 4, high, n);
+        if (shift > 0) {
+            int amount = append_imm(4, shift);
+            q = append_op(IR_SAR, 4, q, amount);
+        }
+        int sign = sign_of(4, n);
+        q = append_op(IR_SUB, 4, q, sign);
+    } else {
+        return 0;
+    }
+
+    if (d < 0) {
+        int zero = append_imm(size, 0);
+        q = append_op(IR_SUB, size, zero, q);
+    }
+    return q;
+}
+
+// n % d for |d| > 1, or 0 if it has to be a division
+static int reduce_mod(int size, int n, int d) {
+    int ad = d < 0 ? -d : d;
+    int k = exact_log2(ad);
+    if (k >= 0) {
+        int bias = pow2_bias(size, n, k);
+        int biased = append_op(IR_ADD, size, n, bias);
+        int mask = append_imm(size, ad - 1);
+        int low = append_op(IR_AND, size, biased, mask);
+        return append_op(IR_SUB, size, low, bias);
+    }
+
+    int q = reduce_div(size, n, ad);
+    if (q == 0)
+        return 0;
+    int divisor = append_imm(size, ad);
+    int p = append_op(IR_MUL, size, q, divisor);
+    return append_op(IR_SUB, size, n, p);
+}
+
+// fills out with the instructions computing inst, whose operand other than n
+// is the constant c, and returns the register holding the result, or 0
+static int reduce(Inst *inst, int n, int c) {
+    int size = inst->size;
+    if (inst->kind == IR_MUL)
+        return reduce_mul(size, n, c);
+
+    // the quotient of the most negative number by -1 overflows
+    if (c == 0 || c == -2147483647 - 1)
+        return 0;
+    if (inst->kind == IR_DIV) {
+        if (c == 1)
+            return n;
+        if (c == -1) {
+            int zero = append_imm(size, 0);
+            return append_op(IR_SUB, size, zero, n);
+        }
+        return reduce_div(size, n, c);
+    }
+    if (c == 1 || c == -1)
+        return append_imm(size, 0);
+    return reduce_mod(size, n, c);
+}
+
+static bool is_imm(Inst *def) {
+    return def != NULL && def->kind == IR_IMM;
+}
+
+// appends inst to insts, or what it is reduced to; pos is its position in bb
+static void reduce_inst(BB *bb, int pos, Inst *inst, Inst **defs, Vec *insts) {
+    out = vec_new();
+    int r = 0;
+    if (inst->kind == IR_MUL || inst->kind == IR_DIV || inst->kind == IR_MOD) {
+        Inst *b = reaching_def(bb, pos, inst->b, defs);
+        Inst *a = reaching_def(bb, pos, inst->a, defs);
+        if (is_imm(b))
+            r = reduce(inst, inst->a, b->imm);
+        else if (inst->kind == IR_MUL && is_imm(a))
+            r = reduce(inst, inst->b, a->imm);
+    }
+    if (r == 0) {
+        vec_push(insts, inst);
+        return;
+    }
+
+    // the last instruction computes the result into the original destination
+    Inst *last = vec_at(out, vec_len(out) - 1);
+    if (last != NULL && last->dst == r) {
+        last->dst = inst->dst;
+    } else {
+        Inst *mov = inst_new(IR_MOV, inst->size);
+        mov->dst = inst->dst;
+        mov->a = r;
+        vec_push(out, mov);
+    }
+    for (int i = 0; i < vec_len(out); i++)
+        vec_push(insts, vec_at(out, i));
+}
+
+void reduce_strength(IRFunc *irf) {
+    ir = irf;
+    Inst **defs = single_defs(ir);
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        Vec *insts = vec_new();
+        for (int j = 0; j < vec_len(bb->insts); j++)
+            reduce_inst(bb, j, vec_at(bb->insts, j), defs, insts);
+        bb->insts = insts;
+    }
+}
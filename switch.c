@@ -0,0 +1,216 @@
+#include "ccatd.h"
+
+// Lowering of switch dispatch, shared by both code generators.
+//
+// The cases are sorted and split by a balanced binary search on their values
+// until a range of them is better dispatched on its own:
+//
+//   - a bit test, if the range spans less than 32 values and jumps to at most
+//     3 different labels: one mask per label, whose bits are the cases
+//   - a jump table in .rodata, if it has at least 4 cases filling at least a
+//     third of the values it spans
+//   - a comparison with each case, if it has at most 3 of them
+//
+// Given how often each case is taken, as in a profile, the cases taken more
+// often than all the others together are compared first, and the comparisons
+// with a few cases are in the order of how often they are taken.
+//
+// The value is read from a 32-bit register other than ecx and edx, which are
+// used as scratch registers.
+
+static int *vals;      // the values of the cases, sorted
+static char **labels;  // the label of each case
+static int *weights;   // how often each case is taken, or NULL
+static char *val;      // the register holding the value
+static char *default_label;
+static int next_label = 0;
+
+static char *new_label() {
+    char *buf = calloc(20, sizeof(char));
+    sprintf(buf, ".Lswitch%d", next_label++);
+    return buf;
+}
+
+// whether vals[hi - 1] - vals[lo] < limit, without overflowing
+static bool spans_less_than(int lo, int hi, int limit) {
+    int min = vals[lo];
+    int max = vals[hi - 1];
+    if (min >= 0 || max < 0)
+        return max - min < limit;
+    return max < min + limit;
+}
+
+// the number of different labels of the cases in [lo, hi), up to 4
+static int num_labels(int lo, int hi) {
+    int n = 0;
+    for (int i = lo; i < hi && n < 4; i++) {
+        bool seen = false;
+        for (int j = lo; j < i; j++)
+            if (!strcmp(labels[j], labels[i]))
+                seen = true;
+        if (!seen)
+            n++;
+    }
+    return n;
+}
+
+// ecx = val - vals[lo], jumping to the default if it is above the range
+static void gen_range_check(int lo, int hi) {
+    emitf("  mov ecx, %s\n", val);
+    if (vals[lo] != 0)
+        emitf("  sub ecx, %d\n", vals[lo]);
+    emitf("  cmp ecx, %d\n", vals[hi - 1] - vals[lo]);
+    emitf("  ja %s\n", default_label);
+}
+
+static void gen_bit_test(int lo, int hi) {
+    gen_range_check(lo, hi);
+    for (int i = lo; i < hi; i++) {
+        bool seen = false;
+        for (int j = lo; j < i; j++)
+            if (!strcmp(labels[j], labels[i]))
+                seen = true;
+        if (seen)
+            continue;
+
+        int mask = 0;
+        for (int j = i; j < hi; j++)
+            if (!strcmp(labels[j], labels[i]))
+                mask = mask | (1 << (vals[j] - vals[lo]));
+        emitf("  mov edx, %d\n", mask);
+        emitf("  bt edx, ecx\n");
+        emitf("  jc %s\n", labels[i]);
+    }
+}
+
+// compares with each case in [lo, hi), the most taken first
+static void gen_compares(int lo, int hi) {
+    bool *done = calloc(hi - lo, sizeof(bool));
+    for (int k = lo; k < hi; k++) {
+        int i = -1;
+        for (int j = lo; j < hi; j++)
+            if (!done[j - lo] && (i < 0 || (weights != NULL && weights[j] > weights[i])))
+                i = j;
+        done[i - lo] = true;
+        emitf("  cmp %s, %d\n", val, vals[i]);
+        emitf("  je %s\n", labels[i]);
+    }
+}
+
+// compares with up to 3 cases taken more often than the others and the
+// default together, removing them from the cases left
+static int gen_hot_cases(int len, int dflt_weight) {
+    int total = dflt_weight;
+    for (int i = 0; i < len; i++)
+        total = total + weights[i];
+    for (int k = 0; k < 3 && len > 0; k++) {
+        int hot = 0;
+        for (int i = 1; i < len; i++)
+            if (weights[i] > weights[hot])
+                hot = i;
+        if (weights[hot] <= total - weights[hot])
+            break;
+        emitf("  cmp %s, %d\n", val, vals[hot]);
+        emitf("  je %s\n", labels[hot]);
+        total = total - weights[hot];
+        len--;
+        for (int i = hot; i < len; i++) {
+            vals[i] = vals[i + 1];
+            labels[i] = labels[i + 1];
+            weights[i] = weights[i + 1];
+        }
+    }
+    return len;
+}
+
+static void gen_jump_table(int lo, int hi) {
+    gen_range_check(lo, hi);
+    char *table = new_label();
+    emitf("  lea rdx, %s[rip]\n", table);
+    emitf("  movsxd rcx, DWORD PTR [rdx+rcx*4]\n");
+    emitf("  add rcx, rdx\n");
+    emitf("  jmp rcx\n");
+
+    emitf("  .section .rodata\n");
+    emitf("  .align 4\n");
+    emitf("%s:\n", table);
+    int i = lo;
+    int v = vals[lo];
+    while (true) {
+        if (vals[i] == v) {
+            emitf("  .long %s-%s\n", labels[i], table);
+            i++;
+        } else {
+            emitf("  .long %s-%s\n", default_label, table);
+        }
+        if (i == hi)
+            break;
+        v++;
+    }
+    emitf("  .text\n");
+}
+
+// dispatches the cases in [lo, hi), falling through to the default if last
+static void gen_cases(int lo, int hi, bool last) {
+    int n = hi - lo;
+    if (n >= 3 && spans_less_than(lo, hi, 32) && num_labels(lo, hi) <= 3) {
+        gen_bit_test(lo, hi);
+    } else if (n >= 4 && spans_less_than(lo, hi, 3 * n)) {
+        gen_jump_table(lo, hi);
+        return;
+    } else if (n <= 3) {
+        gen_compares(lo, hi);
+    } else {
+        int mid = lo + n / 2;
+        char *left = new_label();
+        emitf("  cmp %s, %d\n", val, vals[mid]);
+        emitf("  jl %s\n", left);
+        gen_cases(mid, hi, false);
+        emitf("%s:\n", left);
+        gen_cases(lo, mid, last);
+        return;
+    }
+    if (!last)
+        emitf("  jmp %s\n", default_label);
+}
+
+// jumps to case_labels[i] if the 32-bit register reg holds cases[i], or falls
+// through; case_weights, if not NULL, tells how often each case is taken and
+// case_weights[n] how often none is
+void gen_switch_dispatch(char *reg, int *cases, char **case_labels, int n, char *dflt, int *case_weights) {
+    val = reg;
+    default_label = dflt;
+    vals = calloc(n + 1, sizeof(int));
+    labels = calloc(n + 1, sizeof(char *));
+    weights = case_weights != NULL ? calloc(n + 1, sizeof(int)) : NULL;
+
+    // insertion sort; a case with the value of an earlier one is never taken
+    int len = 0;
+    for (int i = 0; i < n; i++) {
+        bool seen = false;
+        for (int j = 0; j < len; j++)
+            if (vals[j] == cases[i])
+                seen = true;
+        if (seen)
+            continue;
+
+        int j = len;
+        while (j > 0 && vals[j - 1] > cases[i]) {
+            vals[j] = vals[j - 1];
+            labels[j] = labels[j - 1];
+            if (weights != NULL)
+                weights[j] = weights[j - 1];
+            j--;
+        }
+        vals[j] = cases[i];
+        labels[j] = case_labels[i];
+        if (weights != NULL)
+            weights[j] = case_weights[i];
+        len++;
+    }
+
+    if (weights != NULL)
+        len = gen_hot_cases(len, case_weights[n]);
+    if (len > 0)
+        gen_cases(0, len, true);
+}
@@ -0,0 +1,158 @@
+#include "ccatd.h"
+
+// Tail calls.
+//
+// A call whose value is returned right away, maybe after some copies and
+// jumps, is a tail call. A tail call of the function itself becomes a jump
+// back to its start, after the params have been assigned the arguments. Any
+// other tail call is marked, so that the backend tears down the frame before
+// jumping to the callee, which then returns straight to the caller of this
+// function.
+//
+// Neither is done if the address of a local variable is taken, as the callee
+// might be given a pointer into the frame it reuses.
+
+static IRFunc *ir;
+static BB *start; // the entry block without the params, or NULL
+
+// the return reached from the instruction at pos in bb on, if nothing but
+// copies of the value of call are made and jumps taken on the way, or NULL
+static Inst *reached_return(BB *bb, int pos, Inst *call) {
+    int v = call->dst;
+    int jumps = 0;
+    while (jumps < ir->num_bbs) {
+        Inst *inst = vec_at(bb->insts, pos);
+        if (inst->kind == IR_MOV && v != 0 && inst->a == v && inst->size == call->size) {
+            v = inst->dst;
+            pos++;
+        } else if (inst->kind == IR_JMP) {
+            bb = inst->then;
+            pos = 0;
+            jumps++;
+        } else if (inst->kind == IR_RET) {
+            if (inst->a == 0 || (inst->a == v && inst->size == call->size))
+                return inst;
+            return NULL;
+        } else {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static int num_params(BB *entry) {
+    int n = 0;
+    while (((Inst *)vec_at(entry->insts, n))->kind == IR_PARAM)
+        n++;
+    return n;
+}
+
+// moves what follows the params of the entry block into a block of its own,
+// which the calls can jump to
+static void split_entry() {
+    BB *entry = vec_at(ir->blocks, 0);
+    int n = num_params(entry);
+    start = bb_new(ir);
+    for (int i = n; i < vec_len(entry->insts); i++)
+        vec_push(start->insts, vec_at(entry->insts, i));
+
+    Vec *params = vec_new();
+    for (int i = 0; i < n; i++)
+        vec_push(params, vec_at(entry->insts, i));
+    Inst *jmp = inst_new(IR_JMP, 0);
+    jmp->then = start;
+    vec_push(params, jmp);
+    entry->insts = params;
+
+    Vec *blocks = vec_new();
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        vec_push(blocks, vec_at(ir->blocks, i));
+        if (i == 0)
+            vec_push(blocks, start);
+    }
+    ir->blocks = blocks;
+}
+
+static void append_mov(BB *bb, int dst, int a) {
+    Inst *mov = inst_new(IR_MOV, 8);
+    mov->dst = dst;
+    mov->a = a;
+    vec_push(bb->insts, mov);
+}
+
+// replaces the call ending bb, followed by its return, with the assignment
+// of the arguments to the params and a jump to the start
+static void loop_back(BB *bb) {
+    BB *entry = vec_at(ir->blocks, 0);
+    if (start == NULL) {
+        split_entry();
+        if (bb == entry)
+            bb = start;
+    }
+    vec_pop(bb->insts);
+    Inst *call = vec_pop(bb->insts);
+
+    // the arguments may read the params, so they are all copied first
+    int *temps = calloc(call->nargs + 1, sizeof(int));
+    for (int i = 0; i < call->nargs; i++) {
+        temps[i] = ++ir->num_vregs;
+        append_mov(bb, temps[i], call->args[i]);
+    }
+    for (int i = 0; i < call->nargs; i++) {
+        Inst *param = vec_at(entry->insts, i);
+        append_mov(bb, param->dst, temps[i]);
+    }
+    Inst *jmp = inst_new(IR_JMP, 0);
+    jmp->then = start;
+    vec_push(bb->insts, jmp);
+}
+
+static bool is_self_call(Inst *call) {
+    Func *func = ir->func;
+    BB *entry = vec_at(ir->blocks, 0);
+    return !strcmp(call->name, func->name) && call->nargs == vec_len(func->params)
+        && call->nargs == num_params(entry);
+}
+
+void eliminate_tail_calls(IRFunc *irf) {
+    ir = irf;
+    start = NULL;
+    if (ir->func->is_varargs)
+        return;
+    bool *escaped = escaped_locals(ir, single_defs(ir));
+    for (int k = 1; k <= ir->frame; k++)
+        if (escaped[k])
+            return;
+
+    Vec *self_calls = vec_new();
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *call = vec_at(bb->insts, j);
+            if (call->kind != IR_CALL)
+                continue;
+            Inst *ret = reached_return(bb, j + 1, call);
+            if (ret == NULL)
+                continue;
+
+            // the call is followed right away by the return of its value
+            Vec *insts = vec_new();
+            for (int k = 0; k <= j; k++)
+                vec_push(insts, vec_at(bb->insts, k));
+            Inst *copy = inst_new(IR_RET, ret->size);
+            copy->a = ret->a ? call->dst : 0;
+            vec_push(insts, copy);
+            bb->insts = insts;
+
+            if (is_self_call(call))
+                vec_push(self_calls, bb);
+            else
+                call->is_tail = true;
+            break;
+        }
+    }
+    for (int i = 0; i < vec_len(self_calls); i++)
+        loop_back(vec_at(self_calls, i));
+    // the copies the blocks after the calls read may be gone with them
+    remove_unreachable(ir);
+}
@@ -7,7 +7,7 @@ try_return() {
   filename="$1"
   expected="$2"
   echo "running ${1}..."
-  ./${APP} "$filename" > _temp.s
+  ./${APP} ${FLAGS} "$filename" > _temp.s
   if [ "$?" != 0 ]; then
     echo "compilation failed: ${filename}"
     exit 1
@@ -30,7 +30,7 @@ try_stdout() {
   filename="$1"
   expected="$2"
   echo "running ${1}..."
-  ./${APP} "${filename}" > _temp.s
+  ./${APP} ${FLAGS} "${filename}" > _temp.s
   if [ "$?" != 0 ]; then
     echo "compilation failed: ${filename}"
     exit 1
@@ -45,19 +45,68 @@ try_stdout() {
   fi
 }
 
-try_stdout 'sample/call2.c' 'OK'
-try_stdout 'sample/char2.c' "Hello, World!"
-try_stdout 'sample/string2.c' '"hack"'
-try_stdout 'sample/string3.c' 'char'
-try_return 'sample/assignment2.c' 4
-
-try_return 'test/test_misc1.c' 0
-try_return 'test/test_misc2.c' 0
-try_return 'test/test_operators.c' 0
-try_return 'test/test_struct.c' 0
-try_stdout 'test/test_variadic.c' 'abcXYZabc12345'
-try_return 'test/test_list.c' 0
-try_return 'test/test_incr.c' 0
-try_stdout 'test/test_file.c' 'this is text'
+run_tests() {
+  try_stdout 'sample/call2.c' 'OK'
+  try_stdout 'sample/char2.c' "Hello, World!"
+  try_stdout 'sample/string2.c' '"hack"'
+  try_stdout 'sample/string3.c' 'char'
+  try_return 'sample/assignment2.c' 4
+
+  try_return 'test/test_misc1.c' 0
+  try_return 'test/test_misc2.c' 0
+  try_return 'test/test_operators.c' 0
+  try_return 'test/test_struct.c' 0
+  try_stdout 'test/test_variadic.c' 'abcXYZabc12345'
+  try_return 'test/test_list.c' 0
+  try_return 'test/test_incr.c' 0
+  try_return 'test/test_enum.c' 0
+  try_return 'test/test_regalloc.c' 0
+  try_return 'test/test_fold.c' 0
+  try_return 'test/test_dce.c' 0
+  try_return 'test/test_inline.c' 0
+  try_return 'test/test_strength.c' 0
+  try_return 'test/test_licm.c' 0
+  try_return 'test/test_promote.c' 0
+  try_return 'test/test_switch.c' 0
+  try_return 'test/test_leaf.c' 0
+  try_return 'test/test_branch.c' 0
+  try_return 'test/test_gvn.c' 0
+  try_return 'test/test_address.c' 0
+  try_return 'test/test_layout.c' 0
+  try_stdout 'test/test_file.c' 'this is text'
+}
+
+run_tests
+
+# the IR pipeline
+FLAGS='--ir' run_tests
+FLAGS='--ir --inline-threshold=0' try_return 'test/test_inline.c' 0
+FLAGS='--ir --inline-threshold=0' try_return 'test/test_promote.c' 0
+FLAGS='--ir -fno-omit-frame-pointer' try_return 'test/test_leaf.c' 0
+
+# optimization levels and custom pipelines
+FLAGS='-O1 --verify-each' run_tests
+FLAGS='-O2 --verify-each' run_tests
+FLAGS='--passes=' try_return 'test/test_misc1.c' 0
+FLAGS='--passes=promote,dce,gvn,verify' try_return 'test/test_gvn.c' 0
+FLAGS='--passes=promote,gvn' try_return 'test/test_gvn.c' 0
+FLAGS='--passes=promote,layout' try_return 'test/test_layout.c' 0
+
+# a profile of the runs, read back to lay out the code
+rm -f _temp.prof
+FLAGS='-fprofile-generate=_temp.prof' try_return 'test/test_profile.c' 0
+FLAGS='-fprofile-generate=_temp.prof' try_return 'test/test_profile.c' 0
+FLAGS='-fprofile-use=_temp.prof' try_return 'test/test_profile.c' 0
+FLAGS='-O1 -fprofile-generate=_temp.prof' try_return 'test/test_switch.c' 0
+FLAGS='-O1 -fprofile-use=_temp.prof' try_return 'test/test_switch.c' 0
+
+# deep recursion, which needs tail calls
+FLAGS='--ir' try_return 'test/test_tailcall.c' 0
+FLAGS='--ir --inline-threshold=0' try_return 'test/test_tailcall.c' 0
+FLAGS='--passes=promote,tailcall,verify' try_return 'test/test_tailcall.c' 0
+
+# tokenization split into chunks lexed by worker processes
+FLAGS='--tokenize-jobs=4' try_return 'test/test_misc1.c' 0
+FLAGS='--tokenize-jobs=4' try_stdout 'test/test_variadic.c' 'abcXYZabc12345'
 
 echo "All tests passed"
@@ -0,0 +1,73 @@
+struct pair {
+    int key;
+    char tag;
+    long value;
+};
+
+int g;
+char gc;
+long gl;
+int garr[8];
+struct pair gpairs[4];
+
+int sum(int *a, int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++)
+        s = s + a[i];
+    return s;
+}
+
+// the constant added to the index goes into the displacement
+int neighbors(int *a, int i) {
+    return a[i - 1] + a[i + 1];
+}
+
+long total(struct pair *p, int n) {
+    long t = 0;
+    for (int i = 0; i < n; i++)
+        t = t + p[i].value * p[i].tag;
+    return t;
+}
+
+// compound assignments read and write the same operand
+void bump(struct pair *p, int *a, int i) {
+    p->key += 3;
+    p->value *= 2;
+    a[i] -= 1;
+    a[i + 2] <<= 2;
+    garr[i] += 10;
+    g += 5;
+    gc -= 1;
+    gl *= 3;
+}
+
+int main() {
+    int a[6];
+    for (int i = 0; i < 6; i++)
+        a[i] = i * i;
+    assert_equals(sum(a, 6), 55);
+    assert_equals(neighbors(a, 2), 10);
+    assert_equals(*(1 + a + 2), 9);
+
+    for (int i = 0; i < 4; i++) {
+        gpairs[i].key = i;
+        gpairs[i].tag = i + 1;
+        gpairs[i].value = 100 * i;
+    }
+    assert_equals(total(gpairs, 4), 2000);
+
+    g = 1;
+    gc = 2;
+    gl = 7;
+    garr[1] = 4;
+    bump(&gpairs[1], a, 1);
+    assert_equals(gpairs[1].key, 4);
+    assert_equals(gpairs[1].value, 200);
+    assert_equals(a[1], 0);
+    assert_equals(a[3], 36);
+    assert_equals(garr[1], 14);
+    assert_equals(g, 6);
+    assert_equals(gc, 1);
+    assert_equals(gl, 21);
+    return 0;
+}
@@ -0,0 +1,70 @@
+int calls = 0;
+
+int touch(int x) {
+    calls++;
+    return x;
+}
+
+int classify(int a, int b) {
+    if (a < b && b < 10)
+        return 1;
+    if (a == b || !(a < 100))
+        return 2;
+    if (!(a != 7 && b != 7))
+        return 3;
+    return 0;
+}
+
+int count_while(char *s) {
+    int n = 0;
+    while (s[n] != 0 && s[n] != 46)
+        n++;
+    return n;
+}
+
+int count_do(int n) {
+    int i = 0;
+    do {
+        i++;
+    } while (!(i >= n) && i < 100);
+    return i;
+}
+
+int main() {
+    assert_equals(classify(1, 2), 1);
+    assert_equals(classify(1, 20), 0);
+    assert_equals(classify(5, 5), 2);
+    assert_equals(classify(200, 300), 2);
+    assert_equals(classify(7, 20), 3);
+    assert_equals(classify(30, 7), 3);
+
+    // the right operand isn't evaluated once the left one decides
+    assert_equals(touch(0) && touch(1), 0);
+    assert_equals(calls, 1);
+    assert_equals(touch(1) || touch(1), 1);
+    assert_equals(calls, 2);
+    assert_equals(touch(1) && touch(2), 1);
+    assert_equals(calls, 4);
+    assert_equals(touch(0) || touch(0), 0);
+    assert_equals(calls, 6);
+    int x = touch(3) > 2 ? touch(10) : touch(20);
+    assert_equals(x, 10);
+    assert_equals(calls, 8);
+
+    assert_equals(count_while("abc.de"), 3);
+    assert_equals(count_while("abcde"), 5);
+    assert_equals(count_do(5), 5);
+    assert_equals(count_do(0), 1);
+
+    int loops = 0;
+    for (int i = 0; i < 10 || loops < 3; i++)
+        loops++;
+    assert_equals(loops, 10);
+    while (1) {
+        loops++;
+        if (loops >= 15)
+            break;
+    }
+    assert_equals(loops, 15);
+    return 0;
+}
@@ -0,0 +1,69 @@
+int calls = 0;
+
+int count() {
+    calls++;
+    return calls;
+}
+
+int after_return(int x) {
+    return x * 2;
+    count();
+    return x;
+}
+
+int pick(int x) {
+    switch (3) {
+    case 1:
+        return 10;
+    case 3:
+        if (x > 0)
+            return 30;
+        break;
+    default:
+        return 99;
+    }
+    return -1;
+}
+
+int loop(int n) {
+    int sum = 0;
+    while (1) {
+        if (sum >= n)
+            break;
+        sum = sum + 3;
+    }
+    for (;;) {
+        if (0)
+            count();
+        else
+            break;
+    }
+    return sum;
+}
+
+int main() {
+    int x = 5;
+    x + 1;
+    x * count();
+    assert_equals(calls, 1);
+    count();
+    assert_equals(calls, 2);
+
+    assert_equals(after_return(7), 14);
+    assert_equals(calls, 2);
+    assert_equals(pick(1), 30);
+    assert_equals(pick(0), -1);
+    assert_equals(loop(10), 12);
+    assert_equals(calls, 2);
+
+    if (1) {
+        x = 6;
+    } else {
+        x = 7;
+        count();
+    }
+    assert_equals(x, 6);
+    assert_equals(0 ? count() : x, 6);
+    assert_equals(calls, 2);
+    return 0;
+}
@@ -0,0 +1,81 @@
+typedef enum {
+    C0,
+    C1,
+    C10 = 10,
+    C11,
+    C12,
+    CNEG = -3,
+    CNEG_NEXT,
+    CSHIFT = 1 << 4,
+    CREF = C10 * 2 + C1,
+    CSIZE = sizeof(int) + 1
+} Color;
+
+enum Kind {
+    K_A = 'a',
+    K_B,
+    K_LAST = K_B + 100
+};
+
+int global_c12 = C12;
+int global_arr[3] = {C0, C11, CREF};
+
+int classify(Color c) {
+    switch (c) {
+    case C0:
+        return 100;
+    case C10:
+        return 110;
+    case CREF:
+        return 121;
+    case CNEG:
+        return 97;
+    default:
+        return -1;
+    }
+}
+
+int main() {
+    assert_equals(C0, 0);
+    assert_equals(C1, 1);
+    assert_equals(C10, 10);
+    assert_equals(C11, 11);
+    assert_equals(C12, 12);
+    assert_equals(CNEG, -3);
+    assert_equals(CNEG_NEXT, -2);
+    assert_equals(CSHIFT, 16);
+    assert_equals(CREF, 21);
+    assert_equals(CSIZE, 5);
+
+    assert_equals(K_A, 97);
+    assert_equals(K_B, 98);
+    assert_equals(K_LAST, 198);
+
+    assert_equals(global_c12, 12);
+    assert_equals(global_arr[1], 11);
+    assert_equals(global_arr[2], 21);
+
+    assert_equals(classify(C0), 100);
+    assert_equals(classify(C10), 110);
+    assert_equals(classify(CREF), 121);
+    assert_equals(classify(CNEG), 97);
+    assert_equals(classify(C11), -1);
+
+    enum { L0 = 7, L1, L2 = L1 * 2 } local = L2;
+    assert_equals(L0, 7);
+    assert_equals(L1, 8);
+    assert_equals(local, 16);
+
+    int hit = 0;
+    switch (local) {
+    case L0:
+        hit = 1;
+        break;
+    case L2:
+        hit = 2;
+        break;
+    }
+    assert_equals(hit, 2);
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+int calls = 0;
+
+int count() {
+    calls++;
+    return 5;
+}
+
+int main() {
+    assert_equals(4 * 1024 - 1, 4095);
+    assert_equals((1 << 10) | 3, 1027);
+    assert_equals(100 / 7 + 100 % 7, 16);
+    assert_equals(~0, -1);
+    assert_equals(!(3 < 2), 1);
+    assert_equals(sizeof(int) * 3, 12);
+    assert_equals(1 ? 10 : 20, 10);
+    assert_equals(2 - 2 ? 10 : 20, 20);
+    assert_equals((char)300, 44);
+    assert_equals('a' + 1, 98);
+
+    char c = 'x';
+    assert_equals(c + 0, 120);
+    int x = 7;
+    assert_equals(x * 1 + 0, 7);
+    assert_equals(x & 0, 0);
+    assert_equals((x | 0) ^ 0, 7);
+    assert_equals(x << 0, 7);
+    assert_equals(0 && count(), 0);
+    assert_equals(1 || count(), 1);
+    assert_equals(calls, 0);
+
+    // operands with side effects are still evaluated
+    assert_equals(count() * 0, 0);
+    assert_equals(count() & 0, 0);
+    assert_equals(calls, 2);
+    return 0;
+}
@@ -0,0 +1,125 @@
+struct point {
+    int x;
+    int y;
+};
+
+int norm(struct point *p) {
+    return p->x * p->x + p->y * p->y;
+}
+
+int twice(int *a, int i) {
+    return a[i] + a[i];
+}
+
+// the store through q may write *p
+int reload(int *p, int *q) {
+    int x = *p;
+    *q = 7;
+    return x + *p;
+}
+
+int counter;
+
+int bump() {
+    counter++;
+    return 1;
+}
+
+// the call writes counter
+int reload_global() {
+    int x = counter;
+    bump();
+    return x + counter;
+}
+
+// x stays in memory, and the call may write it through p
+void set(int *p) {
+    *p = 9;
+}
+
+int address_taken() {
+    int x = 1;
+    int y = x;
+    set(&x);
+    return y + x;
+}
+
+// the sum is computed once before the branch
+int dominated(int a, int b, int c) {
+    int s = a * b + c;
+    if (c > 0)
+        return a * b + c + s;
+    return s - (a * b + c);
+}
+
+// the second load of the byte becomes a copy of the sign-extended first
+int bytes() {
+    char buf[4];
+    int x;
+    int y;
+    buf[0] = -3;
+    x = buf[0];
+    y = buf[0];
+    return x * y;
+}
+
+// the blocks never reached still read x, whose copies are forwarded
+int dead_return() {
+    int x = counter;
+    int y = x + 1;
+    return y;
+    return x;
+}
+
+int before_case(int c) {
+    int x = counter;
+    int y = x + 2;
+    switch (c) {
+        y = x + 5;
+    case 1:
+        return y;
+    }
+    return x;
+}
+
+// prev copies cur of the iteration before, not the one cur holds when read
+int lagged_sum() {
+    int a[5] = {10, 20, 30, 40, 50};
+    int s = 0;
+    int prev;
+    int cur;
+    for (int i = 0; i < 5; i++) {
+        if (i >= 2)
+            s = s + prev;
+        if (i >= 1)
+            prev = cur;
+        cur = a[i];
+    }
+    return s;
+}
+
+int main() {
+    struct point pt;
+    pt.x = 3;
+    pt.y = 4;
+    assert_equals(norm(&pt), 25);
+    int a[4];
+    a[2] = 21;
+    assert_equals(twice(a, 2), 42);
+    int v = 1;
+    assert_equals(reload(&v, &v), 8);
+    int w = 0;
+    assert_equals(reload(&v, &w), 14);
+    counter = 5;
+    assert_equals(reload_global(), 11);
+    assert_equals(address_taken(), 10);
+    assert_equals(dominated(2, 3, 4), 20);
+    assert_equals(dominated(2, 3, -4), 0);
+    assert_equals(bytes(), 9);
+    counter = 3;
+    assert_equals(dead_return(), 4);
+    assert_equals(before_case(1), 5);
+    assert_equals(before_case(0), 3);
+    assert_equals(lagged_sum(), 60);
+    return 0;
+}
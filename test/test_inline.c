@@ -0,0 +1,68 @@
+static int square(int x) {
+    return x * x;
+}
+
+static inline int clamp(int x, int lo, int hi) {
+    if (x < lo)
+        return lo;
+    if (x > hi)
+        return hi;
+    return x;
+}
+
+int calls = 0;
+
+static void touch() {
+    calls++;
+}
+
+static char first(char *s) {
+    return s[0];
+}
+
+// a local of its own, next to the locals of the caller
+static int sum_to(int n) {
+    int sum = 0;
+    for (int i = 1; i <= n; i++)
+        sum = sum + i;
+    return sum;
+}
+
+int fact(int n) {
+    if (n <= 1)
+        return 1;
+    return n * fact(n - 1);
+}
+
+static int is_odd(int n);
+
+static int is_even(int n) {
+    if (n == 0)
+        return 1;
+    return is_odd(n - 1);
+}
+
+static int is_odd(int n) {
+    if (n == 0)
+        return 0;
+    return is_even(n - 1);
+}
+
+int main() {
+    int a = 3;
+    int b = 10;
+    assert_equals(square(a) + square(b), 109);
+    assert_equals(clamp(a, 5, 8), 5);
+    assert_equals(clamp(b, 5, 8), 8);
+    assert_equals(clamp(square(a) - 2, 5, 8), 7);
+    touch();
+    touch();
+    assert_equals(calls, 2);
+    assert_equals(first("xyz"), 'x');
+    assert_equals(sum_to(a) + a + b, 19);
+    assert_equals(sum_to(sum_to(3)), 21);
+    assert_equals(fact(5), 120);
+    assert_equals(is_even(10), 1);
+    assert_equals(is_odd(7), 1);
+    return 0;
+}
@@ -0,0 +1,107 @@
+int find(int *a, int n, int x) {
+    int i = 0;
+    while (i < n && a[i] != x)
+        i++;
+    return i;
+}
+
+// the loops nest, and continue and break leave them early
+int triangle(int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        if (i == 3)
+            continue;
+        for (int j = 0; j <= i; j++) {
+            if (j > 5)
+                break;
+            s = s + j;
+        }
+    }
+    return s;
+}
+
+int count_down(int n) {
+    int steps = 0;
+    do {
+        n = n / 2;
+        steps++;
+    } while (n > 0);
+    return steps;
+}
+
+// the error paths are expected not to be taken
+int checked_sum(int *a, int n) {
+    if (__builtin_expect(n < 0, 0))
+        return -1;
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        if (__builtin_expect(a[i] < 0, 0))
+            return -2;
+        s = s + a[i];
+    }
+    return s;
+}
+
+int clamp(int x) {
+    if (__builtin_expect(x >= 0 && x < 100, 1))
+        return x;
+    return !__builtin_expect(x < 0, 0) ? 99 : 0;
+}
+
+int calls;
+
+// keeps enough values live to take every register a call may overwrite
+int churn() {
+    int a = calls + 1;
+    int b = calls + 2;
+    int c = calls + 3;
+    int d = calls + 4;
+    int e = calls + 5;
+    int f = calls + 6;
+    int g = calls + 7;
+    calls++;
+    return (a * b + c * d + e * f + g) & 1;
+}
+
+// the inner loop, hotter than the block entering it, is laid out first, so
+// j is live from the call that starts its body
+int odd_rounds(int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        if (i % 2 == 0) {
+            s = s + 100;
+        } else {
+            for (int j = 0; j < 3; j++) {
+                int t = churn();
+                s = s + t + j;
+            }
+        }
+    }
+    return s;
+}
+
+int main() {
+    int a[6];
+    for (int i = 0; i < 6; i++)
+        a[i] = i * 3;
+    assert_equals(find(a, 6, 9), 3);
+    assert_equals(find(a, 6, 10), 6);
+    assert_equals(find(a, 0, 0), 0);
+    assert_equals(triangle(0), 0);
+    assert_equals(triangle(5), 14);
+    assert_equals(triangle(9), 74);
+    assert_equals(count_down(0), 1);
+    assert_equals(count_down(100), 7);
+    assert_equals(checked_sum(a, 6), 45);
+    assert_equals(checked_sum(a, -1), -1);
+    a[4] = -1;
+    assert_equals(checked_sum(a, 6), -2);
+    assert_equals(checked_sum(a, 4), 18);
+    assert_equals(clamp(42), 42);
+    assert_equals(clamp(-5), 0);
+    assert_equals(clamp(500), 99);
+    assert_equals(__builtin_expect(7, 7), 7);
+    calls = 0;
+    assert_equals(odd_rounds(6), 314);
+    return 0;
+}
@@ -0,0 +1,59 @@
+// leaf functions, which keep their locals below rsp without a frame
+
+int add3(int a, int b, int c) {
+    return a + b + c;
+}
+
+// the params trade places, which the moves out of the argument registers
+// have to get right
+int rotate(int a, int b, int c) {
+    int t = a;
+    a = b;
+    b = c;
+    c = t;
+    return a * 100 + b * 10 + c;
+}
+
+int sum_array() {
+    int xs[8];
+    for (int i = 0; i < 8; i++)
+        xs[i] = i * i;
+    int sum = 0;
+    for (int i = 0; i < 8; i++)
+        sum = sum + xs[i];
+    return sum;
+}
+
+// more values live at once than there are registers, so some are spilled
+int many(int a, int b) {
+    int c = a + b;
+    int d = a - b;
+    int e = a * b;
+    int f = c + d;
+    int g = d + e;
+    int h = e + f;
+    int i = f + g;
+    int j = g + h;
+    int k = h + i;
+    int l = i + j;
+    int m = j + k;
+    int n = k + l;
+    return a + b + c + d + e + f + g + h + i + j + k + l + m + n;
+}
+
+// too large for the red zone
+int big() {
+    int xs[64];
+    for (int i = 0; i < 64; i++)
+        xs[i] = i;
+    return xs[10] + xs[63];
+}
+
+int main() {
+    assert_equals(add3(1, 2, 3), 6);
+    assert_equals(rotate(1, 2, 3), 231);
+    assert_equals(sum_array(), 140);
+    assert_equals(many(3, 2), 232);
+    assert_equals(big(), 73);
+    return 0;
+}
@@ -0,0 +1,71 @@
+int g = 0;
+int step = 3;
+
+void bump() {
+    g++;
+}
+
+// n * k is computed once, and the loop still sees each new value of sum
+int invariant(int n, int k) {
+    int sum = 0;
+    for (int i = 0; i < n; i++)
+        sum = sum + n * k + i;
+    return sum;
+}
+
+// x is written through p in the loop
+int through_pointer(int n) {
+    int x = 1;
+    int *p = &x;
+    int sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum = sum + x * 2;
+        *p = *p + 1;
+    }
+    return sum;
+}
+
+// g is written by the call
+int through_call(int n) {
+    int sum = 0;
+    int i = 0;
+    while (i < n) {
+        sum = sum + g;
+        bump();
+        i++;
+    }
+    return sum;
+}
+
+// the division would fault if it ran before the check
+int guarded(int n, int d) {
+    int sum = 0;
+    for (int i = 0; i < n; i++)
+        if (d != 0)
+            sum = sum + 100 / d;
+    return sum;
+}
+
+int nested(int n) {
+    int sum = 0;
+    for (int i = 0; i < n; i++) {
+        int j = 0;
+        do {
+            sum = sum + step * n + i;
+            j++;
+        } while (j < n);
+    }
+    return sum;
+}
+
+int main() {
+    assert_equals(invariant(4, 5), 86);
+    assert_equals(invariant(0, 5), 0);
+    assert_equals(through_pointer(4), 20);
+    assert_equals(through_call(4), 6);
+    assert_equals(g, 4);
+    assert_equals(guarded(3, 0), 0);
+    assert_equals(guarded(3, 7), 42);
+    assert_equals(nested(3), 90);
+    return 0;
+}
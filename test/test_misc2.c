@@ -175,6 +175,21 @@ int main() {
 
     struct H *h = (void*)0;
 
+    {
+        int sh = 1;
+        {
+            int sh = 2;
+            for (int sh = 3; sh < 4; sh++)
+                assert_equals(sh, 3);
+            {
+                int sh = 4;
+                assert_equals(sh, 4);
+            }
+            assert_equals(sh, 2);
+        }
+        assert_equals(sh, 1);
+    }
+
     return 0;
 }
 
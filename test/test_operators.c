@@ -30,6 +30,19 @@ int main() {
     assert_equals(800 || 0, 1);
     assert_equals(0 || 0, 0);
 
+    {
+        char zero = 0;
+        char *zp = &zero;
+        assert_equals(1 && *zp, 0);
+        assert_equals(0 || *zp, 0);
+        assert_equals(*zp || 1, 1);
+
+        int ten = 10;
+        char one = 1;
+        assert_equals(ten + one, 11);
+        assert_equals(ten - one, 9);
+    }
+
     assert_equals(!12345, 0);
     assert_equals(!0, 1);
     assert_equals(!-389, 0);
@@ -0,0 +1,57 @@
+int calls = 0;
+
+int rare(int x) {
+    calls++;
+    return x * 3;
+}
+
+// the error path is cold, and the loop hot
+int sum_to(int n) {
+    if (n < 0)
+        return rare(n);
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        if (i % 100 == 99)
+            s = s - 1;
+        else
+            s = s + i;
+    }
+    return s;
+}
+
+// case 7 is taken almost always
+int kind(int c) {
+    switch (c) {
+    case 1:
+        return 10;
+    case 2:
+    case 3:
+        return 20;
+    case 7:
+        return 70;
+    case 9:
+        return 90;
+    case 12:
+        return 120;
+    default:
+        return -1;
+    }
+}
+
+int main() {
+    assert_equals(sum_to(1000), 494000);
+    assert_equals(sum_to(-2), -6);
+    assert_equals(calls, 1);
+
+    int total = 0;
+    for (int i = 0; i < 500; i++)
+        total = total + kind(7);
+    assert_equals(total, 35000);
+    assert_equals(kind(1), 10);
+    assert_equals(kind(3), 20);
+    assert_equals(kind(9), 90);
+    assert_equals(kind(12), 120);
+    assert_equals(kind(4), -1);
+    assert_equals(kind(-5), -1);
+    return 0;
+}
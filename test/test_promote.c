@@ -0,0 +1,56 @@
+int sum_to(int n) {
+    int sum = 0;
+    for (int i = 1; i <= n; i++)
+        sum = sum + i;
+    return sum;
+}
+
+// params are promoted like the other locals
+int countdown(int n, int step) {
+    int trips = 0;
+    while (n > 0) {
+        n = n - step;
+        trips++;
+    }
+    return trips;
+}
+
+// a char keeps wrapping around as it would in memory
+int wrap() {
+    char c = 120;
+    for (int i = 0; i < 10; i++)
+        c++;
+    return c;
+}
+
+// x stays in memory, as p points to it
+int address_taken() {
+    int x = 1;
+    int y = 10;
+    int *p = &x;
+    *p = 5;
+    y = y + x;
+    return y;
+}
+
+long widen(int n) {
+    long acc = 1;
+    for (int i = 0; i < n; i++)
+        acc = acc * 3;
+    return acc;
+}
+
+// a and b are never read, but are moved from their argument registers with c
+int last(int a, int b, int c) {
+    return c;
+}
+
+int main() {
+    assert_equals(sum_to(10), 55);
+    assert_equals(countdown(10, 3), 4);
+    assert_equals(wrap(), -126);
+    assert_equals(address_taken(), 15);
+    assert_equals(widen(4), 81);
+    assert_equals(last(1, 2, 3), 3);
+    return 0;
+}
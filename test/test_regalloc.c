@@ -0,0 +1,29 @@
+int weigh(int a, int b, int c, int d, int e, int f) {
+    return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f;
+}
+
+int add(int x, int y) {
+    return x + y;
+}
+
+// more values are live at once than there are registers
+int pressure(int x) {
+    return (x + 1) * ((x + 2) * ((x + 3) * ((x + 4) * ((x + 5) * ((x + 6) * ((x + 7)
+        - ((x + 8) - ((x + 9) - ((x + 10) - ((x + 11) - ((x + 12) - ((x + 13)
+        - (x + 14)))))))))))));
+}
+
+int main() {
+    int a = 1;
+    int b = 2;
+    assert_equals(weigh(a, b, 3, 4, 5, 6), 91);
+    assert_equals(weigh(6, 5, 4, 3, b, a), 56);
+
+    // values live across calls
+    assert_equals(a + add(a, b) * b + add(add(a, 3), add(b, 4)) - a, 16);
+    assert_equals(weigh(add(a, b), add(b, a), a, b, add(a, a), b), 42);
+
+    assert_equals(pressure(0), -2880);
+    assert_equals(pressure(1), -20160);
+    return 0;
+}
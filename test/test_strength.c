@@ -0,0 +1,72 @@
+// the divisors are read from variables to compare with idiv
+int d3 = 3;
+int d7 = 7;
+int d10 = 10;
+int d641 = 641;
+int dm6 = -6;
+int d8 = 8;
+int dm16 = -16;
+int d1000000007 = 1000000007;
+
+int check(int n) {
+    assert_equals(n / 3, n / d3);
+    assert_equals(n % 3, n % d3);
+    assert_equals(n / 7, n / d7);
+    assert_equals(n % 7, n % d7);
+    assert_equals(n / 10, n / d10);
+    assert_equals(n % 10, n % d10);
+    assert_equals(n / 641, n / d641);
+    assert_equals(n % 641, n % d641);
+    assert_equals(n / -6, n / dm6);
+    assert_equals(n % -6, n % dm6);
+    assert_equals(n / 8, n / d8);
+    assert_equals(n % 8, n % d8);
+    assert_equals(n / -16, n / dm16);
+    assert_equals(n % -16, n % dm16);
+    assert_equals(n / 1000000007, n / d1000000007);
+    assert_equals(n % 1000000007, n % d1000000007);
+    assert_equals(n / 1, n);
+    assert_equals(n % 1, 0);
+    return 0;
+}
+
+int scale(int x) {
+    assert_equals(x * 3, x * d3);
+    assert_equals(x * 10, x * d10);
+    assert_equals(x * 8, x * d8);
+    assert_equals(x * -16, x * dm16);
+    assert_equals(5 * x, x + x + x + x + x);
+    assert_equals(x * 9, x * d8 + x);
+    assert_equals(x * -1, -x);
+    return 0;
+}
+
+int main() {
+    check(0);
+    check(1);
+    check(-1);
+    check(6);
+    check(-6);
+    check(2147483647);
+    check(-2147483647 - 1);
+    for (int n = -2147483647; n < 2147483000; n = n + 9999991) {
+        check(n);
+        check(n / 1000);
+    }
+
+    scale(0);
+    scale(7);
+    scale(-123);
+
+    char *v[10];
+    char **p = &v[7];
+    char **q = &v[2];
+    assert_equals(p - q, 5);
+    assert_equals(q - p, -5);
+    int u[10];
+    int *i = &u[9];
+    int *j = &u[1];
+    assert_equals(i - j, 8);
+    assert_equals(j - i, -8);
+    return 0;
+}
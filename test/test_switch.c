@@ -0,0 +1,87 @@
+// dense: a jump table
+int dense(int x) {
+    switch (x) {
+    case 0: return 10;
+    case 1: return 11;
+    case 2:
+    case 3: return 12;
+    case 5: return 15;
+    case 6: return 16;
+    default: return -1;
+    }
+}
+
+// sparse: a binary search
+int sparse(int x) {
+    switch (x) {
+    case -1000: return 1;
+    case -7: return 2;
+    case 100: return 3;
+    case 5000: return 4;
+    case 70000: return 5;
+    case 2147483647: return 6;
+    case -2147483647 - 1: return 7;
+    }
+    return 0;
+}
+
+// few labels: a bit test
+int is_space(char c) {
+    switch (c) {
+    case 32: case 9: case 10: case 13:
+        return 1;
+    case 11: case 12:
+        return 2;
+    }
+    return 0;
+}
+
+// clusters of both kinds, with fallthrough and no default
+int mixed(int x) {
+    int r = 0;
+    switch (x) {
+    case 1: r = r + 1;
+    case 2: r = r + 2;
+    case 3: r = r + 3;
+    case 4:
+        r = r + 4;
+        break;
+    case 1000: r = 7;
+    case 1001: r = r + 1;
+    case 1002: r = r + 1;
+    case 1003: r = r + 1;
+    case 1004: r = r + 1;
+        break;
+    }
+    return r;
+}
+
+int main() {
+    assert_equals(dense(0), 10);
+    assert_equals(dense(3), 12);
+    assert_equals(dense(4), -1);
+    assert_equals(dense(6), 16);
+    assert_equals(dense(7), -1);
+    assert_equals(dense(-1), -1);
+    assert_equals(sparse(-1000), 1);
+    assert_equals(sparse(-7), 2);
+    assert_equals(sparse(100), 3);
+    assert_equals(sparse(5000), 4);
+    assert_equals(sparse(70000), 5);
+    assert_equals(sparse(2147483647), 6);
+    assert_equals(sparse(-2147483647 - 1), 7);
+    assert_equals(sparse(0), 0);
+    assert_equals(is_space(32), 1);
+    assert_equals(is_space(13), 1);
+    assert_equals(is_space(12), 2);
+    assert_equals(is_space(14), 0);
+    assert_equals(is_space(65), 0);
+    assert_equals(is_space(-9), 0);
+    assert_equals(mixed(1), 10);
+    assert_equals(mixed(3), 7);
+    assert_equals(mixed(5), 0);
+    assert_equals(mixed(1000), 11);
+    assert_equals(mixed(1003), 2);
+    assert_equals(mixed(999), 0);
+    return 0;
+}
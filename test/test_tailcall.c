@@ -0,0 +1,64 @@
+int sum(int n, int acc) {
+    if (n == 0)
+        return acc;
+    return sum(n - 1, acc + n);
+}
+
+// the arguments are swapped, so the params have to be assigned at once
+int gcd(int a, int b) {
+    if (b == 0)
+        return a;
+    return gcd(b, a % b);
+}
+
+int is_odd(int n);
+
+int is_even(int n) {
+    if (n == 0)
+        return 1;
+    return is_odd(n - 1);
+}
+
+int is_odd(int n) {
+    if (n == 0)
+        return 0;
+    return is_even(n - 1);
+}
+
+int count;
+
+void walk(int n) {
+    if (n == 0)
+        return;
+    count++;
+    walk(n - 1);
+}
+
+// a pointer into the frame is passed on, so the frame has to stay
+int deref(int *p, int n) {
+    if (n == 0)
+        return *p;
+    int x = *p + 1;
+    return deref(&x, n - 1);
+}
+
+// every arm is a tail call, leaving the join of the arms unreachable
+int pick(int c, int n) {
+    return c == 1 ? sum(n, 0) : c == 2 ? gcd(n, 6) : sum(n, 10);
+}
+
+int main() {
+    // deep enough to overflow the stack with a frame per call
+    assert_equals(sum(1000000, 0), 1784293664);
+    assert_equals(gcd(1071, 462), 21);
+    assert_equals(is_even(1000001), 0);
+    assert_equals(is_odd(1000001), 1);
+    walk(1000000);
+    assert_equals(count, 1000000);
+    int x = 5;
+    assert_equals(deref(&x, 10), 15);
+    assert_equals(pick(1, 4), 10);
+    assert_equals(pick(2, 4), 2);
+    assert_equals(pick(3, 4), 20);
+    return 0;
+}
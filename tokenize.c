@@ -1,36 +1,130 @@
 #include "ccatd.h"
 
-int loc_line = 1;
-int loc_column = 1;
-Vec *tokens;
+char *source;
 Vec *string_literals;
 
-void skip_column(char **p, int step) {
-    *p += step;
-    loc_column += step;
+// The token stream is stored as parallel arrays indexed by token number.
+// Numbers start from 1 so that 0 can stand for "no token"; slot 0 holds a
+// TK_EOF token placed at the end of the source.
+int num_tokens;
+Token_kind *token_kinds;
+int *token_vals; // value (TK_NUM, TK_CHAR), index of string_literals (TK_STRING) or name id
+int *token_locs; // source offset
+int *token_lens; // length in the source
+static int tokens_cap;
+
+// Identifiers and keywords are interned so that every occurrence of a
+// name shares one string.
+static Vec *names;
+static int *name_table; // open addressing; name id + 1, or 0 if empty
+static int name_table_size;
+
+// Character classes used by the scanning loops. A table lookup classifies a
+// byte with one load, instead of a call to isspace/isalpha/isdigit.
+typedef enum {
+    CC_SPACE = 1,
+    CC_DIGIT = 2,
+    CC_IDENT = 4  // letters, digits and '_'
+} Char_class;
+
+static char char_class[256];
+
+// source offsets of the beginnings of lines, built by the first diagnostic
+static int *line_starts;
+static int num_lines;
+
+static int name_hash(char *p, int len) {
+    int h = 0;
+    for (int i = 0; i < len; i++)
+        h = (h * 31 + p[i]) & 16777215;
+    return h;
 }
 
-void skip_line(char **p) {
-    (*p)++;
-    loc_line++;
-    loc_column = 1;
+static void name_table_insert(int id) {
+    char *name = vec_at(names, id);
+    int i = name_hash(name, strlen(name)) & (name_table_size - 1);
+    while (name_table[i])
+        i = (i + 1) & (name_table_size - 1);
+    name_table[i] = id + 1;
 }
 
-void skip_char(char **p, char ch) {
-    if (ch == '\n') skip_line(p);
-    else skip_column(p, 1);
+static int intern(char *p, int len) {
+    int i = name_hash(p, len) & (name_table_size - 1);
+    while (name_table[i]) {
+        char *name = vec_at(names, name_table[i] - 1);
+        if (!strncmp(name, p, len) && name[len] == '\0')
+            return name_table[i] - 1;
+        i = (i + 1) & (name_table_size - 1);
+    }
+
+    int id = vec_len(names);
+    vec_push(names, mkstr(p, len));
+    name_table[i] = id + 1;
+    if (2 * vec_len(names) > name_table_size) {
+        name_table_size *= 2;
+        name_table = calloc(name_table_size, sizeof(int));
+        for (int j = 0; j < vec_len(names); j++)
+            name_table_insert(j);
+    }
+    return id;
 }
 
-Token *new_token(Token_kind kind, char *str, int len) {
-    Token *tok = calloc(1, sizeof(Token));
-    tok->kind = kind;
-    tok->str = mkstr(str, len);
+// makes room for the tokens up to the token number n
+static void reserve_tokens(int n) {
+    if (n < tokens_cap)
+        return;
+    while (n >= tokens_cap)
+        tokens_cap *= 2;
+    token_kinds = realloc(token_kinds, tokens_cap * sizeof(Token_kind));
+    token_vals = realloc(token_vals, tokens_cap * sizeof(int));
+    token_locs = realloc(token_locs, tokens_cap * sizeof(int));
+    token_lens = realloc(token_lens, tokens_cap * sizeof(int));
+}
 
-    tok->loc = calloc(1, sizeof(Location));
-    tok->loc->line = loc_line;
-    tok->loc->column = loc_column;
+static void push_token(Token_kind kind, int val, char *start, int len) {
+    reserve_tokens(num_tokens + 1);
+    int tk = ++num_tokens;
+    token_kinds[tk] = kind;
+    token_vals[tk] = val;
+    token_locs[tk] = start - source;
+    token_lens[tk] = len;
+}
 
-    return tok;
+// the name of an identifier or a keyword, or the content of a string
+char *token_str(int tk) {
+    if (token_kinds[tk] == TK_STRING)
+        return vec_at(string_literals, token_vals[tk]);
+    return vec_at(names, token_vals[tk]);
+}
+
+// computes the line and the column of a source offset
+Location *location_of(int loc) {
+    if (line_starts == NULL) {
+        num_lines = 1;
+        for (char *p = source; *p; p++)
+            if (*p == '\n')
+                num_lines++;
+        line_starts = calloc(num_lines, sizeof(int));
+        int n = 1;
+        for (int i = 0; source[i]; i++)
+            if (source[i] == '\n')
+                line_starts[n++] = i + 1;
+    }
+
+    int lo = 0;
+    int hi = num_lines - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (line_starts[mid] <= loc)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    Location *l = calloc(1, sizeof(Location));
+    l->line = lo + 1;
+    l->column = loc - line_starts[lo] + 1;
+    return l;
 }
 
 char *ops[46] = {
@@ -45,151 +139,338 @@ char *ops[46] = {
 char *mem_op(char *p) {
     int ops_len = sizeof(ops) / sizeof(char*);
 
-    int plen = strlen(p);
     for (int i = 0; i < ops_len; i++) {
+        if (*p != ops[i][0])
+            continue;
         int ilen = strlen(ops[i]);
-        if (plen >= ilen && !strncmp(p, ops[i], ilen))
+        if (!strncmp(p, ops[i], ilen))
             return ops[i];
     }
     return NULL;
 }
 
-char *kwds[17] = {
+char *kwds[18] = {
     "return", "if", "else", "while", "for", "typedef", "sizeof", "struct", "do",
-    "break", "continue", "extern", "static", "switch", "case", "default", "enum"
+    "break", "continue", "extern", "static", "switch", "case", "default", "enum",
+    "inline"
 };
 
-Token *mem_kwd(char *p, int len) {
-    int kwds_len = sizeof(kwds) / sizeof(char*);
-
-    for (int i = 0; i < kwds_len; i++) {
-        int ilen = strlen(kwds[i]);
-        if (len == ilen && !strncmp(p, kwds[i], ilen))
-            return new_token(TK_KWD, p, ilen);
+static void init_char_class() {
+    for (int c = 0; c < 256; c++) {
+        char_class[c] = 0;
+        if (c == ' ' || (9 <= c && c <= 13))
+            char_class[c] = CC_SPACE;
+        if (isdigit(c))
+            char_class[c] = CC_DIGIT | CC_IDENT;
+        if (isalpha(c) || c == '_')
+            char_class[c] = CC_IDENT;
     }
-    return NULL;
 }
 
-void tokenize(char *p) {
-    loc_line = 1;
-    loc_column = 1;
+// Scans a string literal at p, together with the literals adjacent to it,
+// and returns the end of them. The content is appended to sb unless it is
+// NULL.
+static char *scan_string(char *p, StringBuilder *sb) {
+    char *start = p;
+    while (*p && *p == '"') {
+        p++; // '"'
+        while (*p && *p != '"') {
+            int run = strcspn(p, "\"\\");
+            if (run > 0) {
+                if (sb)
+                    strbld_append_mem(sb, p, run);
+                p += run;
+            } else if (*(p+1) && *p == '\\') {
+                p++; // '\\'
+                char escaped = *p == 'n' ? '\n'
+                             : *p == 'r' ? '\r'
+                             : *p == '0' ? '\0'
+                             : *p == '"' ? '"'
+                             : *p;
+                if (sb)
+                    strbld_append(sb, escaped);
+                p++;
+            } else {
+                if (sb)
+                    strbld_append(sb, *p);
+                p++;
+            }
+        }
+        if (*p) {
+            p++; // '"'
+            while (char_class[*p & 255] & CC_SPACE)
+                p++;
+        }
+    }
 
-    tokens = vec_new();
+    if (!*p)
+        error_loc(start - source, "[parse] Closing double quote \"\\\"\" expected");
+    return p;
+}
 
-    while (*p) {
-        if (isspace(*p)) {
-            skip_char(&p, *p);
+// Lexes the source from p to end. Names and string contents are left to
+// resolve_tokens(), so that this can run in a worker process.
+static void lex(char *p, char *end) {
+    while (p < end) {
+        if (char_class[*p & 255] & CC_SPACE) {
+            p++;
+            while (char_class[*p & 255] & CC_SPACE)
+                p++;
             continue;
         }
 
-        if (!strncmp(p, "//", 2)) {
-            while (*p != '\n') skip_column(&p, 1);
-            skip_line(&p);
+        if (*p == '/' && *(p+1) == '/') {
+            char *nl = strchr(p, '\n');
+            if (nl)
+                p = nl + 1;
+            else
+                p += strlen(p);
             continue;
         }
 
-        if (!strncmp(p, "/*", 2)) {
-            skip_column(&p, 2);
-            while (*p && strncmp(p, "*/", 2))
-                skip_char(&p, *p);
-            if (!*p)
-                error_loc2(loc_line, loc_column, "Closing comment \"*/\" expected");
+        if (*p == '/' && *(p+1) == '*') {
+            char *close = strstr(p + 2, "*/");
+            if (!close)
+                error_loc(p - source, "Closing comment \"*/\" expected");
 
-            skip_column(&p, 2); // "*/"
+            p = close + 2; // "*/"
             continue;
         }
 
         if (*p == '"') {
-            StringBuilder *sb = strbld_new();
-            while (*p && *p == '"') {
-                skip_column(&p, 1); // '"'
-                while (*p && *p != '"') {
-                    if (*(p+1) && *p == '\\') {
-                        skip_column(&p, 1); // '\\'
-                        char escaped = *p == 'n' ? '\n'
-                                     : *p == 'r' ? '\r'
-                                     : *p == '0' ? '\0'
-                                     : *p == '"' ? '"'
-                                     : *p;
-                        strbld_append(sb, escaped);
-                        skip_char(&p, *p);
-                    } else {
-                        strbld_append(sb, *p);
-                        skip_char(&p, *p);
-                    }
-                }
-                if (*p) {
-                    skip_column(&p, 1); // '"'
-                    while (isspace(*p))
-                        skip_char(&p, *p);
-                }
-            }
-
-            if (!*p)
-                error_loc2(loc_line, loc_column, "[parse] Closing double quote \"\\\"\" expected");
-
-            char *content = strbld_build(sb);
-            int len = strlen(content);
-            vec_push(string_literals, content);
-            vec_push(tokens, new_token(TK_STRING, content, len));
+            char *start = p;
+            p = scan_string(p, NULL);
+            push_token(TK_STRING, -1, start, p - start);
             continue;
         }
 
         if (*p == '\'') {
-            Token *tk = new_token(TK_CHAR, NULL, 0);
-            skip_column(&p, 1); // '\''
+            char *start = p;
+            int val = 0;
+            p++; // '\''
             if (*(p+1) && *p == '\\') {
-                skip_column(&p, 1); // '\\'
-                tk->val = *p == 'n' ? '\n'
-                        : *p == 'r' ? '\r'
-                        : *p == '0' ? '\0'
-                        : *p == '\'' ? '\''
-                        : *p;
-            } else if (*p) tk->val = *p;
-            else error_loc2(loc_line, loc_column, "[parse] unsupported character");
-
-            skip_char(&p, *p); // content
+                p++; // '\\'
+                val = *p == 'n' ? '\n'
+                    : *p == 'r' ? '\r'
+                    : *p == '0' ? '\0'
+                    : *p == '\'' ? '\''
+                    : *p;
+            } else if (*p) val = *p;
+            else error_loc(p - source, "[parse] unsupported character");
+
+            p++; // content
             if (*p != '\'')
-                error_loc2(loc_line, loc_column, "[parse] Closing single quote \"'\" expected");
-            skip_char(&p, *p); // '\''
-            vec_push(tokens, tk);
+                error_loc(p - source, "[parse] Closing single quote \"'\" expected");
+            p++; // '\''
+            push_token(TK_CHAR, val, start, p - start);
+            continue;
+        }
+
+        if (char_class[*p & 255] & CC_DIGIT) {
+            char *q = p;
+            int val = strtol(q, &q, 10);
+            push_token(TK_NUM, val, p, q - p);
+            p = q;
+            continue;
+        }
+
+        if (char_class[*p & 255] & CC_IDENT) {
+            char *q = p + 1;
+            while (char_class[*q & 255] & CC_IDENT)
+                q++;
+            push_token(TK_IDT, -1, p, q - p);
+            p = q;
             continue;
         }
 
         char* op = mem_op(p);
         if (op != NULL) {
             int tlen = strlen(op);
-            Token *token = new_token(TK_KWD, p, tlen);
-            vec_push(tokens, token);
-            skip_column(&p, tlen);
+            push_token(TK_KWD, -1, p, tlen);
+            p += tlen;
             continue;
         }
 
-        if (isdigit(*p)) {
-            Token *tk = new_token(TK_NUM, p, 0);
+        error_loc(p - source, "an unknown character was found: %d", *p);
+    }
+}
+
+// Interns the names of identifiers and keywords and builds the contents of
+// string literals, in the order of the tokens.
+static void resolve_tokens() {
+    int kwds_len = sizeof(kwds) / sizeof(char*);
+
+    for (int tk = 1; tk <= num_tokens; tk++) {
+        Token_kind kind = token_kinds[tk];
+        if (kind == TK_STRING) {
+            StringBuilder *sb = strbld_new();
+            scan_string(source + token_locs[tk], sb);
+            vec_push(string_literals, strbld_build(sb));
+            token_vals[tk] = vec_len(string_literals) - 1;
+        } else if (kind == TK_KWD || kind == TK_IDT) {
+            int id = intern(source + token_locs[tk], token_lens[tk]);
+            token_vals[tk] = id;
+            if (id < kwds_len)
+                token_kinds[tk] = TK_KWD;
+        }
+    }
+}
+
+// Parallel tokenization
+//
+// A large source is split into chunks at newlines outside comments and
+// literals. Each chunk but the first is lexed by a forked process into a
+// shared mapping, which has room for one token per character; the parent
+// lexes the first chunk meanwhile and then appends the others. Token
+// locations are offsets into the whole source, so nothing is renumbered.
+
+int tokenize_jobs;
+static int tokenize_chunk_min = 1048576;
+
+// Finds the boundaries of at most n chunks of about the same length. A
+// newline followed by a string literal is not used, since adjacent literals
+// are merged into one token. Returns the number of chunks.
+static int split_source(int *bounds, int n, int len) {
+    int target = len / n;
+    int nchunks = 1;
+    bounds[0] = 0;
+
+    char *p = source;
+    while (*p && nchunks < n) {
+        p += strcspn(p, "\n/\"'");
+        if (*p == '\n') {
+            p++;
             char *q = p;
-            tk->val = strtol(q, &q, 10);
-            vec_push(tokens, tk);
-            skip_column(&p, (q - p));
-            continue;
+            while (char_class[*q & 255] & CC_SPACE)
+                q++;
+            if (p - source >= target * nchunks && *q && *q != '"')
+                bounds[nchunks++] = p - source;
+        } else if (*p == '/' && *(p+1) == '/') {
+            p = strchr(p, '\n');
+            if (!p)
+                break;
+        } else if (*p == '/' && *(p+1) == '*') {
+            p = strstr(p + 2, "*/");
+            if (!p)
+                break; // reported by the lexer
+            p += 2;
+        } else if (*p == '"' || *p == '\'') {
+            char quote = *p;
+            p++;
+            while (*p && *p != quote) {
+                if (*(p+1) && *p == '\\')
+                    p++;
+                p++;
+            }
+            if (*p)
+                p++;
+        } else if (*p) {
+            p++; // '/'
         }
+    }
 
-        char *q = p;
-        while (isalpha(*q) || isdigit(*q) || *q == '_') q++;
-        int len = q - p;
-        Token *kwd = mem_kwd(p, len);
-        if (kwd != NULL) {
-            vec_push(tokens, kwd);
-            skip_column(&p, len);
-            continue;
+    bounds[nchunks] = len;
+    return nchunks;
+}
+
+static void tokenize_parallel(int *bounds, int nchunks) {
+    int **chunks = calloc(nchunks, sizeof(int*));
+    int *sizes = calloc(nchunks, sizeof(int));
+    int *pids = calloc(nchunks, sizeof(int));
+
+    for (int i = 1; i < nchunks; i++) {
+        // the count of tokens, then four arrays indexed by token number
+        int cap = bounds[i + 1] - bounds[i] + 1;
+        sizes[i] = (4 * cap + 1) * sizeof(int);
+        chunks[i] = mmap(NULL, sizes[i], PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (chunks[i] == MAP_FAILED)
+            error("mmap: %s", strerror(errno));
+
+        pids[i] = fork();
+        if (pids[i] == -1)
+            error("fork: %s", strerror(errno));
+        if (pids[i] == 0) {
+            int *chunk = chunks[i];
+            num_tokens = 0;
+            tokens_cap = cap;
+            token_kinds = (Token_kind *)(chunk + 1);
+            token_vals = chunk + 1 + cap;
+            token_locs = chunk + 1 + 2 * cap;
+            token_lens = chunk + 1 + 3 * cap;
+            lex(source + bounds[i], source + bounds[i + 1]);
+            chunk[0] = num_tokens;
+            exit(0);
         }
+    }
 
-        if (len > 0) {
-            vec_push(tokens, new_token(TK_IDT, p, q - p));
-            skip_column(&p, q - p);
-            continue;
+    lex(source, source + bounds[1]);
+
+    bool failed = false;
+    for (int i = 1; i < nchunks; i++) {
+        int status = 0;
+        if (waitpid(pids[i], &status, 0) == -1 || status != 0)
+            failed = true;
+    }
+    if (failed)
+        exit(1);
+
+    for (int i = 1; i < nchunks; i++) {
+        int *chunk = chunks[i];
+        int count = chunk[0];
+        int cap = bounds[i + 1] - bounds[i] + 1;
+        reserve_tokens(num_tokens + count);
+        for (int j = 1; j <= count; j++) {
+            int tk = ++num_tokens;
+            token_kinds[tk] = chunk[1 + j];
+            token_vals[tk] = chunk[1 + cap + j];
+            token_locs[tk] = chunk[1 + 2 * cap + j];
+            token_lens[tk] = chunk[1 + 3 * cap + j];
         }
+        munmap(chunk, sizes[i]);
+    }
+}
 
-        error_loc2(loc_line, loc_column, "an unknown character was found: %d", *p);
+void tokenize(char *p) {
+    source = p;
+    num_tokens = 0;
+    tokens_cap = 1024;
+    token_kinds = calloc(tokens_cap, sizeof(Token_kind));
+    token_vals = calloc(tokens_cap, sizeof(int));
+    token_locs = calloc(tokens_cap, sizeof(int));
+    token_lens = calloc(tokens_cap, sizeof(int));
+
+    names = vec_new();
+    name_table_size = 1024;
+    name_table = calloc(name_table_size, sizeof(int));
+
+    // keywords are interned first, so that their name ids are 0..kwds_len-1
+    int kwds_len = sizeof(kwds) / sizeof(char*);
+    for (int i = 0; i < kwds_len; i++)
+        intern(kwds[i], strlen(kwds[i]));
+
+    init_char_class();
+
+    int len = strlen(p);
+    int jobs = tokenize_jobs;
+    if (jobs == 0) {
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+        if (jobs > len / tokenize_chunk_min)
+            jobs = len / tokenize_chunk_min;
     }
+
+    int nchunks = 1;
+    int *bounds = NULL;
+    if (jobs > 1) {
+        bounds = calloc(jobs + 1, sizeof(int));
+        nchunks = split_source(bounds, jobs, len);
+    }
+
+    if (nchunks > 1)
+        tokenize_parallel(bounds, nchunks);
+    else
+        lex(p, p + len);
+    resolve_tokens();
+
+    token_kinds[0] = TK_EOF;
+    token_locs[0] = len;
 }
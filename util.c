@@ -10,19 +10,11 @@ void error(char *fmt, ...) {
     exit(1);
 }
 
-void error_loc(Location *loc, char *fmt, ...) {
+void error_loc(int loc, char *fmt, ...) {
     va_list ap;
     va_start(ap, fmt);
-    fprintf(stderr, "[l:%d,c:%d] ", loc->line, loc->column);
-    vfprintf(stderr, fmt, ap);
-    fprintf(stderr, "\n");
-    exit(1);
-}
-
-void error_loc2(int line, int col, char *fmt, ...) {
-    va_list ap;
-    va_start(ap, fmt);
-    fprintf(stderr, "[l:%d,c:%d] ", line, col);
+    Location *l = location_of(loc);
+    fprintf(stderr, "[l:%d,c:%d] ", l->line, l->column);
     vfprintf(stderr, fmt, ap);
     fprintf(stderr, "\n");
     exit(1);
@@ -0,0 +1,550 @@
+#include "ccatd.h"
+
+// Lowering of the IR into x86-64 assembly.
+//
+// Virtual registers live where reg_alloc() put them: in a general-purpose
+// register, or in an 8-byte stack slot below the local variables. rax, rcx
+// and rdx are the scratch registers of the instruction patterns.
+//
+// A leaf function, one calling nothing, whose locals, slots and saved
+// registers fit in the 128 bytes below rsp doesn't set up a frame. They are
+// addressed from rsp instead of rbp, in the red zone, which the System V ABI
+// keeps from being overwritten by signal handlers.
+
+static char *regs64[16] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+static char *regs32[16] = {
+    "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+    "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
+};
+static char *regs8[16] = {
+    "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"
+};
+
+static Reg arg_regs[6] = {RDI, RSI, RDX, RCX, R8, R9};
+
+static IRFunc *ir;
+static BB *next_bb;   // the block following the current one in the output
+static Vec *saved;    // the callee-saved registers in use
+static char *fp;      // the register the frame is addressed from
+static int *num_uses; // the number of reads of each virtual register
+
+bool omit_frame_pointer = true;
+
+static char *reg(Reg r, int size) {
+    if (size == 1)
+        return regs8[r];
+    if (size == 4)
+        return regs32[r];
+    return regs64[r];
+}
+
+static char *ptr_size(int size) {
+    return size == 1 ? "BYTE"
+         : size == 4 ? "DWORD"
+         : "QWORD";
+}
+
+static bool in_reg(int v) {
+    return ir->regs[v] >= 0;
+}
+
+static int slot_offset(int slot) {
+    return ir->frame + 8 * (slot + 1);
+}
+
+// the operand of a virtual register accessed as `size' bytes
+static char *opnd(int v, int size) {
+    if (in_reg(v))
+        return reg(ir->regs[v], size);
+    char *buf = calloc(40, sizeof(char));
+    sprintf(buf, "%s PTR [%s-%d]", ptr_size(size), fp, slot_offset(ir->slots[v]));
+    return buf;
+}
+
+static void load(Reg r, int v, int size) {
+    emitf("  mov %s, %s\n", reg(r, size), opnd(v, size));
+}
+
+static void store(int v, Reg r, int size) {
+    emitf("  mov %s, %s\n", opnd(v, size), reg(r, size));
+}
+
+// dst = src
+static void copy(int dst, int src, int size) {
+    if (in_reg(dst) && ir->regs[dst] == ir->regs[src])
+        return;
+    if (!in_reg(dst) && !in_reg(src)) {
+        load(RAX, src, size);
+        store(dst, RAX, size);
+        return;
+    }
+    emitf("  mov %s, %s\n", opnd(dst, size), opnd(src, size));
+}
+
+// the register holding v, loading it into r first if v is spilled
+static Reg use_reg(int v, Reg r, int size) {
+    if (in_reg(v))
+        return ir->regs[v];
+    load(r, v, size);
+    return r;
+}
+
+// the register to compute the value of v in: its own one, or r if spilled
+static Reg def_reg(int v, Reg r) {
+    return in_reg(v) ? ir->regs[v] : r;
+}
+
+// stores the value computed by def_reg()
+static void def_done(int v, Reg r, int size) {
+    if (!in_reg(v))
+        store(v, r, size);
+}
+
+// performs the 8-byte moves dsts[i] = srcs[i] as if they were all done at
+// once. A move is made once no other move left reads its destination; if the
+// moves left form cycles, the value of a destination is set aside in rax,
+// which none of them reads or writes.
+static void parallel_move(char **dsts, char **srcs, int n) {
+    bool *done = calloc(n + 1, sizeof(bool));
+    int left = n;
+    while (left > 0) {
+        bool progress = false;
+        for (int i = 0; i < n; i++) {
+            if (done[i])
+                continue;
+            bool blocked = false;
+            for (int j = 0; j < n; j++)
+                if (j != i && !done[j] && !strcmp(srcs[j], dsts[i]))
+                    blocked = true;
+            if (blocked)
+                continue;
+            if (strcmp(dsts[i], srcs[i]))
+                emitf("  mov %s, %s\n", dsts[i], srcs[i]);
+            done[i] = true;
+            left--;
+            progress = true;
+        }
+        if (progress)
+            continue;
+
+        int k = 0;
+        while (done[k])
+            k++;
+        emitf("  mov rax, %s\n", dsts[k]);
+        for (int j = 0; j < n; j++)
+            if (!done[j] && !strcmp(srcs[j], dsts[k]))
+                srcs[j] = "rax";
+    }
+}
+
+// the memory operand of a load or store, loading its registers into rax and
+// rdx first if they are spilled
+static char *address(Inst *inst) {
+    char *buf = calloc((inst->name ? strlen(inst->name) : 0) + 60, sizeof(char));
+    char *disp = calloc(20, sizeof(char));
+    if (inst->imm)
+        sprintf(disp, inst->imm > 0 ? "+%d" : "%d", inst->imm);
+
+    if (inst->a == 0 && inst->name != NULL) {
+        sprintf(buf, "%s%s[rip]", inst->name, disp);
+        return buf;
+    }
+    char *base = fp;
+    if (inst->a)
+        base = regs64[use_reg(inst->a, RAX, 8)];
+    if (inst->index) {
+        Reg index = use_reg(inst->index, RDX, 8);
+        sprintf(buf, "[%s+%s*%d%s]", base, regs64[index], inst->scale, disp);
+    } else {
+        sprintf(buf, "[%s%s]", base, disp);
+    }
+    return buf;
+}
+
+static char *label(BB *bb) {
+    char *buf = calloc(strlen(ir->func->name) + 20, sizeof(char));
+    sprintf(buf, ".L%s_bb%d", ir->func->name, bb->id);
+    return buf;
+}
+
+static void jump_to(BB *bb) {
+    if (bb != next_bb)
+        emitf("  jmp %s\n", label(bb));
+}
+
+static char *cmp_suffix(Inst_kind kind) {
+    return kind == IR_EQ ? "e"
+         : kind == IR_NE ? "ne"
+         : kind == IR_LT ? "l"
+         : "le";
+}
+
+// the condition code of the opposite comparison
+static char *negated_suffix(Inst_kind kind) {
+    return kind == IR_EQ ? "ne"
+         : kind == IR_NE ? "e"
+         : kind == IR_LT ? "ge"
+         : "g";
+}
+
+static char *arith_mnemonic(Inst_kind kind) {
+    return kind == IR_ADD ? "add"
+         : kind == IR_SUB ? "sub"
+         : kind == IR_MUL ? "imul"
+         : kind == IR_AND ? "and"
+         : kind == IR_OR ? "or"
+         : kind == IR_SHL ? "shl"
+         : kind == IR_SHR ? "shr"
+         : kind == IR_SAR ? "sar"
+         : "xor";
+}
+
+static void gen_args(Inst *inst) {
+    int n = inst->nargs;
+    char **dsts = calloc(n + 1, sizeof(char *));
+    char **srcs = calloc(n + 1, sizeof(char *));
+    for (int i = 0; i < n; i++) {
+        dsts[i] = regs64[arg_regs[i]];
+        srcs[i] = opnd(inst->args[i], 8);
+    }
+    parallel_move(dsts, srcs, n);
+
+    if (inst->imm) // the number of vector registers used by a variadic call
+        emitf("  mov eax, 0\n");
+}
+
+static void gen_call(Inst *inst) {
+    if (profile_generate)
+        profile_call(inst);
+    gen_args(inst);
+    emitf("  call %s\n", inst->name);
+    if (inst->dst)
+        store(inst->dst, RAX, inst->size);
+}
+
+// restores the registers of the caller and pops the frame
+static void gen_epilogue() {
+    for (int i = 0; i < vec_len(saved); i++) {
+        char *r = vec_at(saved, i);
+        emitf("  mov %s, [%s-%d]\n", r, fp, slot_offset(ir->num_slots + i));
+    }
+    if (!strcmp(fp, "rbp"))
+        emitf("  mov rsp, rbp\n"
+               "  pop rbp\n");
+}
+
+// the arguments are passed in registers, which the epilogue leaves alone, so
+// the callee can take over the frame and return to the caller of this
+// function
+static void gen_tail_call(Inst *inst) {
+    if (profile_generate)
+        profile_call(inst);
+    gen_args(inst);
+    gen_epilogue();
+    emitf("  jmp %s\n", inst->name);
+}
+
+// the leading PARAMs of the entry block take the argument registers all at
+// once, as one of them may be allocated to the register of another
+static int gen_params(BB *entry) {
+    int n = 0;
+    while (n < vec_len(entry->insts) && ((Inst *)vec_at(entry->insts, n))->kind == IR_PARAM)
+        n++;
+
+    char **dsts = calloc(n + 1, sizeof(char *));
+    char **srcs = calloc(n + 1, sizeof(char *));
+    for (int i = 0; i < n; i++) {
+        Inst *inst = vec_at(entry->insts, i);
+        dsts[i] = opnd(inst->dst, 8);
+        srcs[i] = regs64[arg_regs[inst->imm]];
+    }
+    parallel_move(dsts, srcs, n);
+    return n;
+}
+
+// jumps to the then block of br if the flags satisfy the condition code cc,
+// whose opposite is ncc, and to its else block otherwise
+static void gen_jcc(Inst *br, char *cc, char *ncc) {
+    if (br->then == next_bb) {
+        emitf("  j%s %s\n", ncc, label(br->els));
+    } else {
+        emitf("  j%s %s\n", cc, label(br->then));
+        jump_to(br->els);
+    }
+}
+
+static bool is_compare(Inst *inst) {
+    Inst_kind k = inst->kind;
+    return k == IR_EQ || k == IR_NE || k == IR_LT || k == IR_LE;
+}
+
+// branches on the flags of cmp, whose value is read only by br
+static void gen_fused_branch(Inst *cmp, Inst *br) {
+    int size = cmp->size;
+    Reg lhs = use_reg(cmp->a, RAX, size);
+    emitf("  cmp %s, %s\n", reg(lhs, size), opnd(cmp->b, size));
+    gen_jcc(br, cmp_suffix(cmp->kind), negated_suffix(cmp->kind));
+}
+
+static void gen_inst(Inst *inst) {
+    int size = inst->size;
+    switch (inst->kind) {
+    case IR_IMM:
+        emitf("  mov %s, %d\n", opnd(inst->dst, size), inst->imm);
+        return;
+    case IR_MOV:
+        copy(inst->dst, inst->a, size);
+        return;
+    case IR_PARAM:
+        error("[x86] %s: a parameter not at the start of the function", ir->func->name);
+        return;
+    case IR_LADDR: {
+        Reg d = def_reg(inst->dst, RAX);
+        emitf("  lea %s, [%s-%d]\n", regs64[d], fp, inst->imm);
+        def_done(inst->dst, d, 8);
+        return;
+    }
+    case IR_GADDR: {
+        Reg d = def_reg(inst->dst, RAX);
+        emitf("  lea %s, %s[rip]\n", regs64[d], inst->name);
+        def_done(inst->dst, d, 8);
+        return;
+    }
+    case IR_LOAD: {
+        char *addr = address(inst);
+        Reg d = def_reg(inst->dst, RAX);
+        if (size == 1)
+            emitf("  movsx %s, BYTE PTR %s\n", regs32[d], addr);
+        else
+            emitf("  mov %s, %s PTR %s\n", reg(d, size), ptr_size(size), addr);
+        def_done(inst->dst, d, size == 8 ? 8 : 4);
+        return;
+    }
+    case IR_STORE: {
+        char *addr = address(inst);
+        Reg val = use_reg(inst->b, RCX, size == 8 ? 8 : 4);
+        emitf("  mov %s PTR %s, %s\n", ptr_size(size), addr, reg(val, size));
+        return;
+    }
+    case IR_ADD: case IR_SUB: case IR_MUL:
+    case IR_AND: case IR_OR: case IR_XOR: {
+        // the destination can't be written before b is read
+        Reg d = in_reg(inst->dst) && ir->regs[inst->dst] != ir->regs[inst->b] ? ir->regs[inst->dst] : RAX;
+        if (!in_reg(inst->a) || ir->regs[inst->a] != d)
+            emitf("  mov %s, %s\n", reg(d, size), opnd(inst->a, size));
+        emitf("  %s %s, %s\n", arith_mnemonic(inst->kind), reg(d, size), opnd(inst->b, size));
+        if (d == RAX)
+            store(inst->dst, RAX, size);
+        return;
+    }
+    case IR_DIV: case IR_MOD:
+        load(RAX, inst->a, size);
+        emitf(size == 8 ? "  cqo\n" : "  cdq\n");
+        emitf("  idiv %s\n", opnd(inst->b, size));
+        store(inst->dst, inst->kind == IR_DIV ? RAX : RDX, size);
+        return;
+    case IR_MULH:
+        load(RAX, inst->a, size);
+        emitf("  imul %s\n", opnd(inst->b, size));
+        store(inst->dst, RDX, size);
+        return;
+    case IR_SHL: case IR_SHR: case IR_SAR: {
+        load(RCX, inst->b, 4);
+        Reg d = def_reg(inst->dst, RAX);
+        if (!in_reg(inst->a) || ir->regs[inst->a] != d)
+            emitf("  mov %s, %s\n", reg(d, size), opnd(inst->a, size));
+        emitf("  %s %s, cl\n", arith_mnemonic(inst->kind), reg(d, size));
+        def_done(inst->dst, d, size);
+        return;
+    }
+    case IR_EQ: case IR_NE: case IR_LT: case IR_LE: {
+        Reg lhs = use_reg(inst->a, RAX, size);
+        emitf("  cmp %s, %s\n", reg(lhs, size), opnd(inst->b, size));
+        Reg d = def_reg(inst->dst, RAX);
+        emitf("  set%s %s\n", cmp_suffix(inst->kind), regs8[d]);
+        emitf("  movzx %s, %s\n", regs32[d], regs8[d]);
+        def_done(inst->dst, d, 4);
+        return;
+    }
+    case IR_NOT: {
+        Reg d = def_reg(inst->dst, RAX);
+        if (!in_reg(inst->a) || ir->regs[inst->a] != d)
+            emitf("  mov %s, %s\n", reg(d, size), opnd(inst->a, size));
+        emitf("  not %s\n", reg(d, size));
+        def_done(inst->dst, d, size);
+        return;
+    }
+    case IR_SEXT: {
+        Reg d = def_reg(inst->dst, RAX);
+        emitf("  %s %s, %s\n", inst->imm == 4 ? "movsxd" : "movsx",
+               reg(d, size), opnd(inst->a, inst->imm));
+        def_done(inst->dst, d, size);
+        return;
+    }
+    case IR_CALL:
+        gen_call(inst);
+        return;
+    case IR_VASTART: {
+        // the frame of the variadic function is laid out as in gen_func()
+        Reg ap = use_reg(inst->a, RAX, 8);
+        char *p = regs64[ap];
+        emitf("  mov rcx, [rbp]\n");
+        emitf("  add rcx, QWORD PTR [rcx-8]\n");
+        emitf("  sub rcx, 56\n");
+        emitf("  mov DWORD PTR [%s], 48\n", p); // gp_offset
+        emitf("  mov DWORD PTR [%s+4], 304\n", p); // fp_offset
+        emitf("  mov QWORD PTR [%s+8], rcx\n", p); // overflow_arg_area
+        emitf("  mov QWORD PTR [%s+16], 0\n", p); // reg_save_area
+        return;
+    }
+    case IR_JMP:
+        jump_to(inst->then);
+        return;
+    case IR_BR:
+        emitf("  cmp %s, 0\n", opnd(inst->a, size));
+        gen_jcc(inst, "ne", "e");
+        return;
+    case IR_SWITCH: {
+        Reg v = use_reg(inst->a, RAX, 4);
+        int n = vec_len(inst->targets);
+        char **labels = calloc(n + 1, sizeof(char *));
+        for (int i = 0; i < n; i++)
+            labels[i] = label(vec_at(inst->targets, i));
+        char *dflt = label(inst->els);
+        int *weights = NULL;
+        if (ir->freq) {
+            weights = calloc(n + 1, sizeof(int));
+            for (int i = 0; i < n; i++)
+                weights[i] = ir->freq[((BB *)vec_at(inst->targets, i))->id];
+            weights[n] = ir->freq[inst->els->id];
+        }
+        gen_switch_dispatch(regs32[v], inst->cases, labels, n, dflt, weights);
+        jump_to(inst->els);
+        return;
+    }
+    case IR_RET:
+        if (inst->a)
+            load(RAX, inst->a, size);
+        if (next_bb != NULL)
+            emitf("  jmp .L%s_return\n", ir->func->name);
+        return;
+    }
+}
+
+static bool is_leaf() {
+    if (ir->func->is_varargs)
+        return false;
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            if (inst->kind == IR_CALL)
+                return false;
+        }
+    }
+    return true;
+}
+
+// the blocks branched to from below, which start the loops in the output
+static bool *loop_tops() {
+    bool *tops = calloc(ir->num_bbs, sizeof(bool));
+    int *pos = block_index(ir);
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        for (int j = 0; j < bb_num_succs(bb); j++)
+            if (pos[bb_succ(bb, j)->id] <= i)
+                tops[bb_succ(bb, j)->id] = true;
+    }
+    return tops;
+}
+
+static void count_uses() {
+    num_uses = calloc(ir->num_vregs + 1, sizeof(int));
+    int uses[6];
+    for (int i = 0; i < vec_len(ir->blocks); i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        for (int j = 0; j < vec_len(bb->insts); j++) {
+            int n = inst_uses(vec_at(bb->insts, j), uses);
+            for (int k = 0; k < n; k++)
+                num_uses[uses[k]]++;
+        }
+    }
+}
+
+void gen_x86(IRFunc *irf) {
+    ir = irf;
+    Func *func = ir->func;
+    count_uses();
+    if (profile_generate)
+        profile_func(ir);
+
+    // callee-saved registers in use are saved below the spill slots
+    saved = vec_new();
+    bool *used = calloc(16, sizeof(bool));
+    for (int v = 1; v <= ir->num_vregs; v++)
+        if (in_reg(v))
+            used[ir->regs[v]] = true;
+    Reg callee_saved[5] = {RBX, R12, R13, R14, R15};
+    for (int i = 0; i < 5; i++)
+        if (used[callee_saved[i]])
+            vec_push(saved, regs64[callee_saved[i]]);
+
+    int num_saved = vec_len(saved);
+    int frame = slot_offset(ir->num_slots + num_saved - 1);
+
+    emitf("  .p2align 4\n");
+    emitf("%s:\n", func->name);
+    if (omit_frame_pointer && is_leaf() && frame <= 128) {
+        fp = "rsp";
+    } else {
+        fp = "rbp";
+        emitf("  push rbp\n"
+               "  mov rbp, rsp\n");
+        emitf("  sub rsp, %d\n", (frame + 15) / 16 * 16);
+    }
+    for (int i = 0; i < num_saved; i++) {
+        char *r = vec_at(saved, i);
+        emitf("  mov [%s-%d], %s\n", fp, slot_offset(ir->num_slots + i), r);
+    }
+
+    if (func->is_varargs) {
+        emitf("  mov QWORD PTR [rbp-8], %d\n", 8 * vec_len(func->params));
+        for (int i = 0; i < 6; i++)
+            emitf("  mov [rbp-%d], %s\n", 56 - 8 * i, regs64[arg_regs[i]]);
+    }
+
+    bool *tops = loop_tops();
+    int len = vec_len(ir->blocks);
+    for (int i = 0; i < len; i++) {
+        BB *bb = vec_at(ir->blocks, i);
+        next_bb = vec_at(ir->blocks, i + 1);
+        if (tops[bb->id] && i > 0)
+            emitf("  .p2align 4,,10\n");
+        emitf("%s:\n", label(bb));
+        if (profile_generate)
+            profile_block(bb);
+        int j = i == 0 ? gen_params(bb) : 0;
+        for (; j < vec_len(bb->insts); j++) {
+            Inst *inst = vec_at(bb->insts, j);
+            if (inst->kind == IR_CALL && inst->is_tail) {
+                gen_tail_call(inst);
+                break;
+            }
+            Inst *term = bb_term(bb);
+            if (j == vec_len(bb->insts) - 2 && is_compare(inst) && term->kind == IR_BR
+                && term->a == inst->dst && num_uses[inst->dst] == 1) {
+                gen_fused_branch(inst, term);
+                break;
+            }
+            gen_inst(inst);
+        }
+    }
+
+    emitf(".L%s_return:\n", func->name);
+    gen_epilogue();
+    emitf("  ret\n");
+}